@@ -1,24 +1,43 @@
 #include "pch.h"
 #include "client.h"
 #include <concurrent_queue.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stun.h>
 
 struct session
 {
 	using t_send_queue = concurrency::concurrent_queue<std::tuple<std::function<std::tuple<void*, size_t>()>, std::function<void()>>>;
 
-	std::string	 name;
-	uint32		 c_id;
-	bool		 connected = false;
-	SOCKET		 sock;
-	t_send_queue send_queue;
-	char		 recv_buffer[1024];
-	uint32		 seq_num = 0;
+	std::string			   name;
+	uint32				   c_id;
+	bool				   connected = false;
+	SOCKET				   sock;
+	net_core::adapter_addr adapter;
+	t_send_queue		   send_queue;
+	char				   recv_buffer[1024];
+	uint32				   seq_num = 0;
+	// times the socket moved to a new address of its interface, and when the last old one went down
+	uint32				   rebind_count = 0;
+	uint64				   unbound_time = 0;
+
+	// send and recv threads run on sock while bound, the delay thread while the session lives
+	std::atomic<bool> bound = false;
+	std::atomic<bool> alive = true;
+
+	// public mapping of sock from binding requests sent on it, the nat's idle timeout from probe_sock on the same
+	// interface. the run loop ticks both, the recv thread hands answers to stun_mapping
+	std::mutex									  stun_mutex;
+	std::optional<net_core::stun::client>		  stun_mapping;
+	std::optional<net_core::stun::lifetime_probe> stun_lifetime;
+	SOCKET										  probe_sock = INVALID_SOCKET;
 
 	std::thread send_thread;
 	std::thread recv_thread;
 	std::thread delay_thread;
 
-	session(SOCKET sock) : sock(sock), c_id(-1)
+	session(SOCKET sock, net_core::adapter_addr adapter) : c_id(-1), sock(sock), adapter(std::move(adapter))
 	{
 	}
 };
@@ -29,8 +48,17 @@ namespace
 	constexpr auto server_addr = "121.88.244.43";
 	// constexpr auto								   server_addr = "2001:2d8:2120:8c19:5b69:cd74:bc6d:466e";
 
-	auto sessions		  = std::vector<session> {};
-	auto server_addr_info = sockaddr_in {};
+	constexpr uint64 adapter_filter[] = { IF_TYPE_ETHERNET_CSMACD, IF_TYPE_IEEE80211 };
+
+	// sessions come and go with the interfaces, threads hold their session by pointer
+	auto session_mutex	  = std::mutex {};
+	auto sessions		  = std::vector<std::unique_ptr<session>> {};
+	auto session_count	  = 0u;
+	// v4 or v6, sessions only bind addresses of its family
+	auto server_addr_info = net_core::endpoint {};
+	auto watcher		  = net_core::interface_watcher {};
+	// STUN_SERVER_HOST of the server's family, nullopt leaves the sessions without stun
+	auto stun_server	  = std::optional<net_core::endpoint> {};
 
 	auto sending = true;
 	auto recving = true;
@@ -41,13 +69,12 @@ namespace
 
 namespace
 {
-	void _send_loop(uint32 idx)
+	void _send_loop(session* p_session)
 	{
-		auto* p_session	 = &sessions[idx];
 		auto  sock		 = p_session->sock;
 		auto& send_queue = p_session->send_queue;
 		auto  func_tpl	 = std::tuple<std::function<std::tuple<void*, size_t>()>, std::function<void()>>();
-		while (sending)
+		while (sending and p_session->bound)
 		{
 			if (send_queue.try_pop(func_tpl) is_false)
 			{
@@ -58,7 +85,7 @@ namespace
 			auto&& [p_packet, len] = packet_func();
 
 			// p.time_client_send = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-			if (sendto(sock, (char*)p_packet, len, 0, (sockaddr*)&server_addr_info, sizeof(sockaddr_in)) == SOCKET_ERROR)
+			if (sendto(sock, (char*)p_packet, len, 0, server_addr_info.get(), server_addr_info.size()) == SOCKET_ERROR)
 			{
 				err_msg("sendto() failed");
 			}
@@ -76,33 +103,40 @@ namespace
 		}
 	}
 
-	void _recv_loop(uint32 idx)
+	void _recv_loop(session* p_session)
 	{
-		auto* p_session	  = &sessions[idx];
 		auto  sock		  = p_session->sock;
 		auto& recv_buffer = p_session->recv_buffer;
 
-		logger::info("{} recv_loop begin", idx);
+		logger::info("{} recv_loop begin", p_session->name);
 		while (recving)
 		{
 			// auto recv_len = ::recvfrom(sock, recv_buffer, sizeof(recv_buffer), 0, (sockaddr*)&addr, &len);
 			auto recv_len = ::recvfrom(sock, recv_buffer, sizeof(recv_buffer), 0, nullptr, nullptr);
-			// assert(recv_len >= sizeof(uint16));
+			if (recv_len == SOCKET_ERROR)
+			{
+				// the socket was closed under us for a rebind or because its interface is gone
+				if (p_session->bound is_false)
+				{
+					break;
+				}
+				err_msg("recvfrom() failed");
+				continue;
+			}
 
 			// auto* p_recv = (packet*)recv_buffer;
 			//  p_recv->time_client_recv = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-			client::handle_packet(idx, recv_buffer, recv_len);
+			client::handle_packet(p_session, recv_buffer, recv_len);
 
 			// auto duration = std::chrono::nanoseconds(p_recv->time_client_recv - p_recv->time_server_send);
 			// logger::info("[client] : seq num : {}, server->client duration : {}ns", p_recv->seq_num, duration.count());
 		}
 	}
 
-	void _delay_loop(uint32 idx)
+	void _delay_loop(session* p_session)
 	{
 		// todo
-		auto* p_session = &sessions[idx];
-		while (true)
+		while (p_session->alive)
 		{
 			p_session->send_queue.push({ [p_session]() {
 											auto* p_packet = (packet_3*)malloc(sizeof(packet_3));
@@ -126,6 +160,265 @@ namespace
 			Sleep(1000);
 		}
 	}
+
+	// stun_mutex held
+	void _on_stun_mapping(session* p_session, const net_core::stun::client_event& event)
+	{
+		switch (event.kind)
+		{
+		case net_core::stun::event_kind::mapped:
+			logger::info("[{}] {} is reachable at {} (stun rtt {:.1f} ms)", p_session->name, p_session->adapter.name, event.mapped.to_string(), (double64)event.rtt_ns / 1e6);
+			break;
+		case net_core::stun::event_kind::changed:
+			logger::warn("[{}] nat moved {} from {} to {}", p_session->name, p_session->adapter.name, event.previous.to_string(), event.mapped.to_string());
+			break;
+		case net_core::stun::event_kind::timeout:
+			logger::warn("[{}] no stun answer on {} from {}", p_session->name, p_session->adapter.name, stun_server->to_string());
+			break;
+		case net_core::stun::event_kind::error:
+			logger::error("[{}] stun server answered {} with error {}", p_session->name, p_session->adapter.name, event.error);
+			break;
+		case net_core::stun::event_kind::refreshed:
+			break;
+		}
+	}
+
+	// a probe socket on the session's interface and a new lifetime probe, the nat may be another one after a move.
+	// the mapping client carries over a rebind, so the move shows up as changed
+	void _open_stun(session* p_session)
+	{
+		if (stun_server.has_value() is_false)
+		{
+			return;
+		}
+
+		auto lock = std::lock_guard(p_session->stun_mutex);
+		if (p_session->stun_mapping.has_value() is_false)
+		{
+			p_session->stun_mapping.emplace(*stun_server);
+		}
+		p_session->stun_mapping->request_at(0);
+		p_session->stun_lifetime.emplace(*stun_server);
+
+		p_session->probe_sock = net_core::bind_sock(p_session->adapter, 0, true);
+		if (p_session->probe_sock != INVALID_SOCKET and net_core::set_nonblocking(p_session->probe_sock) is_false)
+		{
+			err_msg("stun probe socket failed");
+			::closesocket(p_session->probe_sock);
+			p_session->probe_sock = INVALID_SOCKET;
+		}
+	}
+
+	void _close_stun(session* p_session)
+	{
+		auto lock = std::lock_guard(p_session->stun_mutex);
+		if (p_session->probe_sock != INVALID_SOCKET)
+		{
+			::closesocket(p_session->probe_sock);
+			p_session->probe_sock = INVALID_SOCKET;
+		}
+	}
+
+	// run loop, session_mutex held so sock is not swapped under it
+	void _stun_tick(session* p_session, uint64 now)
+	{
+		auto lock = std::lock_guard(p_session->stun_mutex);
+		if (p_session->stun_mapping.has_value() is_false or p_session->bound is_false)
+		{
+			return;
+		}
+
+		auto& mapping = *p_session->stun_mapping;
+		mapping.tick(
+			now,
+			[&](std::span<const char> data) { ::sendto(p_session->sock, data.data(), (int)data.size(), 0, mapping.server.get(), mapping.server.size()); },
+			[&](const net_core::stun::client_event& event) { _on_stun_mapping(p_session, event); });
+		if (p_session->probe_sock == INVALID_SOCKET)
+		{
+			return;
+		}
+
+		auto& lifetime = *p_session->stun_lifetime;
+		auto  buf	   = std::array<char, net_core::stun::max_message_size> {};
+		while (true)
+		{
+			auto len = ::recvfrom(p_session->probe_sock, buf.data(), (int)buf.size(), 0, nullptr, nullptr);
+			if (len <= 0)
+			{
+				break;
+			}
+			lifetime.on_message({ buf.data(), (std::size_t)len }, now, [](const auto&) { });
+		}
+
+		if (lifetime.done())
+		{
+			// the mapping refresh doubles as the keepalive of the session's binding, at the pace this nat needs
+			auto keepalive = lifetime.keepalive_ns();
+			if (keepalive != 0)
+			{
+				mapping.config.refresh_ns = keepalive;
+				mapping.request_at(std::min(mapping.next_send, now + keepalive));
+			}
+
+			logger::info("[{}] nat of {} keeps an idle binding {}{}s, refreshing it every {}s", p_session->name, p_session->adapter.name,
+						 lifetime.lost_ns == 0 ? "at least " : "", lifetime.kept_ns / 1'000'000'000, mapping.config.refresh_ns / 1'000'000'000);
+			::closesocket(p_session->probe_sock);
+			p_session->probe_sock = INVALID_SOCKET;
+			return;
+		}
+
+		// timeouts are the mapping's to report, the probe retries on its own
+		lifetime.tick(
+			now,
+			[&](std::span<const char> data) {
+				auto& server = lifetime.transactions.server;
+				::sendto(p_session->probe_sock, data.data(), (int)data.size(), 0, server.get(), server.size());
+			},
+			[](const auto&) { });
+	}
+
+	std::unique_ptr<session> _create_session(const net_core::adapter_addr& adapter)
+	{
+		auto sock = net_core::bind_sock(adapter, PORT_CLIENT, true);
+		if (sock == INVALID_SOCKET)
+		{
+			return nullptr;
+		}
+
+		auto p_session	= std::make_unique<session>(sock, adapter);
+		p_session->name = std::format("{}_{}", client_name, session_count++);
+		return p_session;
+	}
+
+	// starts the socket threads. the first packet registers the session, or, once it has an id, tells the server
+	// that the same client moved so its models and seq numbering carry on
+	void _bind_session(session* p_session)
+	{
+		if (p_session->c_id == (uint32)-1)
+		{
+			p_session->send_queue.push({ [p_session]() {
+											auto& sock_name = p_session->name;
+											char* p_packet	= (char*)malloc(sizeof(uint16) + sizeof(uint16) + sizeof(char) * sock_name.size());
+											assert(p_packet != nullptr);
+											{
+												*(uint16*)p_packet					  = 0;
+												*(uint16*)(p_packet + sizeof(uint16)) = (uint16)sock_name.size();
+												memcpy(p_packet + sizeof(uint16) * 2, sock_name.c_str(), sock_name.size());
+											}
+											return std::tuple { (void*)p_packet, sizeof(uint16) * 2 + sizeof(char) * sock_name.size() };
+										},
+										 nullptr });
+		}
+		else
+		{
+			p_session->send_queue.push({ [p_session]() {
+											auto* p_packet = (packet_4*)malloc(sizeof(packet_4));
+											assert(p_packet != nullptr);
+											{
+												p_packet->type		   = 4;
+												p_packet->client_id	   = p_session->c_id;
+												p_packet->seq_num	   = p_session->seq_num;
+												p_packet->rebind_count = p_session->rebind_count;
+												p_packet->gap		   = utils::time_now() - p_session->unbound_time;
+											}
+
+											return std::tuple { (void*)p_packet, sizeof(packet_4) };
+										},
+										 nullptr });
+		}
+
+		p_session->bound	   = true;
+		p_session->send_thread = std::thread(_send_loop, p_session);
+		p_session->recv_thread = std::thread(_recv_loop, p_session);
+		_open_stun(p_session);
+	}
+
+	// stops the socket threads and closes the socket, queued packets wait for the next one
+	void _unbind_session(session* p_session)
+	{
+		p_session->bound = false;
+		p_session->send_thread.join();
+		// wakes the blocked recvfrom
+		::closesocket(p_session->sock);
+		p_session->recv_thread.join();
+		p_session->unbound_time = utils::time_now();
+		_close_stun(p_session);
+	}
+
+	void _retire_session(session* p_session)
+	{
+		logger::info("[{}] {} is gone, session closed", p_session->name, p_session->adapter.name);
+		p_session->alive = false;
+		_unbind_session(p_session);
+		if (p_session->delay_thread.joinable())
+		{
+			p_session->delay_thread.join();
+		}
+	}
+
+	// watcher thread. sessions whose address is still there stay, a session whose interface got a new address moves
+	// to it, the rest are retired, and every address nobody has gets a new session. retirements go last, they wait on
+	// the delay thread's sleep
+	void _on_interface_change()
+	{
+		auto adapters = net_core::get_adapter_addrs(adapter_filter, server_addr_info.family());
+		auto lock	  = std::lock_guard(session_mutex);
+
+		auto unclaimed = adapters
+					   | std::views::filter([](const net_core::adapter_addr& adapter) {
+							 return std::ranges::find(sessions, adapter, [](const auto& p_session) { return p_session->adapter; }) == sessions.end();
+						 })
+					   | std::ranges::to<std::vector>();
+		auto stale	   = std::vector<session*> {};
+		for (auto& p_session : sessions)
+		{
+			if (std::ranges::find(adapters, p_session->adapter) != adapters.end())
+			{
+				continue;
+			}
+
+			auto it = std::ranges::find(unclaimed, p_session->adapter.if_index, &net_core::adapter_addr::if_index);
+			if (it == unclaimed.end())
+			{
+				stale.push_back(p_session.get());
+				continue;
+			}
+
+			auto sock = net_core::bind_sock(*it, PORT_CLIENT, true);
+			if (sock == INVALID_SOCKET)
+			{
+				stale.push_back(p_session.get());
+				continue;
+			}
+
+			logger::info("[{}] {} moved from {} to {}, rebinding", p_session->name, it->name, p_session->adapter.addr.to_string(), it->addr.to_string());
+			_unbind_session(p_session.get());
+			p_session->sock	   = sock;
+			p_session->adapter = *it;
+			++p_session->rebind_count;
+			_bind_session(p_session.get());
+			unclaimed.erase(it);
+		}
+
+		for (auto& adapter : unclaimed)
+		{
+			auto p_session = _create_session(adapter);
+			if (p_session is_nullptr)
+			{
+				continue;
+			}
+
+			logger::info("[{}] new interface {}", p_session->name, adapter.name);
+			_bind_session(p_session.get());
+			sessions.push_back(std::move(p_session));
+		}
+
+		for (auto* p_session : stale)
+		{
+			_retire_session(p_session);
+		}
+		std::erase_if(sessions, [](const auto& p_session) { return p_session->alive is_false; });
+	}
 }	 // namespace
 
 bool client::init()
@@ -133,7 +426,6 @@ bool client::init()
 	logger::init("client_log.txt");
 
 	auto wsa_data = WSADATA {};
-	ZeroMemory(&server_addr_info, sizeof(server_addr_info));
 
 	if (::WSAStartup(MAKEWORD(2, 2), &wsa_data) != S_OK)
 	{
@@ -143,17 +435,24 @@ bool client::init()
 		goto failed;
 	}
 
-	server_addr_info.sin_family = AF_INET;
-	server_addr_info.sin_port	= ::htons(PORT_SERVER);
-	if (inet_pton(AF_INET, server_addr, &server_addr_info.sin_addr) != 1)
+	if (auto addr = net_core::endpoint::parse(server_addr, PORT_SERVER); addr.has_value())
 	{
-		err_msg("inet_pton() failed");
+		server_addr_info = *addr;
+		stun_server		 = net_core::stun_server(server_addr_info.family());
+	}
+	else
+	{
+		logger::error("server address {} is not a numeric ipv4 or ipv6 address", server_addr);
 		goto failed;
 	}
 
-	sessions = net_core::get_binded_socks(PORT_CLIENT, { IF_TYPE_ETHERNET_CSMACD, IF_TYPE_IEEE80211 })
-			 | std::views::transform([](auto sock) { return session(sock); })
-			 | std::ranges::to<std::vector>();
+	for (auto& adapter : net_core::get_adapter_addrs(adapter_filter, server_addr_info.family()))
+	{
+		if (auto p_session = _create_session(adapter); p_session != nullptr)
+		{
+			sessions.push_back(std::move(p_session));
+		}
+	}
 
 	if (sessions.size() == 0)
 	{
@@ -169,40 +468,52 @@ failed:
 
 void client::run()
 {
-	for (auto idx : std::views::iota(0ull, sessions.size()))
 	{
-		sessions[idx].send_queue.push({ [idx]() {
-										   sessions[idx].name = std::format("{}_{}", client_name, idx);
-										   auto& sock_name	  = sessions[idx].name;
-										   char* p_packet	  = (char*)malloc(sizeof(uint16) + sizeof(uint16) + sizeof(char) * sock_name.size());
-										   assert(p_packet != nullptr);
-										   {
-											   *(uint16*)p_packet					 = 0;
-											   *(uint16*)(p_packet + sizeof(uint16)) = (uint16)sock_name.size();
-											   memcpy(p_packet + sizeof(uint16) * 2, sock_name.c_str(), sock_name.size());
-										   }
-										   return std::tuple { (void*)p_packet, sizeof(uint16) * 2 + sizeof(char) * sock_name.size() };
-									   },
-										nullptr });
-
-		sessions[idx].send_thread = std::thread(_send_loop, idx);
-		sessions[idx].recv_thread = std::thread(_recv_loop, idx);
+		auto lock = std::lock_guard(session_mutex);
+		for (auto& p_session : sessions)
+		{
+			_bind_session(p_session.get());
+		}
+	}
+
+	// from here on sessions follow the interfaces
+	if (watcher.start(_on_interface_change) is_false)
+	{
+		logger::error("interface watcher failed to start, sessions stay on the addresses they have");
 	}
 
-	for (auto idx : std::views::iota(0ull, sessions.size()))
+	// the stun timers of every session, retransmissions start at 500 ms
+	while (sending)
 	{
-		sessions[idx].send_thread.join();
-		sessions[idx].recv_thread.join();
+		{
+			auto lock = std::lock_guard(session_mutex);
+			auto now  = utils::steady_now();
+			for (auto& p_session : sessions)
+			{
+				_stun_tick(p_session.get(), now);
+			}
+		}
+		Sleep(100);
 	}
 }
 
 void client::deinit()
 {
+	watcher.stop();
+	{
+		auto lock = std::lock_guard(session_mutex);
+		for (auto& p_session : sessions)
+		{
+			_retire_session(p_session.get());
+		}
+		sessions.clear();
+	}
+
 	logger::clear();
 	::WSACleanup();
 }
 
-void client::handle_packet(uint32 session_idx, void* p_mem, int32 recv_len)
+void client::handle_packet(session* p_session, void* p_mem, int32 recv_len)
 {
 	if (recv_len < sizeof(uint16))
 	{
@@ -210,8 +521,19 @@ void client::handle_packet(uint32 session_idx, void* p_mem, int32 recv_len)
 		return;
 	}
 
-	auto  packet_type = *(uint16*)p_mem;
-	auto* p_session	  = &sessions[session_idx];
+	// answers to the session's binding requests share the socket with the server's packets
+	auto data = std::span<const char>((const char*)p_mem, recv_len);
+	if (net_core::stun::is_message(data))
+	{
+		auto lock = std::lock_guard(p_session->stun_mutex);
+		if (p_session->stun_mapping.has_value())
+		{
+			p_session->stun_mapping->on_message(data, utils::steady_now(), [&](const net_core::stun::client_event& event) { _on_stun_mapping(p_session, event); });
+		}
+		return;
+	}
+
+	auto packet_type = *(uint16*)p_mem;
 
 	switch (packet_type)
 	{
@@ -219,7 +541,7 @@ void client::handle_packet(uint32 session_idx, void* p_mem, int32 recv_len)
 	{
 		if (recv_len != sizeof(packet_1))
 		{
-			logger::error("session idx : [{}] invalid packet, packet type : {} but recv_len is {}", session_idx, packet_type, recv_len);
+			logger::error("session [{}] invalid packet, packet type : {} but recv_len is {}", p_session->name, packet_type, recv_len);
 		}
 
 		auto* p_packet = (packet_1*)p_mem;
@@ -244,7 +566,12 @@ void client::handle_packet(uint32 session_idx, void* p_mem, int32 recv_len)
 										return std::tuple { (void*)p_packet, sizeof(packet_2) };
 									},
 									 nullptr });
-		p_session->delay_thread = std::thread(_delay_loop, session_idx);
+
+		// the answer to a rejoin, measuring never stopped
+		if (p_session->delay_thread.joinable() is_false)
+		{
+			p_session->delay_thread = std::thread(_delay_loop, p_session);
+		}
 		break;
 	}
 	case 3:
@@ -1,10 +1,12 @@
 #pragma once
 
+struct session;
+
 namespace client
 {
 	bool init();
 	void run();
 	void deinit();
 
-	void handle_packet(uint32 session_idx, void* p_packet, int32 recv_len);
+	void handle_packet(session* p_session, void* p_packet, int32 recv_len);
 }	 // namespace client
\ No newline at end of file
@@ -0,0 +1,154 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <ranges>
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <cmath>
+#include <cassert>
+#include "common.h"
+#include "thread_pool.h"
+#include "predictor.h"
+
+struct named_trace
+{
+	std::string			  name;
+	std::vector<double64> values;
+};
+
+// how to build one kind of predictor, from the warm-up part of the trace it will replay
+struct predictor_entry
+{
+	std::string											   name;
+	std::function<any_predictor(std::span<const double64>)> make;
+};
+
+struct backtest_config
+{
+	// head of every trace used to build and warm the predictor, never scored
+	double64				 warmup_fraction = 0.2;
+	// forecast distances, 1 is the next sample
+	std::vector<std::size_t> horizons		 = { 1 };
+};
+
+// one (trace, predictor, horizon)
+struct backtest_score
+{
+	std::string trace;
+	std::string predictor;
+	std::size_t horizon;
+	std::size_t count;
+	double64	mae;
+	double64	rmse;
+	// make() on the warm-up data, training included
+	double64	fit_ms;
+	// one replay step : update with the new delay and one forecast per horizon
+	double64	ns_per_step;
+};
+
+struct backtest_result
+{
+	std::vector<backtest_score> scores;
+	double64					elapsed_ms;
+
+	void print() const
+	{
+		std::cout << std::format("{:>16} {:>12} {:>3} | {:>8} | {:>14} {:>14} | {:>9} {:>10}\n", "trace", "predictor", "k", "count", "MAE", "RMSE", "fit ms", "ns/step");
+		for (auto& score : scores)
+		{
+			std::cout << std::format("{:>16} {:>12} {:>3} | {:>8} | {:>14.3f} {:>14.3f} | {:>9.2f} {:>10.1f}\n",
+									 score.trace, score.predictor, score.horizon, score.count, score.mae, score.rmse, score.fit_ms, score.ns_per_step);
+		}
+	}
+};
+
+// replays every trace through every predictor, one (trace, predictor) pair per pool task.
+// a pair builds its predictor from the warm-up head, feeds the head through update(), then walks the rest :
+// before each sample x_t it asks predict(k) for every horizon, a forecast of x_t+k-1, then feeds x_t.
+// scores come out grouped by trace, then horizon, then predictor in the order given.
+inline backtest_result backtest(thread_pool& pool, std::span<const named_trace> traces, std::span<const predictor_entry> predictors, const backtest_config& config)
+{
+	auto begin	   = std::chrono::steady_clock::now();
+	auto horizons  = config.horizons;
+	assert(std::ranges::all_of(horizons, [](std::size_t k) { return k >= 1; }));
+	auto pair_runs = std::vector<std::vector<backtest_score>>(traces.size() * predictors.size());
+
+	pool.parallel_for(pair_runs.size(), [&](std::size_t pair_idx, std::size_t) {
+		auto& trace	 = traces[pair_idx / predictors.size()];
+		auto& entry	 = predictors[pair_idx % predictors.size()];
+		auto  values = std::span<const double64>(trace.values);
+		auto  warmup = values.first((std::size_t)((double64)values.size() * config.warmup_fraction));
+		auto  test	 = values.subspan(warmup.size());
+
+		auto fit_begin = std::chrono::steady_clock::now();
+		auto p		   = entry.make(warmup);
+		auto fit_ms	   = std::chrono::duration<double64, std::milli>(std::chrono::steady_clock::now() - fit_begin).count();
+		for (auto x : warmup)
+		{
+			update(p, x);
+		}
+
+		// forecast[h][t] : forecast of test[t] made horizons[h] - 1 samples before it
+		auto forecast	= std::vector<std::vector<double64>>(horizons.size(), std::vector<double64>(test.size(), 0.0));
+		auto run_begin	= std::chrono::steady_clock::now();
+		for (auto t : std::views::iota(0uz, test.size()))
+		{
+			for (auto h : std::views::iota(0uz, horizons.size()))
+			{
+				auto target = t + horizons[h] - 1;
+				auto value	= predict(p, horizons[h]);
+				if (target < test.size())
+				{
+					forecast[h][target] = value;
+				}
+			}
+			update(p, test[t]);
+		}
+		auto run_ns = std::chrono::duration<double64, std::nano>(std::chrono::steady_clock::now() - run_begin).count();
+
+		for (auto h : std::views::iota(0uz, horizons.size()))
+		{
+			auto first	   = std::min(horizons[h] - 1, test.size());
+			auto abs_error = 0.0;
+			auto sq_error  = 0.0;
+			for (auto t : std::views::iota(first, test.size()))
+			{
+				auto err   = test[t] - forecast[h][t];
+				abs_error += std::abs(err);
+				sq_error  += err * err;
+			}
+
+			auto count = test.size() - first;
+			auto n	   = (double64)std::max(count, 1uz);
+			pair_runs[pair_idx].push_back({
+				.trace		 = trace.name,
+				.predictor	 = entry.name,
+				.horizon	 = horizons[h],
+				.count		 = count,
+				.mae		 = abs_error / n,
+				.rmse		 = std::sqrt(sq_error / n),
+				.fit_ms		 = fit_ms,
+				.ns_per_step = run_ns / (double64)std::max(test.size(), 1uz),
+			});
+		}
+	});
+
+	auto res = backtest_result {};
+	for (auto trace_idx : std::views::iota(0uz, traces.size()))
+	{
+		for (auto h : std::views::iota(0uz, horizons.size()))
+		{
+			for (auto pred_idx : std::views::iota(0uz, predictors.size()))
+			{
+				res.scores.push_back(pair_runs[trace_idx * predictors.size() + pred_idx][h]);
+			}
+		}
+	}
+
+	res.elapsed_ms = std::chrono::duration<double64, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	return res;
+}
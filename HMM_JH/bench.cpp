@@ -0,0 +1,801 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <format>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <regex>
+#include <array>
+#include <bit>
+#include <filesystem>
+#include <numeric>
+#include "common.h"
+#include "model.h"
+#include "dyn_model.h"
+#include "trainer.h"
+#include "online_model.h"
+#include "stream_filter.h"
+#include "gmm_model.h"
+#include "discretizer.h"
+#include "stream_decoder.h"
+#include "model_store.h"
+#include "trace_reader.h"
+#include "lstm_model.h"
+#include "change_detector.h"
+#include "event_queue.h"
+#include "model_pool.h"
+#include "feature_engine.h"
+
+namespace
+{
+	constexpr auto bench_state_count	   = 5;
+	constexpr auto bench_observation_count = 10;
+	constexpr auto bench_repeat			   = 2000;
+
+	std::vector<t_observation> gen_observations(std::size_t len)
+	{
+		std::mt19937						 gen(42);
+		std::uniform_int_distribution<int32> dist(0, bench_observation_count - 1);
+
+		auto res = std::vector<t_observation>(len);
+		for (auto& o : res)
+		{
+			o = (t_observation)dist(gen);
+		}
+		return res;
+	}
+
+	template <typename t_func>
+	double64 ns_per_call(t_func&& func, int32 repeat)
+	{
+		auto begin = std::chrono::steady_clock::now();
+		for (auto _ : std::views::iota(0, repeat))
+		{
+			func();
+		}
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double64, std::nano>(end - begin).count() / repeat;
+	}
+
+	// one baum_welch step on the fixed model<> vs the runtime dyn_model, same sequence
+	template <std::size_t T>
+	void bench_fixed_vs_dyn()
+	{
+		auto observations = gen_observations(T);
+
+		// model<> is too big for the stack once T grows
+		auto p_fixed = std::make_unique<model<bench_state_count, bench_observation_count, T>>();
+		p_fixed->init_A_B_pi();
+		p_fixed->update_observations(observations);
+		auto fixed_ns = ns_per_call([&]() { p_fixed->baum_welch(); }, bench_repeat);
+
+		auto dyn = dyn_model(bench_state_count, bench_observation_count);
+		dyn.init_A_B_pi();
+		dyn.update_observations(observations);
+		auto dyn_ns = ns_per_call([&]() { dyn.baum_welch(); }, bench_repeat);
+
+		std::cout << std::format("N = {}, M = {}, T = {:>4} | model<> : {:>10.1f} ns/iter ({:.2f} ns/sample) | dyn_model : {:>10.1f} ns/iter ({:.2f} ns/sample)\n",
+								 bench_state_count, bench_observation_count, T,
+								 fixed_ns, fixed_ns / T,
+								 dyn_ns, dyn_ns / T);
+	}
+
+	// forward / backward / viterbi / baum_welch per kernel set, checked against the scalar set
+	void bench_kernels(std::size_t state_count)
+	{
+		constexpr auto seq_len = 4096uz;
+		constexpr auto repeat  = 20;
+
+		auto ref = dyn_model(state_count, bench_observation_count);
+		ref.init_A_B_pi();
+		ref.update_observations(gen_observations(seq_len));
+		ref.p_kernels = &kernel::scalar_set;
+		ref.forward();
+		ref.backward();
+		ref.viterbi();
+
+		for (auto type : { kernel::isa::scalar, kernel::isa::avx2, kernel::isa::avx512 })
+		{
+			auto* p_set = kernel::find(type);
+			if (p_set == nullptr)
+			{
+				continue;
+			}
+
+			auto hmm	  = ref;
+			hmm.p_kernels = p_set;
+
+			auto forward_ns	 = ns_per_call([&]() { hmm.forward(); }, repeat);
+			auto backward_ns = ns_per_call([&]() { hmm.backward(); }, repeat);
+			auto viterbi_ns	 = ns_per_call([&]() { hmm.viterbi(); }, repeat);
+
+			auto max_diff = 0.0;
+			for (auto i : std::views::iota(0uz, ref.alpha.size()))
+			{
+				max_diff = std::max({ max_diff, std::abs(hmm.alpha[i] - ref.alpha[i]), std::abs(hmm.beta[i] - ref.beta[i]) });
+			}
+			auto path_mismatch = 0uz;
+			for (auto t : std::views::iota(0uz, seq_len))
+			{
+				path_mismatch += hmm.path[t] != ref.path[t];
+			}
+
+			auto em_ns = ns_per_call([&]() { hmm.baum_welch(); }, repeat);
+
+			std::cout << std::format("N = {:>2}, {:<6} | forward {:>7.2f} ns/sample | backward {:>7.2f} ns/sample | viterbi {:>7.2f} ns/sample | baum_welch {:>8.2f} ns/sample | max |diff| {:.2e}, path mismatch {}\n",
+									 state_count, p_set->name,
+									 forward_ns / seq_len, backward_ns / seq_len, viterbi_ns / seq_len, em_ns / seq_len,
+									 max_diff, path_mismatch);
+		}
+	}
+
+	// one multi-sequence em iteration for growing worker counts, same corpus and same start
+	void bench_trainer()
+	{
+		constexpr auto state_count	  = 8uz;
+		constexpr auto sequence_count = 256uz;
+		constexpr auto seq_len		  = 4096uz;
+
+		auto corpus	   = gen_observations(sequence_count * seq_len);
+		auto sequences = em_trainer::split(corpus, seq_len);
+
+		auto init = dyn_model(state_count, bench_observation_count);
+		init.init_A_B_pi();
+
+		auto base_ns = 0.0;
+		for (auto worker_count = 1uz; worker_count <= std::max(1u, std::thread::hardware_concurrency()); worker_count *= 2)
+		{
+			auto pool	 = thread_pool(worker_count);
+			auto trainer = em_trainer(pool);
+			auto hmm	 = init;
+
+			auto log_likelihood = 0.0;
+			auto ns				= ns_per_call([&]() { hmm = init; log_likelihood = trainer.step(hmm, sequences); }, 3);
+			base_ns				= worker_count == 1 ? ns : base_ns;
+
+			std::cout << std::format("em_trainer N = {}, {} x {} samples, workers = {:>2} | {:>8.2f} ms/iter | {:>6.2f} ns/sample | speedup {:.2f} | log likelihood {:.6f}\n",
+									 state_count, sequence_count, seq_len, worker_count,
+									 ns / 1e6, ns / (sequence_count * seq_len), base_ns / ns, log_likelihood);
+		}
+	}
+
+	// online em, cost of one delay sample
+	void bench_online(std::size_t state_count)
+	{
+		constexpr auto sample_count = 1uz << 18;
+
+		auto observations = gen_observations(sample_count);
+		auto online		  = online_model(state_count, bench_observation_count);
+		online.init_random(42);
+
+		auto ns = ns_per_call([&]() {
+			for (auto o : observations)
+			{
+				online.update(o);
+			}
+		}, 1);
+
+		std::cout << std::format("online_model N = {:>2} | {:>7.2f} ns/sample | step size {:.4f} | log likelihood / sample {:.6f}\n",
+								 state_count, ns / sample_count, online.step_size(), online.log_likelihood / (double64)online.sample_count);
+	}
+
+	// streaming inference, per sample : filter update, lag 4 smoothing, 1 step delay prediction
+	void bench_stream(std::size_t state_count)
+	{
+		constexpr auto sample_count = 1uz << 16;
+
+		auto observations = gen_observations(sample_count);
+		auto hmm		  = dyn_model(state_count, bench_observation_count);
+		hmm.init_A_B_pi(42);
+
+		auto filter		= stream_filter(hmm, 4);
+		auto prediction = std::vector<double64>(bench_observation_count);
+		auto checksum	= 0.0;
+
+		auto update_ns = ns_per_call([&]() {
+			for (auto o : observations)
+			{
+				filter.update(o);
+			}
+		}, 1) / sample_count;
+
+		auto smooth_ns = ns_per_call([&]() {
+			for (auto _ : std::views::iota(0uz, sample_count))
+			{
+				checksum += filter.smoothed()[0];
+			}
+		}, 1) / sample_count;
+
+		auto predict_ns = ns_per_call([&]() {
+			for (auto _ : std::views::iota(0uz, sample_count))
+			{
+				filter.predict(1, prediction);
+				checksum += prediction[0];
+			}
+		}, 1) / sample_count;
+
+		std::cout << std::format("stream_filter N = {:>2}, {} | update {:>6.1f} ns | smoothed (lag 4) {:>6.1f} ns | predict (k = 1) {:>6.1f} ns | checksum {:.3f}\n",
+								 state_count, hmm.p_kernels->name, update_ns, smooth_ns, predict_ns, checksum);
+	}
+
+	// continuous emissions : density evaluation alone and one full em iteration
+	void bench_gmm(std::size_t state_count, std::size_t mixture_count)
+	{
+		constexpr auto sample_count = 1uz << 16;
+
+		std::mt19937						 gen(42);
+		std::lognormal_distribution<double64> dist(14.5, 0.6);
+		auto delays = std::vector<double64>(sample_count);
+		for (auto& x : delays)
+		{
+			x = dist(gen);
+		}
+
+		auto hmm = gmm_model(state_count, mixture_count);
+		hmm.update_observations(delays);
+		hmm.init_from_data(delays);
+
+		auto density_ns = ns_per_call([&]() { hmm.emission_log_density(); }, 20) / sample_count;
+		auto em_ns		= ns_per_call([&]() { hmm.baum_welch(); }, 5) / sample_count;
+
+		std::cout << std::format("gmm_model N = {:>2}, K = {} | density {:>6.2f} ns/sample | baum_welch {:>7.2f} ns/sample\n",
+								 state_count, mixture_count, density_ns, em_ns);
+	}
+
+	// delay -> symbol : branch-free search against std::upper_bound
+	void bench_discretizer(std::size_t symbol_count)
+	{
+		constexpr auto sample_count = 1uz << 20;
+
+		std::mt19937						  gen(42);
+		std::lognormal_distribution<double64> dist(14.5, 0.8);
+		auto delays = std::vector<double64>(sample_count);
+		auto sketch = quantile_sketch();
+		for (auto& x : delays)
+		{
+			x = dist(gen);
+			sketch.add(x);
+		}
+
+		auto binning = discretizer::quantile(sketch, symbol_count);
+		auto ref	 = std::vector<t_observation>(sample_count);
+		auto out	 = std::vector<t_observation>(sample_count);
+
+		auto ref_ns = ns_per_call([&]() {
+			for (auto i : std::views::iota(0uz, sample_count))
+			{
+				ref[i] = (t_observation)(std::ranges::upper_bound(binning.edges, delays[i]) - binning.edges.begin());
+			}
+		}, 5) / sample_count;
+
+		auto single_ns = ns_per_call([&]() {
+			for (auto i : std::views::iota(0uz, sample_count))
+			{
+				out[i] = binning(delays[i]);
+			}
+		}, 5) / sample_count;
+
+		auto mismatch = 0uz;
+		for (auto i : std::views::iota(0uz, sample_count))
+		{
+			mismatch += out[i] != ref[i];
+		}
+
+		// how equal the mass of the sketch's bins really is
+		auto hist = std::vector<std::size_t>(binning.symbol_count());
+		for (auto o : out)
+		{
+			++hist[o];
+		}
+
+		std::cout << std::format("discretizer M = {:>3} | upper_bound {:>5.2f} ns | branch-free {:>5.2f} ns | mismatch {} | bin mass {:.4f} .. {:.4f}\n",
+								 binning.symbol_count(), ref_ns, single_ns, mismatch,
+								 (double64)std::ranges::min(hist) / sample_count, (double64)std::ranges::max(hist) / sample_count);
+	}
+
+	// long trace decoding : scaled, log space, checkpointed (sqrt(T) memory), fixed-lag streaming
+	void bench_viterbi(std::size_t state_count)
+	{
+		constexpr auto sample_count = 1uz << 20;
+
+		auto hmm = dyn_model(state_count, bench_observation_count);
+		hmm.init_A_B_pi(42);
+		hmm.update_observations(gen_observations(sample_count));
+
+		auto scaled_ns		 = ns_per_call([&]() { hmm.viterbi(); }, 1) / sample_count;
+		auto log_ns			 = ns_per_call([&]() { hmm.viterbi_log(); }, 1) / sample_count;
+		auto ref			 = hmm.path;
+		auto checkpointed_ns = ns_per_call([&]() { hmm.viterbi_checkpointed(); }, 1) / sample_count;
+
+		auto mismatch = 0uz;
+		for (auto t : std::views::iota(0uz, sample_count))
+		{
+			mismatch += hmm.path[t] != ref[t];
+		}
+
+		auto decoder   = stream_decoder(hmm, 32);
+		auto checksum  = 0uz;
+		auto stream_ns = ns_per_call([&]() {
+			for (auto o : hmm.observations)
+			{
+				checksum += decoder.update(o).value_or(0);
+			}
+		}, 1) / sample_count;
+
+		auto segment_len = (std::size_t)std::sqrt((double64)sample_count);
+		std::cout << std::format("viterbi N = {:>2}, T = {} | scaled {:>6.2f} | log {:>6.2f} | checkpointed {:>6.2f} | stream (lag 32) {:>6.2f} ns/sample | psi {} KiB -> {} KiB, mismatch {}, checksum {}\n",
+								 state_count, sample_count, scaled_ns, log_ns, checkpointed_ns, stream_ns,
+								 sample_count * state_count * sizeof(t_state) / 1024, (segment_len + sample_count / segment_len) * state_count * sizeof(double64) / 1024, mismatch, checksum);
+	}
+
+	// startup cost of per-client models : text files parsed one by one vs one mapped pack
+	void bench_model_store(std::size_t model_count)
+	{
+		constexpr auto text_sample = 100uz;
+
+		auto writer = model_store::pack_writer {};
+		auto hmm	= dyn_model(bench_state_count, 16);
+		for (auto key : std::views::iota(0uz, model_count))
+		{
+			hmm.init_A_B_pi(key);
+			writer.add(key, hmm);
+		}
+
+		auto pack_path = std::string("bench_models.pack");
+		auto text_path = std::string("bench_model.txt");
+		writer.save(pack_path);
+		hmm.save(text_path);
+
+		auto checksum = 0.0;
+		auto pack_ns  = ns_per_call([&]() {
+			auto pack = model_store::pack {};
+			pack.open(pack_path);
+			for (auto key : std::views::iota(0uz, model_count))
+			{
+				checksum += pack.find(key)->a(0, 0);
+			}
+		}, 5);
+
+		auto text_ns = ns_per_call([&]() {
+			auto loaded = dyn_model(1, 1);
+			loaded.load(text_path);
+			checksum += loaded.a(0, 0);
+		}, text_sample);
+
+		std::cout << std::format("model_store {} models | mapped pack open + find all {:>8.3f} ms | text load {:>8.3f} ms (extrapolated) | checksum {:.3f}\n",
+								 model_count, pack_ns / 1e6, text_ns * model_count / 1e6, checksum);
+
+		std::remove(pack_path.c_str());
+		std::remove(text_path.c_str());
+	}
+
+	// "seq[n], delay = d" trace : the old getline + regex loop vs the mapped scanner on one thread and on the pool
+	void bench_ingest(std::size_t line_count)
+	{
+		auto path = std::string("bench_delay.txt");
+		{
+			auto rng   = std::mt19937_64(7);
+			auto dist  = std::lognormal_distribution<double64>(15.0, 1.0);
+			auto out   = std::ofstream(path);
+			for (auto idx : std::views::iota(1uz, line_count + 1))
+			{
+				out << "seq[" << idx << "], delay = " << (uint64)dist(rng) << '\n';
+			}
+		}
+
+		auto file = mapped_file {};
+		file.open(path);
+		auto text = std::string_view((const char*)file.p_data, file.size);
+		auto gb	  = (double64)text.size() / 1e9;
+
+		auto regex_begin = std::chrono::steady_clock::now();
+		auto expected	 = std::vector<double64> {};
+		{
+			auto in			= std::ifstream(path);
+			auto num_regex	= std::regex(R"((\d+)\s*$)");
+			auto line		= std::string {};
+			auto match		= std::smatch {};
+			while (std::getline(in, line))
+			{
+				if (std::regex_search(line, match, num_regex))
+				{
+					expected.push_back(std::stod(match[1]));
+				}
+			}
+		}
+		auto regex_s = std::chrono::duration<double64>(std::chrono::steady_clock::now() - regex_begin).count();
+
+		auto single = delay_trace {};
+		auto single_s = ns_per_call([&]() {
+			single.clear();
+			trace_ingest::parse(text, single);
+		}, 5) / 1e9;
+
+		auto pool	 = thread_pool();
+		auto chunked = delay_trace {};
+		auto report	 = ingest_report {};
+		auto pool_s	 = ns_per_call([&]() {
+			chunked.clear();
+			report = trace_ingest::parse(pool, text, chunked);
+		}, 5) / 1e9;
+
+		auto mismatch = (std::size_t)(chunked.delay != expected) + (std::size_t)(single.delay != expected);
+		for (auto idx : std::views::iota(0uz, chunked.size()))
+		{
+			mismatch += chunked.seq[idx] != idx + 1;
+		}
+
+		std::cout << std::format("ingest {} lines, {:.1f} MB | regex {:>7.3f} GB/s | scanner {:>7.3f} GB/s | scanner x {} threads ({} chunks) {:>7.3f} GB/s | mismatch {}\n",
+								 line_count, gb * 1e3, gb / regex_s, gb / single_s, pool.size(), report.chunk_count, gb / pool_s, mismatch);
+
+		file.close();
+		std::remove(path.c_str());
+	}
+
+	// lstm of the notebook shape (window 10, LSTM(50), Dense(1)) with random weights :
+	// float32 / int8 against a double reference with exact activations, then predictions per ms by batch size
+	void bench_lstm(std::size_t unit_count)
+	{
+		constexpr auto window_size = 10uz;
+
+		auto gen	= std::mt19937_64(3);
+		auto weight = std::normal_distribution<float32>(0.0f, 0.3f);
+		auto model	= lstm_model {};
+		model.window_size = window_size;
+		model.scale_min	  = 1e5;
+		model.scale_max	  = 1e8;
+
+		auto layer = lstm_layer { 1, unit_count, false, dense_weights(4 * unit_count, 1 + unit_count) };
+		auto dense = dense_layer { dense_weights(1, unit_count), activation::linear };
+		for (auto* p_weights : { &layer.gates, &dense.weights })
+		{
+			std::ranges::generate(p_weights->w, [&]() { return weight(gen); });
+			std::ranges::generate(p_weights->bias, [&]() { return weight(gen); });
+		}
+		model.lstm_layers.push_back(layer);
+		model.dense_layers.push_back(dense);
+
+		// round trip through the export format
+		auto path = std::string("bench_lstm.txt");
+		auto f32  = lstm_model {};
+		model.save(path);
+		f32.load(path);
+		std::remove(path.c_str());
+
+		auto i8 = f32;
+		i8.quantize();
+
+		auto reference = [&](const float32* x) {
+			auto h = std::vector<double64>(unit_count, 0.0);
+			auto c = std::vector<double64>(unit_count, 0.0);
+			auto z = std::vector<double64>(4 * unit_count);
+			auto sigmoid = [](double64 v) { return 1.0 / (1.0 + std::exp(-v)); };
+			for (auto t : std::views::iota(0uz, window_size))
+			{
+				for (auto gate : std::views::iota(0uz, 4 * unit_count))
+				{
+					auto* p_row = &layer.gates.w[gate * (1 + unit_count)];
+					z[gate]		= layer.gates.bias[gate] + p_row[0] * x[t];
+					for (auto k : std::views::iota(0uz, unit_count))
+					{
+						z[gate] += p_row[1 + k] * h[k];
+					}
+				}
+				for (auto k : std::views::iota(0uz, unit_count))
+				{
+					c[k] = sigmoid(z[unit_count + k]) * c[k] + sigmoid(z[k]) * std::tanh(z[2 * unit_count + k]);
+					h[k] = sigmoid(z[3 * unit_count + k]) * std::tanh(c[k]);
+				}
+			}
+
+			auto res = (double64)dense.weights.bias[0];
+			for (auto k : std::views::iota(0uz, unit_count))
+			{
+				res += dense.weights.w[k] * h[k];
+			}
+			return res;
+		};
+
+		constexpr auto max_batch = 4096uz;
+		auto		   unit		 = std::uniform_real_distribution<float32>(0.0f, 1.0f);
+		auto		   inputs	 = std::vector<float32>(max_batch * window_size);
+		std::ranges::generate(inputs, [&]() { return unit(gen); });
+
+		auto ws		 = lstm_workspace {};
+		auto outputs = std::vector<float32>(max_batch);
+		auto f32_err = 0.0;
+		auto i8_err	 = 0.0;
+		f32.predict(inputs, max_batch, outputs, ws);
+		for (auto b : std::views::iota(0uz, 256uz))
+		{
+			f32_err = std::max(f32_err, std::abs(outputs[b] - reference(&inputs[b * window_size])));
+		}
+		i8.predict(inputs, max_batch, outputs, ws);
+		for (auto b : std::views::iota(0uz, 256uz))
+		{
+			i8_err = std::max(i8_err, std::abs(outputs[b] - reference(&inputs[b * window_size])));
+		}
+
+		std::cout << std::format("lstm units = {}, kernels {} | max abs error vs double : float32 {:.2e}, int8 {:.2e}\n", unit_count, f32.p_kernels->name, f32_err, i8_err);
+		for (auto batch_count : { 1uz, 16uz, 256uz, 4096uz })
+		{
+			auto repeat = (int32)std::max(4096uz / batch_count, 4uz);
+			auto f32_ns = ns_per_call([&]() { f32.predict(inputs, batch_count, outputs, ws); }, repeat) / (double64)batch_count;
+			auto i8_ns	= ns_per_call([&]() { i8.predict(inputs, batch_count, outputs, ws); }, repeat) / (double64)batch_count;
+			std::cout << std::format("  batch {:>5} | float32 {:>8.1f} ns/prediction ({:>7.0f} / ms) | int8 {:>8.1f} ns/prediction ({:>7.0f} / ms)\n",
+									 batch_count, f32_ns, 1e6 / f32_ns, i8_ns, 1e6 / i8_ns);
+		}
+
+		auto pool		= thread_pool();
+		auto workspaces = std::vector<lstm_workspace> {};
+		auto pool_ns	= ns_per_call([&]() { f32.predict(pool, inputs, max_batch, outputs, workspaces); }, 4) / (double64)max_batch;
+		std::cout << std::format("  batch {:>5} on {} threads | float32 {:>8.1f} ns/prediction ({:>7.0f} / ms)\n", max_batch, pool.size(), pool_ns, 1e6 / pool_ns);
+	}
+
+	// synthetic client : log-normal delay whose level jumps x2 / x0.5 every segment_len samples, plus a rare 50x spike.
+	// per sample the server path : online hmm update, filter argmax, detector, events into the lock-free queue.
+	// reports the cost per sample, how fast the level shifts were found and how many alarms matched no shift
+	void bench_detector()
+	{
+		constexpr auto segment_len	= 4096uz;
+		constexpr auto sample_count = segment_len * 64;
+
+		auto gen	= std::mt19937_64(11);
+		auto noise	= std::normal_distribution<double64>(0.0, 0.2);
+		auto spike	= std::bernoulli_distribution(1e-4);
+		auto delays = std::vector<double64>(sample_count);
+		for (auto t : std::views::iota(0uz, sample_count))
+		{
+			auto level = std::log(2e6) + ((t / segment_len) % 2 == 1 ? std::log(2.0) : 0.0);
+			delays[t]  = std::exp(level + noise(gen)) * (spike(gen) ? 50.0 : 1.0);
+		}
+
+		auto binning = discretizer::log_spaced(1e5, 1e8, bench_observation_count);
+		auto hmm	 = online_model(bench_state_count, bench_observation_count);
+		hmm.init_random(42);
+		auto states = std::vector<t_state>(sample_count);
+		for (auto t : std::views::iota(0uz, sample_count))
+		{
+			hmm.update(binning(delays[t]));
+			states[t] = (t_state)(std::ranges::max_element(hmm.filter) - hmm.filter.begin());
+		}
+
+		auto queue	  = event_queue<change_event>(1 << 16);
+		auto detector = change_detector(0);
+		auto ns		  = ns_per_call([&]() {
+			for (auto t : std::views::iota(0uz, sample_count))
+			{
+				detector.update(t, t * 1000, delays[t], states[t], [&](const change_event& event) { queue.push(event); });
+			}
+		}, 1) / (double64)sample_count;
+
+		auto counts		  = std::array<std::size_t, 4> {};
+		auto shift_found  = std::vector<bool>(sample_count / segment_len, false);
+		auto delay_sum	  = 0.0;
+		auto onset_err	  = 0.0;
+		auto false_alarms = 0uz;
+		while (auto event = queue.pop())
+		{
+			++counts[std::countr_zero((uint32)event->source)];
+			if (event->source != change_source::cusum and event->source != change_source::page_hinkley)
+			{
+				continue;
+			}
+
+			// nearest segment boundary at or before the detection
+			auto segment = event->detect_seq / segment_len;
+			auto since	 = event->detect_seq % segment_len;
+			if (segment == 0 or since > segment_len / 4 or shift_found[segment])
+			{
+				++false_alarms;
+				continue;
+			}
+			shift_found[segment]  = true;
+			delay_sum			 += (double64)since;
+			onset_err			 += std::abs((double64)event->onset_seq - (double64)(segment * segment_len));
+		}
+		auto found = (std::size_t)std::ranges::count(shift_found, true);
+
+		auto hmm_ns = ns_per_call([&]() {
+			for (auto t : std::views::iota(0uz, sample_count))
+			{
+				hmm.update(binning(delays[t]));
+			}
+		}, 1) / (double64)sample_count;
+
+		std::cout << std::format("change_detector | {:>5.1f} ns/sample ({:>5.1f} with the online hmm, {:.1f} M samples/s on one core) | events spike {} cusum {} page-hinkley {} regime {} | dropped {}\n",
+								 ns, ns + hmm_ns, 1e3 / (ns + hmm_ns), counts[0], counts[1], counts[2], counts[3], queue.dropped.load());
+		std::cout << std::format("  level shifts found {} / {} | mean detection delay {:.1f} samples | mean onset error {:.1f} samples | false alarms {}\n",
+								 found, shift_found.size() - 1, delay_sum / (double64)std::max(found, 1uz), onset_err / (double64)std::max(found, 1uz), false_alarms);
+	}
+
+	// many clients, few hot : 90% of the samples go to hot_count clients, the rest anywhere, so cold models keep
+	// getting evicted and read back while the hot ones retrain. the caller's side is what a receive thread pays
+	void bench_model_pool(std::size_t client_count, std::size_t max_resident)
+	{
+		constexpr auto sample_count = 1uz << 21;
+		constexpr auto hot_count	= 256uz;
+
+		auto dir = std::string("bench_pool");
+		std::filesystem::create_directories(dir);
+
+		auto gen	 = std::mt19937_64(5);
+		auto hot	 = std::bernoulli_distribution(0.9);
+		auto client	 = std::uniform_int_distribution<uint64>(0, client_count - 1);
+		auto symbol	 = std::uniform_int_distribution<int32>(0, bench_observation_count - 1);
+		auto samples = std::vector<std::pair<uint64, t_observation>>(sample_count);
+		for (auto& [id, o] : samples)
+		{
+			id = hot(gen) ? client(gen) % hot_count : client(gen);
+			o  = (t_observation)symbol(gen);
+		}
+
+		auto workers = thread_pool(2);
+		auto pool	 = model_pool(workers, { .state_count		= bench_state_count,
+											 .observation_count = bench_observation_count,
+											 .max_resident		= max_resident,
+											 .store_dir			= dir,
+											 .history_size		= 1024,
+											 .retrain_after		= 1024,
+											 .train				= { .max_iterations = 10, .tolerance = 1e-5 } });
+
+		auto latency  = std::vector<float32>(sample_count);
+		auto buffered = 0uz;
+		auto ns		  = ns_per_call([&]() {
+			for (auto idx : std::views::iota(0uz, sample_count))
+			{
+				auto begin	  = std::chrono::steady_clock::now();
+				buffered	 += pool.update(samples[idx].first, samples[idx].second) ? 0 : 1;
+				latency[idx]  = std::chrono::duration<float32, std::nano>(std::chrono::steady_clock::now() - begin).count();
+			}
+		}, 1) / (double64)sample_count;
+		workers.wait();
+
+		std::ranges::sort(latency);
+		std::cout << std::format("model_pool {} clients, {} resident max | caller {:>6.1f} ns/sample, p99 {:>6.1f} us, max {:>8.1f} us | resident {} | evictions {} loads {} (failed {}) trainings {} | buffered {} dropped {}\n",
+								 pool.client_count(), max_resident, ns, latency[sample_count * 99 / 100] / 1e3, latency.back() / 1e3, pool.stats.resident.load(), pool.stats.evictions.load(),
+								 pool.stats.loads.load(), pool.stats.load_failures.load(), pool.stats.trainings.load(), buffered, pool.stats.dropped_samples.load());
+
+		std::filesystem::remove_all(dir);
+	}
+
+	// default windows (10, 60, 300) and quantiles over a log-normal stream whose level triples half way :
+	// update alone, update + the full vector, and the largest error against recomputing every window from scratch
+	void bench_features()
+	{
+		constexpr auto sample_count = 1uz << 20;
+
+		auto gen	= std::mt19937_64(9);
+		auto dist	= std::lognormal_distribution<double64>(15.0, 1.0);
+		auto values = std::vector<double64>(sample_count);
+		for (auto t : std::views::iota(0uz, sample_count))
+		{
+			values[t] = dist(gen) * (t < sample_count / 2 ? 1.0 : 3.0);
+		}
+
+		auto engine	  = feature_engine();
+		auto update_ns = ns_per_call([&]() {
+			for (auto x : values)
+			{
+				engine.update(x);
+			}
+		}, 1) / (double64)sample_count;
+
+		auto out	   = std::vector<double64>(engine.feature_count());
+		auto checksum  = 0.0;
+		auto vector_ns = ns_per_call([&]() {
+			for (auto x : values)
+			{
+				engine.update(x);
+				engine.features(out);
+				checksum += out[1];
+			}
+		}, 1) / (double64)sample_count;
+
+		// exact mean / std / min / max / slope and rank quantiles of the same windows, every 97 samples
+		auto check		= feature_engine();
+		auto moment_err = 0.0;
+		auto q_err		= 0.0;
+		for (auto t : std::views::iota(0uz, sample_count / 16))
+		{
+			check.update(values[t]);
+			if (t % 97 != 0)
+			{
+				continue;
+			}
+
+			check.features(out);
+			auto pos = 1uz;
+			for (auto size : check.config.window_sizes)
+			{
+				auto n		= std::min(size, t + 1);
+				auto window = std::vector<double64>(values.begin() + (std::ptrdiff_t)(t + 1 - n), values.begin() + (std::ptrdiff_t)(t + 1));
+				auto mean	= std::accumulate(window.begin(), window.end(), 0.0) / (double64)n;
+				auto var	= 0.0;
+				auto s_tx	= 0.0;
+				for (auto i : std::views::iota(0uz, n))
+				{
+					var	 += (window[i] - mean) * (window[i] - mean);
+					s_tx += ((double64)i - (double64)(n - 1) / 2.0) * window[i];
+				}
+				auto slope	  = n > 1 ? s_tx / ((double64)n * ((double64)n * (double64)n - 1.0) / 12.0) : 0.0;
+				auto expected = std::array { mean, n > 1 ? std::sqrt(var / (double64)(n - 1)) : 0.0, std::ranges::min(window), std::ranges::max(window), slope };
+				auto slots	  = std::array { 0uz, 1uz, 2uz, 3uz, 5uz };
+				for (auto k : std::views::iota(0uz, expected.size()))
+				{
+					moment_err = std::max(moment_err, std::abs(out[pos + slots[k]] - expected[k]) / std::max(std::abs(expected[k]), 1.0));
+				}
+
+				std::ranges::sort(window);
+				for (auto k : std::views::iota(0uz, check.config.quantiles.size()))
+				{
+					auto exact = window[(std::size_t)(check.config.quantiles[k] * (double64)(n - 1))];
+					q_err	   = std::max(q_err, std::abs(out[pos + 6 + k] / exact - 1.0));
+				}
+				pos += check.per_window_count();
+			}
+		}
+
+		std::cout << std::format("feature_engine {} features | update {:>6.1f} ns/sample | update + vector {:>6.1f} ns/sample | max rel error moments {:.1e}, quantiles {:.4f} | checksum {:.3e}\n",
+								 engine.feature_count(), update_ns, vector_ns, moment_err, q_err, checksum);
+	}
+}	 // namespace
+
+int main()
+{
+	bench_fixed_vs_dyn<10>();
+	bench_fixed_vs_dyn<100>();
+	bench_fixed_vs_dyn<200>();
+
+	for (auto state_count : { 4uz, 8uz, 16uz, 32uz, 64uz })
+	{
+		bench_kernels(state_count);
+	}
+
+	bench_trainer();
+
+	for (auto state_count : { 4uz, 8uz, 16uz })
+	{
+		bench_online(state_count);
+	}
+
+	for (auto state_count : { 4uz, 8uz, 16uz })
+	{
+		bench_stream(state_count);
+	}
+
+	for (auto state_count : { 3uz, 8uz })
+	{
+		for (auto mixture_count : { 1uz, 2uz, 4uz })
+		{
+			bench_gmm(state_count, mixture_count);
+		}
+	}
+
+	for (auto symbol_count : { 10uz, 64uz, 256uz })
+	{
+		bench_discretizer(symbol_count);
+	}
+
+	for (auto state_count : { 4uz, 8uz, 16uz })
+	{
+		bench_viterbi(state_count);
+	}
+
+	bench_model_store(10000);
+	bench_ingest(4'000'000);
+
+	for (auto unit_count : { 50uz, 128uz })
+	{
+		bench_lstm(unit_count);
+	}
+
+	bench_detector();
+	bench_model_pool(20000, 1024);
+	bench_features();
+	return 0;
+}
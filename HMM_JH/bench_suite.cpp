@@ -0,0 +1,355 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <random>
+#include <format>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <map>
+#include <optional>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "common.h"
+#include "dyn_model.h"
+#include "gmm_model.h"
+#include "stream_filter.h"
+
+// regression suite of the hmm engine
+// every (op, emission, N, M or K, T, kernel) of the grid is timed the same way and reported as
+// ns / sample, GFLOP/s and the bytes the model holds after the op ran.
+//
+//	HMM_JH_suite [--quick] [--all-kernels] [--csv <out.csv>] [--baseline <old.csv>] [--tolerance <0.10>]
+//
+// --baseline compares ns / sample with an earlier --csv run of the same grid and exits with 1 when any case got
+// slower by more than tolerance, so the suite can gate a build.
+//
+// flop counts are the nominal ones of the textbook recursion per sample, not what a kernel actually issues :
+//	forward		2N^2 + 2N		(matrix-vector, emission, scaling)
+//	backward	2N^2 + 2N
+//	viterbi		2N^2 + N		(max-plus, add + compare)
+//	em			8N^2 + 6N		(forward + backward + xi accumulation, m-step amortized)
+//	predict		4N^2 + 2NM		(filter step + one step ahead symbol distribution, discrete only)
+// gaussian emissions add 3NK (+ 3NK log-sum-exp when K > 1) per sample wherever the density is evaluated.
+namespace
+{
+	struct suite_config
+	{
+		std::vector<std::size_t> state_counts	 = { 2, 4, 8, 16, 32, 64 };
+		std::vector<std::size_t> symbol_counts	 = { 10, 64 };
+		std::vector<std::size_t> mixture_counts = { 1, 4 };
+		std::vector<std::size_t> lengths		 = { 256, 4096, 65536 };
+		bool					 all_kernels	 = false;
+		// time spent on every case, split into batch_count batches, the fastest batch is reported
+		double64				 case_ms		 = 30.0;
+		int32					 batch_count	 = 5;
+	};
+
+	struct case_result
+	{
+		std::string		 op;
+		std::string		 emission;
+		std::size_t		 state_count;
+		// symbols for discrete, mixture components for gaussian
+		std::size_t		 width;
+		std::size_t		 length;
+		std::string_view kernel;
+		double64		 ns_per_sample;
+		double64		 gflops;
+		std::size_t		 footprint;
+
+		std::string key() const { return std::format("{},{},{},{},{},{}", op, emission, state_count, width, length, kernel); }
+	};
+
+	template <typename t_func>
+	double64 best_ns_per_call(t_func&& func, const suite_config& config)
+	{
+		// first call sizes the buffers
+		func();
+
+		auto best = std::numeric_limits<double64>::infinity();
+		for (auto _ : std::views::iota(0, config.batch_count))
+		{
+			auto begin	= std::chrono::steady_clock::now();
+			auto repeat = 0;
+			auto ns		= 0.0;
+			do
+			{
+				func();
+				++repeat;
+				ns = std::chrono::duration<double64, std::nano>(std::chrono::steady_clock::now() - begin).count();
+			} while (ns < config.case_ms * 1e6 / config.batch_count);
+
+			best = std::min(best, ns / repeat);
+		}
+		return best;
+	}
+
+	std::vector<const kernel::kernel_set*> kernel_sets(const suite_config& config)
+	{
+		if (not config.all_kernels)
+		{
+			return { &kernel::best() };
+		}
+
+		auto res = std::vector<const kernel::kernel_set*> {};
+		for (auto type : { kernel::isa::scalar, kernel::isa::avx2, kernel::isa::avx512 })
+		{
+			if (auto* p_set = kernel::find(type); p_set != nullptr)
+			{
+				res.push_back(p_set);
+			}
+		}
+		return res;
+	}
+
+	void run_discrete(const suite_config& config, std::vector<case_result>& results)
+	{
+		auto gen = std::mt19937_64(42);
+		for (auto n : config.state_counts)
+		{
+			for (auto m : config.symbol_counts)
+			{
+				for (auto len : config.lengths)
+				{
+					auto dist		  = std::uniform_int_distribution<int32>(0, (int32)m - 1);
+					auto observations = std::vector<t_observation>(len);
+					for (auto& o : observations)
+					{
+						o = (t_observation)dist(gen);
+					}
+
+					for (auto* p_set : kernel_sets(config))
+					{
+						auto hmm = dyn_model(n, m);
+						hmm.init_A_B_pi(n * 1000 + m);
+						hmm.p_kernels = p_set;
+						hmm.update_observations(observations);
+
+						auto nn	 = (double64)(n * n);
+						auto add = [&](std::string op, double64 ns_per_call, double64 flop_per_sample) {
+							auto ns = ns_per_call / (double64)len;
+							results.push_back({ std::move(op), "discrete", n, m, len, p_set->name, ns, flop_per_sample / ns, hmm.memory_footprint() });
+						};
+
+						add("forward", best_ns_per_call([&]() { hmm.forward(); }, config), 2 * nn + 2 * n);
+
+						hmm.forward();
+						add("backward", best_ns_per_call([&]() { hmm.backward(); }, config), 2 * nn + 2 * n);
+
+						add("viterbi", best_ns_per_call([&]() { hmm.viterbi_log(); }, config), 2 * nn + n);
+
+						add("em", best_ns_per_call([&]() { hmm.baum_welch(); }, config), 8 * nn + 6 * n);
+
+						auto filter	  = stream_filter(hmm);
+						auto forecast = std::vector<double64>(m);
+						add("predict", best_ns_per_call([&]() {
+							filter.reset();
+							for (auto o : observations)
+							{
+								filter.update(o);
+								filter.predict(1, forecast);
+							}
+						}, config), 4 * nn + 2 * (double64)(n * m));
+					}
+				}
+			}
+		}
+	}
+
+	void run_gaussian(const suite_config& config, std::vector<case_result>& results)
+	{
+		auto gen = std::mt19937_64(42);
+		for (auto n : config.state_counts)
+		{
+			for (auto k : config.mixture_counts)
+			{
+				for (auto len : config.lengths)
+				{
+					auto dist	= std::lognormal_distribution<double64>(15.0, 1.0);
+					auto values = std::vector<double64>(len);
+					for (auto& x : values)
+					{
+						x = dist(gen);
+					}
+
+					for (auto* p_set : kernel_sets(config))
+					{
+						auto hmm = gmm_model(n, k);
+						hmm.p_kernels = p_set;
+						hmm.update_observations(values);
+						hmm.init_from_data(values);
+
+						auto nn		 = (double64)(n * n);
+						auto density = 3.0 * (double64)(n * k) * (k > 1 ? 2.0 : 1.0);
+						auto add	 = [&](std::string op, double64 ns_per_call, double64 flop_per_sample) {
+							auto ns = ns_per_call / (double64)len;
+							results.push_back({ std::move(op), "gaussian", n, k, len, p_set->name, ns, flop_per_sample / ns, hmm.memory_footprint() });
+						};
+
+						add("forward", best_ns_per_call([&]() { hmm.forward(); }, config), 2 * nn + 2 * n + density);
+
+						hmm.forward();
+						add("backward", best_ns_per_call([&]() { hmm.backward(); }, config), 2 * nn + 2 * n);
+
+						add("viterbi", best_ns_per_call([&]() { hmm.viterbi(); }, config), 2 * nn + n + density);
+
+						add("em", best_ns_per_call([&]() { hmm.baum_welch(); }, config), 8 * nn + 6 * n + density);
+					}
+				}
+			}
+		}
+	}
+
+	// key -> ns / sample of an earlier --csv run, nullopt when the file cannot be read
+	std::optional<std::map<std::string, double64>> load_baseline(const std::string& path)
+	{
+		auto file = std::ifstream(path);
+		if (not file)
+		{
+			return std::nullopt;
+		}
+
+		auto res  = std::map<std::string, double64> {};
+		auto line = std::string {};
+		std::getline(file, line);	 // header
+		while (std::getline(file, line))
+		{
+			// op,emission,N,width,T,kernel,ns_per_sample,...
+			auto pos = 0uz;
+			for (auto _ : std::views::iota(0, 6))
+			{
+				pos = line.find(',', pos) + 1;
+			}
+			if (pos == 0)
+			{
+				continue;
+			}
+			res[line.substr(0, pos - 1)] = std::stod(line.substr(pos));
+		}
+		return res;
+	}
+}	 // namespace
+
+int main(int argc, char** argv)
+{
+	auto config		   = suite_config {};
+	auto csv_path	   = std::string {};
+	auto baseline_path = std::string {};
+	auto tolerance	   = 0.10;
+	for (auto idx = 1; idx < argc; ++idx)
+	{
+		auto arg  = std::string_view(argv[idx]);
+		auto next = [&]() { return idx + 1 < argc ? std::string(argv[++idx]) : std::string {}; };
+		if (arg == "--quick")
+		{
+			config.state_counts	  = { 4, 16 };
+			config.symbol_counts  = { 10 };
+			config.mixture_counts = { 1 };
+			config.lengths		  = { 1024 };
+			config.case_ms		  = 10.0;
+		}
+		else if (arg == "--all-kernels")
+		{
+			config.all_kernels = true;
+		}
+		else if (arg == "--csv")
+		{
+			csv_path = next();
+		}
+		else if (arg == "--baseline")
+		{
+			baseline_path = next();
+		}
+		else if (arg == "--tolerance")
+		{
+			tolerance = std::stod(next());
+		}
+		else
+		{
+			std::cout << "unknown argument " << arg << std::endl;
+			return 2;
+		}
+	}
+
+	// read before the run, a bad path fails in a second instead of after the sweep
+	auto baseline = std::map<std::string, double64> {};
+	if (not baseline_path.empty())
+	{
+		auto loaded = load_baseline(baseline_path);
+		if (not loaded)
+		{
+			std::cout << "failed to read baseline " << baseline_path << std::endl;
+			return 2;
+		}
+		baseline = std::move(*loaded);
+	}
+
+	auto results = std::vector<case_result> {};
+	run_discrete(config, results);
+	run_gaussian(config, results);
+
+	std::cout << std::format("{:>8} {:>8} {:>3} {:>4} {:>6} {:>7} | {:>10} {:>8} {:>12}\n", "op", "emission", "N", "M/K", "T", "kernel", "ns/sample", "GFLOP/s", "bytes");
+	for (auto& res : results)
+	{
+		std::cout << std::format("{:>8} {:>8} {:>3} {:>4} {:>6} {:>7} | {:>10.2f} {:>8.3f} {:>12}\n",
+								 res.op, res.emission, res.state_count, res.width, res.length, res.kernel, res.ns_per_sample, res.gflops, res.footprint);
+	}
+
+	if (not csv_path.empty())
+	{
+		auto file = std::ofstream(csv_path);
+		file << "op,emission,N,width,T,kernel,ns_per_sample,gflops,footprint_bytes\n";
+		for (auto& res : results)
+		{
+			file << std::format("{},{:.4f},{:.4f},{}\n", res.key(), res.ns_per_sample, res.gflops, res.footprint);
+		}
+		if (not file)
+		{
+			std::cout << "failed to write " << csv_path << std::endl;
+			return 2;
+		}
+	}
+
+	if (baseline_path.empty())
+	{
+		return 0;
+	}
+
+	auto regressions = 0;
+	auto matched	 = 0uz;
+	for (auto& res : results)
+	{
+		auto it = baseline.find(res.key());
+		if (it == baseline.end())
+		{
+			continue;
+		}
+
+		++matched;
+		if (res.ns_per_sample > it->second * (1.0 + tolerance))
+		{
+			std::cout << std::format("regression {} : {:.2f} -> {:.2f} ns/sample ({:+.1f}%)\n", res.key(), it->second, res.ns_per_sample, (res.ns_per_sample / it->second - 1.0) * 100.0);
+			++regressions;
+		}
+		baseline.erase(it);
+	}
+
+	// what is left was in the baseline and not run, e.g. a full baseline against --quick
+	for (auto& [key, _] : baseline)
+	{
+		std::cout << "missing from this run " << key << std::endl;
+	}
+
+	if (matched == 0)
+	{
+		std::cout << "no case of this run is in baseline " << baseline_path << std::endl;
+		return 2;
+	}
+
+	std::cout << std::format("{} of {} cases slower than baseline by more than {:.0f}%, {} not in baseline, {} baseline cases missing", regressions, matched,
+							 tolerance * 100.0, results.size() - matched, baseline.size())
+			  << std::endl;
+	return regressions == 0 ? 0 : 1;
+}
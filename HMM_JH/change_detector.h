@@ -0,0 +1,290 @@
+#pragma once
+#include <algorithm>
+#include <string_view>
+#include <cmath>
+#include <cassert>
+#include "common.h"
+#include "model.h"
+
+// what raised a change_event, also used as a bit mask of the tests that agree on it
+enum class change_source : uint8
+{
+	spike		 = 1,	 // one sample far outside the baseline
+	cusum		 = 2,	 // level shift against the ewma baseline
+	page_hinkley = 4,	 // drift against the mean since the last change
+	regime		 = 8,	 // the hmm's most likely state moved and held
+};
+
+inline std::string_view source_name(change_source source)
+{
+	switch (source)
+	{
+	case change_source::spike:
+		return "spike";
+	case change_source::cusum:
+		return "cusum";
+	case change_source::page_hinkley:
+		return "page-hinkley";
+	case change_source::regime:
+		return "regime";
+	}
+	return "?";
+}
+
+struct change_event
+{
+	uint32		  client_id;
+	change_source source;
+	// source | every other test that fired or was half way to its threshold within corroborate_window samples
+	uint8		  sources;
+	// +1 delay went up, -1 down
+	int8		  direction;
+	t_state		  from_state;
+	t_state		  to_state;
+	// first sample of the change and the sample that confirmed it, seq and time as the caller fed them
+	uint64		  onset_seq;
+	uint64		  onset_time;
+	uint64		  detect_seq;
+	uint64		  detect_time;
+	// delay after / delay before
+	double64	  ratio;
+};
+
+struct change_config
+{
+	// baseline : ewma of log delay and of its variance, 1 / n for the first warmup_count samples of every level
+	double64	baseline_alpha	   = 0.02;
+	std::size_t warmup_count	   = 32;
+	// log units, a floor of ~5% so a flat link does not alarm on noise
+	double64	min_sigma		   = 0.05;
+	// standardized samples are clipped here and reported as spikes, one outlier alone never shifts the level
+	double64	spike_sigma		   = 6.0;
+	// cusum on the standardized log delay, slack and threshold in sigmas
+	double64	cusum_slack		   = 0.5;
+	double64	cusum_threshold	   = 10.0;
+	// page-hinkley on log delay around its mean since the last change, log units
+	double64	ph_tolerance	   = 0.05;
+	double64	ph_threshold	   = 5.0;
+	// a decoded state counts once it held this many samples in a row
+	std::size_t state_persistence  = 8;
+	std::size_t corroborate_window = 32;
+};
+
+// max(0, sum + step) accumulator shared by cusum and page-hinkley.
+// the onset is the last sample that lifted it off zero, which is the argmin of the raw cumulative sum
+struct one_sided_test
+{
+	double64 sum		= 0.0;
+	double64 step_sum	= 0.0;
+	uint64	 count		= 0;
+	uint64	 onset_seq	= 0;
+	uint64	 onset_time = 0;
+
+	// true when sum crossed threshold
+	bool update(double64 step, double64 threshold, uint64 seq, uint64 time)
+	{
+		if (sum == 0.0 and step > 0.0)
+		{
+			onset_seq  = seq;
+			onset_time = time;
+			step_sum   = 0.0;
+			count	   = 0;
+		}
+
+		sum = std::max(0.0, sum + step);
+		if (sum > 0.0)
+		{
+			step_sum += step;
+			++count;
+		}
+		return sum > threshold;
+	}
+
+	// mean step since the onset
+	double64 mean_step() const { return count == 0 ? 0.0 : step_sum / (double64)count; }
+
+	void reset() { sum = 0.0; }
+};
+
+// streaming change detector of one client's delay series, fixed size state and O(1) work per sample.
+//	spike			|z| > spike_sigma, z the log delay standardized by the ewma baseline
+//	cusum			two-sided on clipped z, fast on abrupt level shifts
+//	page_hinkley	two-sided on log delay around the running mean since the last change, catches slow drift
+//	regime			the state the caller decoded (filter argmax) changed and held state_persistence samples
+// cusum and page-hinkley alarms are one event : whichever fires first takes the other along in sources when that one
+// is past half its threshold, then both restart from the new level. regime events are raised on their own and
+// corroborated by a statistical alarm in the window before or after.
+struct change_detector
+{
+	change_config config;
+	uint32		  client_id;
+
+	uint64	 sample_count  = 0;
+	// samples since the first one or the last level change, the baseline relearns and the tests wait while it is short
+	uint64	 level_count   = 0;
+	double64 baseline_mean = 0.0;
+	double64 baseline_var  = 0.0;
+
+	one_sided_test cusum_up;
+	one_sided_test cusum_down;
+
+	// page-hinkley's own mean, restarts at every change
+	double64	   ph_mean	= 0.0;
+	uint64		   ph_count = 0;
+	one_sided_test ph_up;
+	one_sided_test ph_down;
+
+	t_state	 state			   = 0;
+	t_state	 candidate		   = 0;
+	uint64	 candidate_count   = 0;
+	uint64	 candidate_seq	   = 0;
+	uint64	 candidate_time	   = 0;
+	double64 candidate_log_sum = 0.0;
+	double64 candidate_base	   = 0.0;
+
+	// sample_count of the last alarm of each kind, for corroboration (the caller's seq may wrap or restart)
+	uint64 last_shift_sample  = 0;
+	uint64 last_regime_sample = 0;
+	uint8  last_shift_sources = 0;
+	bool   has_shift		  = false;
+	bool   has_regime		  = false;
+
+	explicit change_detector(uint32 client_id = 0, change_config config = {}) : config(config), client_id(client_id) { }
+
+	double64 sigma() const { return std::max(std::sqrt(baseline_var), config.min_sigma); }
+
+	// delay > 0 in any unit, state the most likely hmm state after this sample. emit(const change_event&) once per event
+	template <typename t_emit>
+	void update(uint64 seq, uint64 time, double64 delay, t_state decoded_state, t_emit&& emit)
+	{
+		auto x = std::log(std::max(delay, 1e-9));
+		++sample_count;
+		++level_count;
+
+		if (sample_count == 1)
+		{
+			baseline_mean = x;
+			ph_mean		  = x;
+			ph_count	  = 1;
+			state		  = decoded_state;
+			candidate	  = decoded_state;
+			return;
+		}
+
+		auto event = change_event {
+			.client_id	 = client_id,
+			.from_state	 = state,
+			.to_state	 = decoded_state,
+			.detect_seq	 = seq,
+			.detect_time = time,
+		};
+
+		auto warm = level_count > config.warmup_count;
+		auto sd	  = sigma();
+		auto z	  = std::clamp((x - baseline_mean) / sd, -config.spike_sigma, config.spike_sigma);
+
+		if (warm and std::abs(x - baseline_mean) > config.spike_sigma * sd)
+		{
+			event.source	 = change_source::spike;
+			event.sources	 = (uint8)change_source::spike;
+			event.direction	 = x > baseline_mean ? 1 : -1;
+			event.onset_seq	 = seq;
+			event.onset_time = time;
+			event.ratio		 = std::exp(x - baseline_mean);
+			emit(event);
+		}
+
+		// baseline and page-hinkley see the clipped sample, a spike moves them no more than spike_sigma would
+		auto clipped   = baseline_mean + z * sd;
+		auto alpha	   = std::max(config.baseline_alpha, 1.0 / (double64)level_count);
+		auto diff	   = clipped - baseline_mean;
+		baseline_mean += alpha * diff;
+		baseline_var   = (1.0 - alpha) * (baseline_var + alpha * diff * diff);
+
+		++ph_count;
+		ph_mean += (clipped - ph_mean) / (double64)ph_count;
+
+		if (warm)
+		{
+			auto cusum_hit = cusum_up.update(z - config.cusum_slack, config.cusum_threshold, seq, time)
+						   | cusum_down.update(-z - config.cusum_slack, config.cusum_threshold, seq, time);
+			auto ph_hit	   = ph_up.update(clipped - ph_mean - config.ph_tolerance, config.ph_threshold, seq, time)
+						   | ph_down.update(ph_mean - clipped - config.ph_tolerance, config.ph_threshold, seq, time);
+
+			if (cusum_hit or ph_hit)
+			{
+				// the side past its threshold, cusum first : its shift estimate is the better one
+				auto& test	  = cusum_hit ? (cusum_up.sum > config.cusum_threshold ? cusum_up : cusum_down)
+										  : (ph_up.sum > config.ph_threshold ? ph_up : ph_down);
+				auto  up	  = &test == &cusum_up or &test == &ph_up;
+				auto  shift	  = cusum_hit ? (test.mean_step() + config.cusum_slack) * sd : test.mean_step() + config.ph_tolerance;
+				auto  halfway = [&](one_sided_test& t, double64 threshold) { return t.sum > threshold * 0.5; };
+
+				event.source	 = cusum_hit ? change_source::cusum : change_source::page_hinkley;
+				event.sources	 = (uint8)event.source;
+				event.sources	|= (cusum_hit or halfway(up ? cusum_up : cusum_down, config.cusum_threshold)) ? (uint8)change_source::cusum : 0;
+				event.sources	|= (ph_hit or halfway(up ? ph_up : ph_down, config.ph_threshold)) ? (uint8)change_source::page_hinkley : 0;
+				event.sources	|= near(has_regime, last_regime_sample) ? (uint8)change_source::regime : 0;
+				event.direction	 = up ? 1 : -1;
+				event.onset_seq	 = test.onset_seq;
+				event.onset_time = test.onset_time;
+				event.ratio		 = std::exp(up ? shift : -shift);
+				emit(event);
+
+				// restart from the new level, estimated again from scratch over the next warmup_count samples
+				baseline_mean	   = (cusum_hit ? baseline_mean : ph_mean) + (up ? shift : -shift);
+				ph_mean			   = baseline_mean;
+				ph_count		   = 1;
+				level_count		   = 1;
+				last_shift_sample  = sample_count;
+				last_shift_sources = event.sources & ((uint8)change_source::cusum | (uint8)change_source::page_hinkley);
+				has_shift		   = true;
+				cusum_up.reset();
+				cusum_down.reset();
+				ph_up.reset();
+				ph_down.reset();
+			}
+		}
+
+		if (decoded_state == state)
+		{
+			candidate_count = 0;
+			return;
+		}
+
+		if (decoded_state != candidate or candidate_count == 0)
+		{
+			candidate		  = decoded_state;
+			candidate_count	  = 0;
+			candidate_seq	  = seq;
+			candidate_time	  = time;
+			candidate_log_sum = 0.0;
+			candidate_base	  = baseline_mean;
+		}
+
+		++candidate_count;
+		candidate_log_sum += x;
+		if (candidate_count < config.state_persistence)
+		{
+			return;
+		}
+
+		auto shift		 = candidate_log_sum / (double64)candidate_count - candidate_base;
+		event.source	 = change_source::regime;
+		event.sources	 = (uint8)change_source::regime | (near(has_shift, last_shift_sample) ? last_shift_sources : 0);
+		event.direction	 = shift >= 0.0 ? 1 : -1;
+		event.from_state = state;
+		event.to_state	 = candidate;
+		event.onset_seq	 = candidate_seq;
+		event.onset_time = candidate_time;
+		event.ratio		 = std::exp(shift);
+		emit(event);
+
+		state			   = candidate;
+		candidate_count	   = 0;
+		last_regime_sample = sample_count;
+		has_regime		   = true;
+	}
+
+	bool near(bool has, uint64 sample) const { return has and sample_count - sample <= config.corroborate_window; }
+};
@@ -0,0 +1,228 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <ranges>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <cassert>
+#include "common.h"
+#include "model.h"
+
+// streaming quantile sketch with relative error (ddsketch)
+// a sample x > 0 lands in bucket ceil(log_gamma(x)), gamma = (1 + a) / (1 - a), and every quantile it answers is
+// within a factor (1 +- a) of the exact one. memory is bounded by max_bucket_count : past it the lowest buckets
+// are folded together, which only costs accuracy on the small end (short delays), never on the tail.
+struct quantile_sketch
+{
+	double64	relative_accuracy;
+	double64	gamma;
+	double64	inv_log_gamma;
+	std::size_t max_bucket_count;
+
+	// counts[i] is bucket index offset + i
+	std::vector<uint64> counts;
+	int64				offset	   = 0;
+	// samples <= 0
+	uint64				zero_count = 0;
+	uint64				count	   = 0;
+	double64			min		   = std::numeric_limits<double64>::infinity();
+	double64			max		   = -std::numeric_limits<double64>::infinity();
+
+	explicit quantile_sketch(double64 relative_accuracy = 0.005, std::size_t max_bucket_count = 4096)
+		: relative_accuracy(relative_accuracy), gamma((1.0 + relative_accuracy) / (1.0 - relative_accuracy)),
+		  inv_log_gamma(1.0 / std::log(gamma)), max_bucket_count(max_bucket_count)
+	{
+		assert(relative_accuracy > 0.0 and relative_accuracy < 1.0 and max_bucket_count > 0);
+	}
+
+	void add(double64 x)
+	{
+		if (std::isnan(x))
+		{
+			return;
+		}
+
+		++count;
+		min = std::min(min, x);
+		max = std::max(max, x);
+		if (x <= 0.0)
+		{
+			++zero_count;
+			return;
+		}
+
+		_add_bucket((int64)std::ceil(std::log(x) * inv_log_gamma), 1);
+	}
+
+	// other must use the same relative_accuracy
+	void merge(const quantile_sketch& other)
+	{
+		assert(other.gamma == gamma);
+		for (auto i : std::views::iota(0uz, other.counts.size()))
+		{
+			if (other.counts[i] > 0)
+			{
+				_add_bucket(other.offset + (int64)i, other.counts[i]);
+			}
+		}
+
+		zero_count += other.zero_count;
+		count	   += other.count;
+		min			= std::min(min, other.min);
+		max			= std::max(max, other.max);
+	}
+
+	// q in [0, 1]
+	double64 quantile(double64 q) const
+	{
+		if (count == 0)
+		{
+			return std::numeric_limits<double64>::quiet_NaN();
+		}
+
+		auto rank = (uint64)(std::clamp(q, 0.0, 1.0) * (double64)(count - 1));
+		if (rank < zero_count)
+		{
+			return min;
+		}
+
+		auto seen = zero_count;
+		for (auto i : std::views::iota(0uz, counts.size()))
+		{
+			seen += counts[i];
+			if (seen > rank)
+			{
+				// middle of the bucket (gamma^(k-1), gamma^k] in relative terms
+				auto value = 2.0 * std::pow(gamma, (double64)(offset + (int64)i)) / (gamma + 1.0);
+				return std::clamp(value, min, max);
+			}
+		}
+
+		return max;
+	}
+
+  private:
+	void _add_bucket(int64 idx, uint64 n)
+	{
+		if (counts.empty())
+		{
+			offset = idx;
+			counts.push_back(0);
+		}
+		else if (idx < offset)
+		{
+			counts.insert(counts.begin(), (std::size_t)(offset - idx), 0);
+			offset = idx;
+		}
+		else if (idx >= offset + (int64)counts.size())
+		{
+			counts.resize((std::size_t)(idx - offset) + 1, 0);
+		}
+
+		counts[(std::size_t)(idx - offset)] += n;
+
+		if (counts.size() > max_bucket_count)
+		{
+			auto fold = counts.size() - max_bucket_count;
+			for (auto i : std::views::iota(0uz, fold))
+			{
+				counts[fold] += counts[i];
+			}
+			counts.erase(counts.begin(), counts.begin() + (std::ptrdiff_t)fold);
+			offset += (int64)fold;
+		}
+	}
+};
+
+// value -> observation symbol
+// symbol(x) = number of edges <= x, so symbol_count() = edges.size() + 1 and edges[k - 1] <= x < edges[k] is symbol k.
+// the lookup is a branch-free binary search over the edges padded to a power of two with +inf :
+// a fixed log2 trip count of compare + conditional add, no mispredict however the delays jump around.
+struct discretizer
+{
+	// ascending, no duplicates
+	std::vector<double64> edges;
+	// edges padded with +inf to a power of two
+	std::vector<double64> table;
+
+	discretizer() : discretizer(std::vector<double64> {}) { }
+
+	explicit discretizer(std::vector<double64> edge_values) : edges(std::move(edge_values))
+	{
+		std::ranges::sort(edges);
+		auto dup = std::ranges::unique(edges);
+		edges.erase(dup.begin(), dup.end());
+		assert(edges.size() < std::numeric_limits<t_observation>::max() + 1uz);
+
+		table = edges;
+		table.resize(std::bit_ceil(std::max(edges.size(), 1uz)), std::numeric_limits<double64>::infinity());
+	}
+
+	// equal-mass bins : edge k at quantile k / symbol_count. an empty sketch has no quantiles, that is one symbol
+	static discretizer quantile(const quantile_sketch& sketch, std::size_t symbol_count)
+	{
+		if (sketch.count == 0)
+		{
+			return discretizer();
+		}
+
+		auto res = std::vector<double64> {};
+		for (auto k : std::views::iota(1uz, symbol_count))
+		{
+			res.push_back(sketch.quantile((double64)k / (double64)symbol_count));
+		}
+		return discretizer(std::move(res));
+	}
+
+	// geometric bins between lo and hi, the first and last symbol take everything outside
+	static discretizer log_spaced(double64 lo, double64 hi, std::size_t symbol_count)
+	{
+		assert(lo > 0.0 and hi > lo and symbol_count >= 2);
+		auto res   = std::vector<double64> {};
+		auto ratio = std::log(hi / lo) / (double64)(symbol_count - 2);
+		for (auto k : std::views::iota(0uz, symbol_count - 1))
+		{
+			res.push_back(symbol_count == 2 ? lo : lo * std::exp(ratio * (double64)k));
+		}
+		return discretizer(std::move(res));
+	}
+
+	// geometric bins over the bulk of what the sketch saw, one symbol when it saw nothing
+	static discretizer log_spaced(const quantile_sketch& sketch, std::size_t symbol_count, double64 q_lo = 0.001, double64 q_hi = 0.999)
+	{
+		if (sketch.count == 0)
+		{
+			return discretizer();
+		}
+
+		auto lo = std::max(sketch.quantile(q_lo), std::numeric_limits<double64>::min());
+		auto hi = std::max(sketch.quantile(q_hi), lo * (1.0 + 1e-9));
+		return log_spaced(lo, hi, symbol_count);
+	}
+
+	std::size_t symbol_count() const { return edges.size() + 1; }
+
+	t_observation operator()(double64 x) const
+	{
+		const auto* p_table = table.data();
+		auto		pos		= 0uz;
+		for (auto half = table.size() / 2; half > 0; half /= 2)
+		{
+			pos += (p_table[pos + half - 1] <= x) * half;
+		}
+		pos += (p_table[pos] <= x);
+		return (t_observation)pos;
+	}
+
+	// out[i] = symbol(in[i])
+	void batch(std::span<const double64> in, std::span<t_observation> out) const
+	{
+		assert(out.size() >= in.size());
+		for (auto idx : std::views::iota(0uz, in.size()))
+		{
+			out[idx] = (*this)(in[idx]);
+		}
+	}
+};
@@ -0,0 +1,803 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include <limits>
+#include <functional>
+#include <span>
+#include <ranges>
+#include <algorithm>
+#include <random>
+#include <format>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <cassert>
+#include "common.h"
+#include "model.h"
+#include "hmm_kernels.h"
+
+// log(sum(exp(x))) without leaving log space
+inline double64 log_sum_exp(std::span<const double64> values)
+{
+	auto max = -std::numeric_limits<double64>::infinity();
+	for (auto val : values)
+	{
+		max = std::max(max, val);
+	}
+
+	if (std::isinf(max))
+	{
+		return max;
+	}
+
+	auto sum = 0.0;
+	for (auto val : values)
+	{
+		sum += std::exp(val - max);
+	}
+
+	return max + std::log(sum);
+}
+
+// heap bytes held by the given vectors, capacity not size
+template <typename... t_vectors>
+std::size_t heap_bytes(const t_vectors&... vectors)
+{
+	return (0uz + ... + (vectors.capacity() * sizeof(typename t_vectors::value_type)));
+}
+
+// row-major table printer, same layout as format_matrix
+template <typename t>
+std::string format_table(std::span<const t> table, std::size_t width)
+{
+	std::ostringstream oss;
+	oss << "{\n";
+	for (auto row : std::views::iota(0uz, width == 0 ? 0 : table.size() / width))
+	{
+		oss << "{\n";
+		for (auto col : std::views::iota(0uz, width))
+		{
+			if constexpr (std::is_same_v<t, float32> or std::is_same_v<t, double64>)
+			{
+				oss << std::format(" {:.3f}", table[row * width + col]);
+			}
+			else
+			{
+				oss << std::format(" {}", table[row * width + col]);
+			}
+		}
+		oss << "\n}\n";
+	}
+	oss << "\n}\n";
+	return oss.str();
+}
+
+// expected sufficient statistics of one or more sequences, everything the m-step needs
+// statistics of independent sequences are combined by merge()
+struct suff_stats
+{
+	std::size_t state_count;
+	std::size_t observation_count;
+
+	// [state_count], sum over sequences of gamma[0]
+	std::vector<double64> pi;
+	// [state_count][state_count], sum over t of xi[t]
+	std::vector<double64> trans;
+	// [state_count][observation_count], sum over t of gamma[t] at the observed symbol
+	std::vector<double64> emit;
+
+	double64	log_likelihood = 0.0;
+	std::size_t sequence_count = 0;
+
+	suff_stats(std::size_t state_count, std::size_t observation_count)
+		: state_count(state_count), observation_count(observation_count),
+		  pi(state_count), trans(state_count * state_count), emit(state_count * observation_count)
+	{
+	}
+
+	void clear()
+	{
+		std::ranges::fill(pi, 0.0);
+		std::ranges::fill(trans, 0.0);
+		std::ranges::fill(emit, 0.0);
+		log_likelihood = 0.0;
+		sequence_count = 0;
+	}
+
+	void merge(const suff_stats& other)
+	{
+		assert(other.state_count == state_count and other.observation_count == observation_count);
+		for (auto i : std::views::iota(0uz, pi.size()))
+			pi[i] += other.pi[i];
+		for (auto i : std::views::iota(0uz, trans.size()))
+			trans[i] += other.trans[i];
+		for (auto i : std::views::iota(0uz, emit.size()))
+			emit[i] += other.emit[i];
+		log_likelihood += other.log_likelihood;
+		sequence_count += other.sequence_count;
+	}
+};
+
+// lambda, dimensioned at runtime
+// model<state_count, observation_count, T> keeps every table in std::array, so it has to live on the stack
+// and T is fixed at compile time. dyn_model keeps the same tables on the heap, each one contiguous and row-major
+// (table[row * width + col]), and is resized to whatever sequence is given to update_observations.
+// use model<> for small fixed windows, dyn_model for full traces.
+struct dyn_model
+{
+	std::size_t state_count;
+	std::size_t observation_count;
+	// sequence length
+	std::size_t T = 0;
+
+	// transition probability distribution, [state_count][state_count]
+	std::vector<double64> A;
+	// observation symbol probability distribution, [state_count][observation_count]
+	std::vector<double64> B;
+	// initial state distribution, [state_count]
+	std::vector<double64> pi;
+
+	// observation sequence, [T]
+	std::vector<t_observation> observations;
+
+	// bin edges the symbols were cut with (see discretizer), [observation_count - 1], empty if the symbols are not binned values
+	std::vector<double64> edges;
+
+	// per-time tables are allocated by the pass that fills them, e_step only needs beta
+
+	// [T][state_count], see model::alpha
+	// scaled : every row sums to 1, the dropped mass is kept in scale
+	std::vector<double64> alpha;
+	// [T][state_count], see model::beta
+	// after backward() : scaled with the same factors as alpha, so alpha[t][s] * beta[t][s] == gamma[t][s]
+	// after e_step()	: every row sums to 1
+	std::vector<double64> beta;
+	// [T], scale[t] = sum of unscaled alpha[t] given alpha[t - 1] was scaled
+	// log P(O | lambda) = sum log(scale[t])
+	std::vector<double64> scale;
+
+	// [T][state_count], log-space alpha / beta, only filled by forward_log / backward_log
+	std::vector<double64> log_alpha;
+	std::vector<double64> log_beta;
+	// [T][state_count], see model::delta
+	std::vector<double64> delta;
+	// [T][state_count], see model::psi
+	std::vector<t_state> psi;
+
+	// 최적의 state array, [T]
+	std::vector<t_state> path;
+
+	// transposed copies of A and B for the kernels, rebuilt by update_layout()
+	// At[next_state][curr_state], Bt[observation][state]
+	std::vector<double64> At;
+	std::vector<double64> Bt;
+
+	// inner loops, widest instruction set of this cpu by default
+	const kernel::kernel_set* p_kernels = &kernel::best();
+
+	dyn_model(std::size_t state_count, std::size_t observation_count)
+		: state_count(state_count), observation_count(observation_count),
+		  A(state_count * state_count), B(state_count * observation_count), pi(state_count),
+		  At(state_count * state_count), Bt(observation_count * state_count)
+	{
+		assert(state_count > 0 and state_count <= std::numeric_limits<t_state>::max() + 1uz);
+		assert(observation_count > 0 and observation_count <= std::numeric_limits<t_observation>::max() + 1uz);
+	}
+
+	double64& a(std::size_t curr_state, std::size_t next_state) { return A[curr_state * state_count + next_state]; }
+
+	double64& b(std::size_t state, std::size_t observation) { return B[state * observation_count + observation]; }
+
+	std::span<double64> row(std::vector<double64>& table, std::size_t t) { return { table.data() + t * state_count, state_count }; }
+
+	// emission probability of every state for observation o, contiguous
+	const double64* b_col(t_observation o) const { return Bt.data() + o * state_count; }
+
+	// refresh At / Bt after A or B changed
+	void update_layout()
+	{
+		for (auto curr_state : std::views::iota(0uz, state_count))
+		{
+			for (auto next_state : std::views::iota(0uz, state_count))
+			{
+				At[next_state * state_count + curr_state] = A[curr_state * state_count + next_state];
+			}
+
+			for (auto o : std::views::iota(0uz, observation_count))
+			{
+				Bt[o * state_count + curr_state] = B[curr_state * observation_count + o];
+			}
+		}
+	}
+
+	void init_A_B_pi()
+	{
+		std::random_device rd;
+		init_A_B_pi(rd());
+	}
+
+	// same seed, same lambda
+	void init_A_B_pi(uint64 seed)
+	{
+		std::mt19937_64							 gen(seed);
+		std::uniform_real_distribution<double64> dist(0.0, 1.0);
+
+		auto fill_normalized = [&](std::span<double64> dst) {
+			auto sum = 0.0;
+			for (auto& val : dst)
+			{
+				val	 = dist(gen);
+				sum += val;
+			}
+
+			for (auto& val : dst)
+			{
+				val /= sum;
+			}
+		};
+
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			fill_normalized({ A.data() + state * state_count, state_count });
+			fill_normalized({ B.data() + state * observation_count, observation_count });
+		}
+
+		fill_normalized(pi);
+	}
+
+	// new sequence length, the per-time tables follow when they are filled next
+	void resize(std::size_t seq_len)
+	{
+		T = seq_len;
+		observations.resize(T);
+	}
+
+	void update_observations(auto&& view)
+	{
+		resize(std::ranges::distance(view));
+		std::ranges::copy(view, observations.begin());
+	}
+
+	void gen_random_observations(std::size_t seq_len)
+	{
+		std::random_device					 rd;
+		std::mt19937						 gen(rd());
+		std::uniform_int_distribution<int32> dist(0, (int32)observation_count - 1);
+
+		resize(seq_len);
+		for (auto t : std::views::iota(0uz, T))
+		{
+			observations[t] = (t_observation)dist(gen);
+		}
+	}
+
+	// fill alpha, rabiner scaling
+	void forward()
+	{
+		update_layout();
+		alpha.resize(T * state_count);
+		scale.resize(T);
+
+		auto sum = 0.0;
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			alpha[state]  = pi[state] * b(state, observations[0]);
+			sum			 += alpha[state];
+		}
+
+		normalize_alpha(0, sum);
+
+		for (auto t : std::views::iota(1uz, T))
+		{
+			sum = p_kernels->forward_step(A.data(), &alpha[(t - 1) * state_count], b_col(observations[t]), &alpha[t * state_count], state_count);
+			normalize_alpha(t, sum);
+		}
+	}
+
+	// fill beta, scaled by the factors forward() left in scale
+	void backward()
+	{
+		beta.resize(T * state_count);
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			beta[(T - 1) * state_count + state] = 1.0;
+		}
+
+		for (auto t : std::views::iota(0uz, T - 1) | std::views::reverse)
+		{
+			p_kernels->backward_step(At.data(), &beta[(t + 1) * state_count], b_col(observations[t + 1]), 1.0 / scale[t + 1], &beta[t * state_count], state_count);
+		}
+	}
+
+	// log P(O | lambda), valid after forward()
+	double64 log_likelihood()
+	{
+		auto res = 0.0;
+		for (auto val : scale)
+		{
+			res += std::log(val);
+		}
+
+		return res;
+	}
+
+	// compute possibility of observation given this model
+	// underflows to 0 for long sequences, use log_likelihood()
+	double64 likelihood()
+	{
+		return std::exp(log_likelihood());
+	}
+
+	// log-sum-exp forward, fills log_alpha and returns log P(O | lambda)
+	// slower than the scaled forward() but never loses a state to underflow
+	double64 forward_log()
+	{
+		auto log_A = log_table(A);
+		auto log_B = log_table(B);
+		auto terms = std::vector<double64>(state_count);
+
+		log_alpha.resize(T * state_count);
+		for (auto state : std::views::iota(0uz, state_count))
+			log_alpha[state] = std::log(pi[state]) + log_B[state * observation_count + observations[0]];
+
+		for (auto t : std::views::iota(1uz, T))
+		{
+			for (auto curr_state : std::views::iota(0uz, state_count))
+			{
+				for (auto prev_state : std::views::iota(0uz, state_count))
+				{
+					terms[prev_state] = log_alpha[(t - 1) * state_count + prev_state] + log_A[prev_state * state_count + curr_state];
+				}
+
+				log_alpha[t * state_count + curr_state] = log_sum_exp(terms) + log_B[curr_state * observation_count + observations[t]];
+			}
+		}
+
+		return log_sum_exp({ log_alpha.data() + (T - 1) * state_count, state_count });
+	}
+
+	// log-sum-exp backward, fills log_beta
+	void backward_log()
+	{
+		auto log_A = log_table(A);
+		auto log_B = log_table(B);
+		auto terms = std::vector<double64>(state_count);
+
+		log_beta.resize(T * state_count);
+		for (auto state : std::views::iota(0uz, state_count))
+			log_beta[(T - 1) * state_count + state] = 0.0;
+
+		for (auto t : std::views::iota(0uz, T - 1) | std::views::reverse)
+		{
+			for (auto curr_state : std::views::iota(0uz, state_count))
+			{
+				for (auto next_state : std::views::iota(0uz, state_count))
+				{
+					terms[next_state] = log_A[curr_state * state_count + next_state] + log_B[next_state * observation_count + observations[t + 1]] + log_beta[(t + 1) * state_count + next_state];
+				}
+
+				log_beta[t * state_count + curr_state] = log_sum_exp(terms);
+			}
+		}
+	}
+
+	// init delta, psi, and path
+	// delta[t] is rescaled to a max of 1 every step so long sequences do not underflow, argmax is unchanged
+	void viterbi()
+	{
+		update_layout();
+		delta.resize(T * state_count);
+		psi.resize(T * state_count);
+		path.resize(T);
+
+		for (auto s : std::views::iota(0uz, state_count))
+		{
+			delta[s] = pi[s] * b(s, observations[0]);
+			psi[s]	 = 0;	 // dummy
+		}
+
+		normalize_delta(0);
+
+		for (auto t : std::views::iota(1uz, T))
+		{
+			p_kernels->viterbi_step(A.data(), &delta[(t - 1) * state_count], b_col(observations[t]), &delta[t * state_count], &psi[t * state_count], state_count);
+			normalize_delta(t);
+		}
+
+		auto last	= row(delta, T - 1);
+		path[T - 1] = (t_state)(std::ranges::max_element(last) - last.begin());
+
+		for (auto t : std::views::iota(0uz, T - 1) | std::views::reverse)
+		{
+			path[t] = psi[(t + 1) * state_count + path[t + 1]];
+		}
+	}
+
+	// viterbi in log space : max-plus on log A / log B, no underflow however long T is
+	// keeps two delta rows and the full psi [T][state_count], returns log P of the best path
+	double64 viterbi_log()
+	{
+		update_layout();
+		auto log_A	= log_table(A);
+		auto log_Bt = log_table(Bt);
+		psi.resize(T * state_count);
+		path.resize(T);
+
+		auto rows	= std::vector<double64>(2 * state_count);
+		auto* p_prev = rows.data();
+		auto* p_curr = rows.data() + state_count;
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			p_prev[state] = std::log(pi[state]) + log_Bt[observations[0] * state_count + state];
+			psi[state]	  = 0;	  // dummy
+		}
+
+		for (auto t : std::views::iota(1uz, T))
+		{
+			p_kernels->viterbi_step_log(log_A.data(), p_prev, &log_Bt[observations[t] * state_count], p_curr, &psi[t * state_count], state_count);
+			std::swap(p_prev, p_curr);
+		}
+
+		auto last	= std::max_element(p_prev, p_prev + state_count);
+		path[T - 1] = (t_state)(last - p_prev);
+		for (auto t : std::views::iota(0uz, T - 1) | std::views::reverse)
+		{
+			path[t] = psi[(t + 1) * state_count + path[t + 1]];
+		}
+
+		return *last;
+	}
+
+	// viterbi_log with checkpoints, for traces whose psi does not fit in memory
+	// the first pass keeps only the delta row in front of every segment of segment_len samples,
+	// the traceback then recomputes psi one segment at a time, last segment first.
+	// memory : O(state_count * (T / segment_len + segment_len)), sqrt(T) by default, for one more max-plus pass.
+	// psi is recomputed from the same delta with the same kernel, so path is identical to viterbi_log()
+	double64 viterbi_checkpointed(std::size_t segment_len = 0)
+	{
+		update_layout();
+		auto log_A	= log_table(A);
+		auto log_Bt = log_table(Bt);
+		path.resize(T);
+
+		segment_len		   = segment_len > 0 ? segment_len : std::max(1uz, (std::size_t)std::sqrt((double64)T));
+		auto segment_count = (T + segment_len - 1) / segment_len;
+
+		// checkpoints[s] = delta[s * segment_len - 1], the row segment s starts from (s >= 1)
+		auto checkpoints = std::vector<double64>(segment_count * state_count);
+		auto seg_psi	 = std::vector<t_state>(segment_len * state_count);
+		auto rows		 = std::vector<double64>(2 * state_count);
+		auto* p_prev	 = rows.data();
+		auto* p_curr	 = rows.data() + state_count;
+
+		auto init_delta = [&](double64* p_row) {
+			for (auto state : std::views::iota(0uz, state_count))
+			{
+				p_row[state] = std::log(pi[state]) + log_Bt[observations[0] * state_count + state];
+			}
+		};
+
+		// runs t in [begin, end) from p_prev = delta[begin - 1], psi of t goes to seg_psi[t - begin], returns delta[end - 1]
+		auto run = [&](std::size_t begin, std::size_t end, bool save_checkpoints) {
+			for (auto t : std::views::iota(begin, end))
+			{
+				p_kernels->viterbi_step_log(log_A.data(), p_prev, &log_Bt[observations[t] * state_count], p_curr, &seg_psi[(t % segment_len) * state_count], state_count);
+				std::swap(p_prev, p_curr);
+				if (save_checkpoints and (t + 1) % segment_len == 0 and t + 1 < T)
+				{
+					std::copy_n(p_prev, state_count, &checkpoints[(t + 1) / segment_len * state_count]);
+				}
+			}
+		};
+
+		init_delta(p_prev);
+		if (T > 1 and segment_len == 1)
+		{
+			std::copy_n(p_prev, state_count, &checkpoints[state_count]);
+		}
+		run(1, T, true);
+
+		auto last	= std::max_element(p_prev, p_prev + state_count);
+		auto best	= *last;
+		path[T - 1] = (t_state)(last - p_prev);
+
+		for (auto seg : std::views::iota(0uz, segment_count) | std::views::reverse)
+		{
+			auto begin = seg * segment_len;
+			auto end   = std::min(T, begin + segment_len);
+			if (seg == 0)
+			{
+				init_delta(p_prev);
+				run(1, end, false);
+			}
+			else
+			{
+				std::copy_n(&checkpoints[seg * state_count], state_count, p_prev);
+				run(begin, end, false);
+			}
+
+			// psi of t in this segment is seg_psi[t % segment_len]
+			for (auto t = end - 1; t > begin; --t)
+			{
+				path[t - 1] = seg_psi[(t % segment_len) * state_count + path[t]];
+			}
+			if (seg > 0)
+			{
+				path[begin - 1] = seg_psi[(begin % segment_len) * state_count + path[begin]];
+			}
+		}
+
+		return best;
+	}
+
+	// accumulate the expected counts of the current sequence into stats
+	// streams over t once without storing gamma or xi : a backward pass fills beta (each row normalized),
+	// then a forward pass keeps only two alpha rows and adds gamma[t] and xi[t - 1] to the counts as soon as they are known.
+	// gamma[t] and xi[t] are normalized on the spot, so beta only has to be right up to a per-row factor.
+	// memory : beta [T][state_count] plus O(state_count * (state_count + observation_count))
+	void e_step(suff_stats& stats)
+	{
+		assert(stats.state_count == state_count and stats.observation_count == observation_count);
+
+		update_layout();
+		beta.resize(T * state_count);
+
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			beta[(T - 1) * state_count + state] = 1.0 / (double64)state_count;
+		}
+
+		for (auto t : std::views::iota(0uz, T - 1) | std::views::reverse)
+		{
+			auto curr = row(beta, t);
+			p_kernels->backward_step(At.data(), &beta[(t + 1) * state_count], b_col(observations[t + 1]), 1.0, curr.data(), state_count);
+
+			auto sum = std::ranges::fold_left(curr, 0.0, std::plus {});
+			for (auto& val : curr)
+			{
+				val /= sum;
+			}
+		}
+
+		// emission counts are kept as [observation][state] here so each step adds one contiguous row
+		auto emit_t			= std::vector<double64>(observation_count * state_count, 0.0);
+		auto alpha_rows		= std::vector<double64>(2 * state_count);
+		auto* p_prev		= alpha_rows.data();
+		auto* p_curr		= alpha_rows.data() + state_count;
+		auto log_likelihood = 0.0;
+
+		auto sum = 0.0;
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			p_prev[state]  = pi[state] * b(state, observations[0]);
+			sum			  += p_prev[state];
+		}
+
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			p_prev[state] /= sum;
+		}
+
+		log_likelihood += std::log(sum);
+
+		// gamma[0] = alpha[0] * beta[0] / norm
+		auto norm = dot(p_prev, beta.data());
+		p_kernels->mul_add(stats.pi.data(), p_prev, beta.data(), 1.0 / norm, state_count);
+		p_kernels->mul_add(&emit_t[observations[0] * state_count], p_prev, beta.data(), 1.0 / norm, state_count);
+
+		for (auto t : std::views::iota(1uz, T))
+		{
+			auto* p_beta = &beta[t * state_count];
+			auto* p_b	 = b_col(observations[t]);
+
+			sum = p_kernels->forward_step(A.data(), p_prev, p_b, p_curr, state_count);
+			for (auto state : std::views::iota(0uz, state_count))
+			{
+				p_curr[state] /= sum;
+			}
+
+			log_likelihood += std::log(sum);
+
+			// xi[t - 1][i][j] = alpha[t - 1][i] * A[i][j] * b_j(O_t) * beta[t][j] / (sum * norm)
+			// gamma[t][s]		= alpha[t][s] * beta[t][s] / norm
+			norm = dot(p_curr, p_beta);
+			p_kernels->xi_accumulate(A.data(), p_prev, p_beta, p_b, 1.0 / (sum * norm), stats.trans.data(), state_count);
+			p_kernels->mul_add(&emit_t[observations[t] * state_count], p_curr, p_beta, 1.0 / norm, state_count);
+
+			std::swap(p_prev, p_curr);
+		}
+
+		for (auto o : std::views::iota(0uz, observation_count))
+		{
+			for (auto state : std::views::iota(0uz, state_count))
+			{
+				stats.emit[state * observation_count + o] += emit_t[o * state_count + state];
+			}
+		}
+
+		stats.log_likelihood += log_likelihood;
+		stats.sequence_count += 1;
+	}
+
+	// re-estimate lambda from the summed expected counts
+	// a state that was never visited keeps its previous row
+	void m_step(const suff_stats& stats)
+	{
+		assert(stats.sequence_count > 0);
+
+		for (auto curr_state : std::views::iota(0uz, state_count))
+		{
+			pi[curr_state] = stats.pi[curr_state] / (double64)stats.sequence_count;
+
+			// expected number of transitions from curr_state, t = 0 .. T - 2
+			auto trans_row = std::span { stats.trans.data() + curr_state * state_count, state_count };
+			auto trans_sum = std::ranges::fold_left(trans_row, 0.0, std::plus {});
+			if (trans_sum > 0.0)
+			{
+				for (auto next_state : std::views::iota(0uz, state_count))
+				{
+					a(curr_state, next_state) = trans_row[next_state] / trans_sum;
+				}
+			}
+
+			// emissions are counted over the whole sequence, t = 0 .. T - 1
+			auto emit_row = std::span { stats.emit.data() + curr_state * observation_count, observation_count };
+			auto emit_sum = std::ranges::fold_left(emit_row, 0.0, std::plus {});
+			if (emit_sum > 0.0)
+			{
+				for (auto o : std::views::iota(0uz, observation_count))
+				{
+					b(curr_state, o) = emit_row[o] / emit_sum;
+				}
+			}
+		}
+	}
+
+	void baum_welch()
+	{
+		auto stats = suff_stats(state_count, observation_count);
+		e_step(stats);
+		m_step(stats);
+	}
+
+	// take A, B, pi of another model with the same dimensions
+	void copy_parameters(const dyn_model& other)
+	{
+		assert(other.state_count == state_count and other.observation_count == observation_count);
+		A	  = other.A;
+		B	  = other.B;
+		pi	  = other.pi;
+		edges = other.edges;
+	}
+
+	// lambda as text : "state_count observation_count", then A, B, pi row by row, then "edges" and the bin edges if there are any
+	bool save(const std::string& path) const
+	{
+		std::ofstream file(path);
+		if (not file.is_open())
+		{
+			return false;
+		}
+
+		file << state_count << ' ' << observation_count << '\n';
+		auto write_rows = [&file](const std::vector<double64>& table, std::size_t width) {
+			for (auto i : std::views::iota(0uz, table.size()))
+			{
+				file << std::format("{:.17g}", table[i]) << ((i + 1) % width == 0 ? '\n' : ' ');
+			}
+		};
+		write_rows(A, state_count);
+		write_rows(B, observation_count);
+		write_rows(pi, state_count);
+		if (not edges.empty())
+		{
+			file << "edges\n";
+			write_rows(edges, edges.size());
+		}
+
+		return file.good();
+	}
+
+	// replaces this model, dimensions included, with the one saved at path
+	bool load(const std::string& path)
+	{
+		std::ifstream file(path);
+		if (not file.is_open())
+		{
+			return false;
+		}
+
+		auto n = 0uz;
+		auto m = 0uz;
+		if (not(file >> n >> m) or n == 0 or m == 0)
+		{
+			return false;
+		}
+
+		auto res = dyn_model(n, m);
+		for (auto* p_table : { &res.A, &res.B, &res.pi })
+		{
+			for (auto& val : *p_table)
+			{
+				if (not(file >> val))
+				{
+					return false;
+				}
+			}
+		}
+
+		// files written before the edges existed end here
+		auto tag = std::string {};
+		if (file >> tag and tag == "edges")
+		{
+			res.edges.resize(m - 1);
+			for (auto& val : res.edges)
+			{
+				if (not(file >> val))
+				{
+					return false;
+				}
+			}
+		}
+
+		res.p_kernels = p_kernels;
+		*this		  = std::move(res);
+		return true;
+	}
+
+	// parameters plus every per-time table at its current size
+	std::size_t memory_footprint() const
+	{
+		return sizeof(*this) + heap_bytes(A, B, pi, observations, edges, alpha, beta, scale, log_alpha, log_beta, delta, psi, path, At, Bt);
+	}
+
+	double64 dot(const double64* x, const double64* y) const
+	{
+		auto res = 0.0;
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			res += x[state] * y[state];
+		}
+
+		return res;
+	}
+
+	static std::vector<double64> log_table(const std::vector<double64>& table)
+	{
+		auto res = std::vector<double64>(table.size());
+		std::ranges::transform(table, res.begin(), [](auto val) { return std::log(val); });
+		return res;
+	}
+
+	void normalize_alpha(std::size_t t, double64 sum)
+	{
+		scale[t] = sum;
+		for (auto& val : row(alpha, t))
+		{
+			val /= sum;
+		}
+	}
+
+	void normalize_delta(std::size_t t)
+	{
+		auto max = std::ranges::max(row(delta, t));
+		if (max > 0.0)
+		{
+			for (auto& val : row(delta, t))
+			{
+				val /= max;
+			}
+		}
+	}
+
+	void print()
+	{
+		std::cout << "A : \n"
+				  << format_table<double64>(A, state_count) << std::endl;
+		std::cout << "B : \n"
+				  << format_table<double64>(B, observation_count) << std::endl;
+		std::cout << "pi : \n"
+				  << format_table<double64>(pi, state_count) << std::endl;
+	}
+};
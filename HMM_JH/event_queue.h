@@ -0,0 +1,92 @@
+#pragma once
+#include <vector>
+#include <ranges>
+#include <algorithm>
+#include <atomic>
+#include <optional>
+#include <bit>
+#include <new>
+#include <cassert>
+#include "common.h"
+
+// bounded lock-free multi producer / single consumer ring (vyukov's sequence numbered cells)
+// every cell carries the ticket it is ready for : tail for a producer, tail + 1 for the consumer.
+// a producer claims a ticket with one cas on tail and publishes by storing the cell's sequence, so push never blocks
+// and never allocates. when the ring is full push drops the item and counts it instead of waiting on the consumer.
+template <typename t>
+struct event_queue
+{
+	struct cell
+	{
+		std::atomic<uint64> sequence;
+		t					value;
+	};
+
+	std::vector<cell> cells;
+	uint64			  mask;
+
+	// producers and the consumer on separate cache lines
+	alignas(64) std::atomic<uint64> tail = 0;
+	alignas(64) std::atomic<uint64> head = 0;
+	std::atomic<uint64>				dropped = 0;
+
+	// capacity rounds up to a power of two
+	explicit event_queue(std::size_t capacity = 4096) : cells(std::bit_ceil(std::max(capacity, 2uz))), mask(cells.size() - 1)
+	{
+		for (auto idx : std::views::iota(0uz, cells.size()))
+		{
+			cells[idx].sequence.store(idx, std::memory_order_relaxed);
+		}
+	}
+
+	event_queue(const event_queue&)			   = delete;
+	event_queue& operator=(const event_queue&) = delete;
+
+	std::size_t capacity() const { return cells.size(); }
+
+	// any thread. false when full, the item is dropped
+	bool push(const t& value)
+	{
+		auto pos = tail.load(std::memory_order_relaxed);
+		while (true)
+		{
+			auto& c	  = cells[pos & mask];
+			auto  seq = c.sequence.load(std::memory_order_acquire);
+			auto  dif = (int64)seq - (int64)pos;
+			if (dif == 0)
+			{
+				if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					c.value = value;
+					c.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (dif < 0)
+			{
+				dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			else
+			{
+				pos = tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// consumer thread only
+	std::optional<t> pop()
+	{
+		auto  pos = head.load(std::memory_order_relaxed);
+		auto& c	  = cells[pos & mask];
+		if (c.sequence.load(std::memory_order_acquire) != pos + 1)
+		{
+			return std::nullopt;
+		}
+
+		auto res = std::optional<t>(std::move(c.value));
+		c.sequence.store(pos + cells.size(), std::memory_order_release);
+		head.store(pos + 1, std::memory_order_relaxed);
+		return res;
+	}
+};
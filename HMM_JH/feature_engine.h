@@ -0,0 +1,443 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <ranges>
+#include <algorithm>
+#include <bit>
+#include <string>
+#include <format>
+#include <functional>
+#include <cmath>
+#include <limits>
+#include <cassert>
+#include "common.h"
+
+struct feature_config
+{
+	std::vector<std::size_t> window_sizes = { 10, 60, 300 };
+	std::vector<double64>	 quantiles	  = { 0.5, 0.9, 0.99 };
+	// value features are min-max scaled like the notebooks' MinMaxScaler fitted on [scale_min, scale_max],
+	// spread and slope by the same range. scale_max <= scale_min leaves everything raw
+	double64				 scale_min	  = 0.0;
+	double64				 scale_max	  = 0.0;
+	// quantile buckets are geometric with this relative error over [quantile_lo, quantile_hi], values outside land in the end buckets
+	double64				 relative_accuracy = 0.01;
+	double64				 quantile_lo	   = 1e3;
+	double64				 quantile_hi	   = 1e10;
+};
+
+// sliding min or max : values that can never be the extreme again are dropped from the back, so every value is
+// pushed and popped once, O(1) amortized. ring of (sample index, value), never more than the window
+template <typename t_better>
+struct monotonic_queue
+{
+	std::vector<std::pair<uint64, double64>> ring;
+	// [head, tail) wrapping, no modulo on the hot path
+	std::size_t								 head  = 0;
+	std::size_t								 tail  = 0;
+	std::size_t								 count = 0;
+
+	explicit monotonic_queue(std::size_t window_size) : ring(window_size + 1) { }
+
+	// idx of x, samples at or below expire_idx leave the window
+	void push(uint64 idx, double64 x, uint64 expire_idx, bool expire)
+	{
+		while (count > 0)
+		{
+			auto back = tail == 0 ? ring.size() - 1 : tail - 1;
+			if (t_better {}(ring[back].second, x))
+			{
+				break;
+			}
+			tail = back;
+			--count;
+		}
+
+		ring[tail] = { idx, x };
+		tail	   = tail + 1 == ring.size() ? 0 : tail + 1;
+		++count;
+
+		if (expire and ring[head].first <= expire_idx)
+		{
+			head = head + 1 == ring.size() ? 0 : head + 1;
+			--count;
+		}
+	}
+
+	double64 front() const { return count == 0 ? std::numeric_limits<double64>::quiet_NaN() : ring[head].second; }
+};
+
+// sliding quantiles on a fixed geometric histogram (the bucket mapping of quantile_sketch).
+// every tracked quantile keeps the bucket it sits in and how many samples lie below that bucket : an add or remove
+// moves its rank by at most one, so it steps to the next non-empty bucket up or down at most once.
+// a bitmap of the non-empty buckets makes that step a count-zero over a few words instead of a walk over the
+// empty buckets between two order statistics, which a short window on a wide histogram is mostly made of
+struct window_quantiles
+{
+	struct walker
+	{
+		double64	q;
+		std::size_t pos	  = 0;
+		uint64		below = 0;
+	};
+
+	double64			  inv_log_gamma;
+	double64			  gamma;
+	int64				  offset;
+	std::vector<uint32>	  counts;
+	std::vector<uint64>	  occupied;
+	// middle of every bucket, (gamma^(k-1), gamma^k] in relative terms
+	std::vector<double64> midpoint;
+	std::vector<walker>	  walkers;
+	uint64				  count = 0;
+
+	window_quantiles(std::span<const double64> quantiles, double64 relative_accuracy, double64 lo, double64 hi)
+		: inv_log_gamma(1.0 / std::log((1.0 + relative_accuracy) / (1.0 - relative_accuracy))),
+		  gamma((1.0 + relative_accuracy) / (1.0 - relative_accuracy)),
+		  offset((int64)std::ceil(std::log(lo) * inv_log_gamma))
+	{
+		assert(lo > 0.0 and hi > lo);
+		counts.resize((std::size_t)((int64)std::ceil(std::log(hi) * inv_log_gamma) - offset) + 1, 0);
+		occupied.resize((counts.size() + 63) / 64, 0);
+		for (auto b : std::views::iota(0uz, counts.size()))
+		{
+			midpoint.push_back(2.0 * std::pow(gamma, (double64)(offset + (int64)b)) / (gamma + 1.0));
+		}
+		for (auto q : quantiles)
+		{
+			walkers.push_back({ std::clamp(q, 0.0, 1.0) });
+		}
+	}
+
+	std::size_t bucket(double64 x) const
+	{
+		if (not(x > 0.0))
+		{
+			return 0;
+		}
+		auto idx = (int64)std::ceil(std::log(x) * inv_log_gamma) - offset;
+		return (std::size_t)std::clamp(idx, (int64)0, (int64)counts.size() - 1);
+	}
+
+	// by bucket, so a stream that feeds many windows takes the log once per sample
+	void add(std::size_t b)
+	{
+		if (counts[b]++ == 0)
+		{
+			occupied[b / 64] |= 1ull << (b % 64);
+		}
+		++count;
+		_rebalance(b, 1);
+	}
+
+	void remove(std::size_t b)
+	{
+		assert(counts[b] > 0);
+		if (--counts[b] == 0)
+		{
+			occupied[b / 64] &= ~(1ull << (b % 64));
+		}
+		--count;
+		_rebalance(b, -1);
+	}
+
+	// middle of the bucket of walker k
+	double64 value(std::size_t k) const { return count == 0 ? std::numeric_limits<double64>::quiet_NaN() : midpoint[walkers[k].pos]; }
+
+  private:
+	// first non-empty bucket >= b, counts.size() if none
+	std::size_t _next(std::size_t b) const
+	{
+		auto word = b / 64;
+		if (word >= occupied.size())
+		{
+			return counts.size();
+		}
+
+		auto bits = occupied[word] & (~0ull << (b % 64));
+		while (bits == 0)
+		{
+			if (++word == occupied.size())
+			{
+				return counts.size();
+			}
+			bits = occupied[word];
+		}
+		return word * 64 + (std::size_t)std::countr_zero(bits);
+	}
+
+	// last non-empty bucket <= b, 0 if none
+	std::size_t _prev(std::size_t b) const
+	{
+		auto word = b / 64;
+		auto bits = occupied[word] & (~0ull >> (63 - b % 64));
+		while (bits == 0)
+		{
+			if (word == 0)
+			{
+				return 0;
+			}
+			bits = occupied[--word];
+		}
+		return word * 64 + 63 - (std::size_t)std::countl_zero(bits);
+	}
+
+	void _rebalance(std::size_t b, int32 delta)
+	{
+		for (auto& w : walkers)
+		{
+			if (b < w.pos)
+			{
+				w.below += delta;
+			}
+
+			if (count == 0)
+			{
+				w.pos	= 0;
+				w.below = 0;
+				continue;
+			}
+
+			// below <= rank < below + counts[pos]
+			auto rank = (uint64)(w.q * (double64)(count - 1));
+			while (w.pos > 0 and w.below > rank)
+			{
+				w.pos	 = _prev(w.pos - 1);
+				w.below -= counts[w.pos];
+			}
+			while (w.below + counts[w.pos] <= rank)
+			{
+				w.below += counts[w.pos];
+				w.pos	 = _next(w.pos + 1);
+				assert(w.pos < counts.size());
+			}
+		}
+	}
+};
+
+// rolling features of one delay stream over several windows at once, O(1) amortized per sample.
+// one ring holds the last max(window_sizes) raw values and feeds every window its expiring sample.
+// per window, in this order :
+//	mean, std		running sums of (x - shift), re-summed exactly from the ring once per ring turn so rounding never builds up
+//	min, max		monotonic queues
+//	ewma			alpha = 2 / (W + 1), pandas' ewm(span = W)
+//	slope			least squares slope per sample over the window, from the running sum of t * x
+//	quantiles		window_quantiles, config.quantiles in order
+// the vector starts with the last value. windows that are not full yet use what they have, like min_periods = 1.
+// features() writes that fixed layout, names() says what every slot is, so the server, the trainers and the
+// notebooks' csv all agree on it
+struct feature_engine
+{
+	struct window_state
+	{
+		std::size_t						  size;
+		double64						  alpha;
+		std::size_t						  count	 = 0;
+		double64						  sum	 = 0.0;
+		double64						  sum_sq = 0.0;
+		// sum over the window of t * (x - shift), t = 0 for the oldest sample
+		double64						  sum_tx = 0.0;
+		double64						  ewma	 = 0.0;
+		monotonic_queue<std::less<>>	  min_queue;
+		monotonic_queue<std::greater<>>	  max_queue;
+		window_quantiles				  quantiles;
+
+		double64 mean(double64 shift) const { return count == 0 ? 0.0 : sum / (double64)count + shift; }
+
+		double64 variance() const
+		{
+			if (count < 2)
+			{
+				return 0.0;
+			}
+			auto n = (double64)count;
+			return std::max((sum_sq - sum * sum / n) / (n - 1.0), 0.0);
+		}
+
+		double64 slope() const
+		{
+			if (count < 2)
+			{
+				return 0.0;
+			}
+			auto n	  = (double64)count;
+			auto s_t  = n * (n - 1.0) / 2.0;
+			auto s_tt = (n - 1.0) * n * (2.0 * n - 1.0) / 6.0;
+			return (n * sum_tx - s_t * sum) / (n * s_tt - s_t * s_t);
+		}
+	};
+
+	feature_config			  config;
+	std::vector<window_state> windows;
+	std::vector<double64>	  ring;
+	// quantile bucket of every value in the ring
+	std::vector<uint32>		  ring_bucket;
+	// sample_count % ring.size()
+	std::size_t				  ring_pos	   = 0;
+	uint64					  sample_count = 0;
+	// first sample, subtracted inside the sums to keep sum_sq well conditioned on nanosecond delays
+	double64				  shift		   = 0.0;
+	double64				  last		   = 0.0;
+
+	explicit feature_engine(feature_config feature_conf = {}) : config(std::move(feature_conf))
+	{
+		assert(not config.window_sizes.empty());
+		for (auto size : config.window_sizes)
+		{
+			assert(size > 0);
+			windows.push_back({ size, 2.0 / ((double64)size + 1.0), 0, 0.0, 0.0, 0.0, 0.0, monotonic_queue<std::less<>>(size), monotonic_queue<std::greater<>>(size),
+								window_quantiles(config.quantiles, config.relative_accuracy, config.quantile_lo, config.quantile_hi) });
+		}
+		ring.resize(std::ranges::max(config.window_sizes), 0.0);
+		ring_bucket.resize(ring.size(), 0);
+	}
+
+	std::size_t per_window_count() const { return 6 + config.quantiles.size(); }
+
+	std::size_t feature_count() const { return 1 + windows.size() * per_window_count(); }
+
+	std::vector<std::string> names() const
+	{
+		auto res = std::vector<std::string> { "last" };
+		for (auto& w : windows)
+		{
+			for (auto name : { "mean", "std", "min", "max", "ewma", "slope" })
+			{
+				res.push_back(std::format("{}_{}", name, w.size));
+			}
+			for (auto q : config.quantiles)
+			{
+				res.push_back(std::format("q{}_{}", q * 100.0, w.size));
+			}
+		}
+		return res;
+	}
+
+	void update(double64 x)
+	{
+		if (sample_count == 0)
+		{
+			shift = x;
+		}
+
+		auto idx	= sample_count;
+		auto y		= x - shift;
+		auto bucket = windows[0].quantiles.bucket(x);
+		for (auto& w : windows)
+		{
+			auto full = w.count == w.size;
+			if (full)
+			{
+				auto old  = ring_pos >= w.size ? ring_pos - w.size : ring_pos + ring.size() - w.size;
+				auto y0	  = ring[old] - shift;
+				w.sum_tx -= w.sum - y0;
+				w.sum	 -= y0;
+				w.sum_sq -= y0 * y0;
+				w.quantiles.remove(ring_bucket[old]);
+			}
+			else
+			{
+				++w.count;
+			}
+
+			w.sum_tx += (double64)(w.count - 1) * y;
+			w.sum	 += y;
+			w.sum_sq += y * y;
+			w.ewma	  = idx == 0 ? x : w.ewma + w.alpha * (x - w.ewma);
+			w.min_queue.push(idx, x, idx - w.size, idx >= w.size);
+			w.max_queue.push(idx, x, idx - w.size, idx >= w.size);
+			w.quantiles.add(bucket);
+		}
+
+		ring[ring_pos]		  = x;
+		ring_bucket[ring_pos] = (uint32)bucket;
+		last				  = x;
+		++sample_count;
+
+		if (++ring_pos == ring.size())
+		{
+			ring_pos = 0;
+			_resum();
+		}
+	}
+
+	double64 mean(std::size_t window_idx) const { return windows[window_idx].mean(shift); }
+
+	// raw, config.quantiles[quantile_idx] of window window_idx
+	double64 quantile(std::size_t window_idx, std::size_t quantile_idx) const
+	{
+		auto& w = windows[window_idx];
+		return std::clamp(w.quantiles.value(quantile_idx), w.min_queue.front(), w.max_queue.front());
+	}
+
+	// true once every window is full
+	bool ready() const { return sample_count >= ring.size(); }
+
+	// last out.size() raw values, oldest first. false until that many were seen or past the longest window
+	bool recent(std::span<double64> out) const
+	{
+		if (out.size() > ring.size() or sample_count < out.size())
+		{
+			return false;
+		}
+
+		for (auto idx : std::views::iota(0uz, out.size()))
+		{
+			out[idx] = ring[(sample_count - out.size() + idx) % ring.size()];
+		}
+		return true;
+	}
+
+	// out.size() >= feature_count()
+	void features(std::span<double64> out) const
+	{
+		assert(out.size() >= feature_count());
+		auto scaled = config.scale_max > config.scale_min;
+		auto inv	= scaled ? 1.0 / (config.scale_max - config.scale_min) : 1.0;
+		auto base	= scaled ? config.scale_min : 0.0;
+		auto value	= [&](double64 v) { return (v - base) * inv; };
+
+		auto pos   = 0uz;
+		out[pos++] = value(last);
+		for (auto idx : std::views::iota(0uz, windows.size()))
+		{
+			auto& w	   = windows[idx];
+			out[pos++] = value(w.mean(shift));
+			out[pos++] = std::sqrt(w.variance()) * inv;
+			out[pos++] = value(w.min_queue.front());
+			out[pos++] = value(w.max_queue.front());
+			out[pos++] = value(w.ewma);
+			out[pos++] = w.slope() * inv;
+			for (auto k : std::views::iota(0uz, config.quantiles.size()))
+			{
+				out[pos++] = value(quantile(idx, k));
+			}
+		}
+	}
+
+	std::vector<double64> features() const
+	{
+		auto res = std::vector<double64>(feature_count());
+		features(res);
+		return res;
+	}
+
+  private:
+	// exact sums from the ring, O(sum of window sizes) once every ring.size() samples
+	void _resum()
+	{
+		for (auto& w : windows)
+		{
+			w.sum	 = 0.0;
+			w.sum_sq = 0.0;
+			w.sum_tx = 0.0;
+			for (auto t : std::views::iota(0uz, w.count))
+			{
+				auto y	  = ring[(sample_count - w.count + t) % ring.size()] - shift;
+				w.sum	 += y;
+				w.sum_sq += y * y;
+				w.sum_tx += (double64)t * y;
+			}
+		}
+	}
+};
@@ -0,0 +1,528 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <ranges>
+#include <algorithm>
+#include <numbers>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <cassert>
+#include "common.h"
+#include "dyn_model.h"
+#include "trainer.h"
+
+// expected sufficient statistics of a gmm_model, merged like suff_stats
+struct gmm_stats
+{
+	std::size_t state_count;
+	std::size_t mixture_count;
+
+	// [state_count], sum over sequences of gamma[0]
+	std::vector<double64> pi;
+	// [state_count][state_count], sum over t of xi[t]
+	std::vector<double64> trans;
+	// [state_count][mixture_count], sum over t of the component responsibility r[t]
+	std::vector<double64> weight;
+	// [state_count][mixture_count], sum over t of r[t] * (x[t] - center), center is the mean the e-step ran with
+	std::vector<double64> first;
+	// [state_count][mixture_count], sum over t of r[t] * (x[t] - center)^2
+	std::vector<double64> second;
+
+	double64	log_likelihood = 0.0;
+	std::size_t sequence_count = 0;
+
+	gmm_stats(std::size_t state_count, std::size_t mixture_count)
+		: state_count(state_count), mixture_count(mixture_count),
+		  pi(state_count), trans(state_count * state_count),
+		  weight(state_count * mixture_count), first(state_count * mixture_count), second(state_count * mixture_count)
+	{
+	}
+
+	void clear()
+	{
+		for (auto* p_table : { &pi, &trans, &weight, &first, &second })
+		{
+			std::ranges::fill(*p_table, 0.0);
+		}
+		log_likelihood = 0.0;
+		sequence_count = 0;
+	}
+
+	void merge(const gmm_stats& other)
+	{
+		assert(other.state_count == state_count and other.mixture_count == mixture_count);
+		auto add = [](std::vector<double64>& dst, const std::vector<double64>& src) {
+			for (auto i : std::views::iota(0uz, dst.size()))
+				dst[i] += src[i];
+		};
+		add(pi, other.pi);
+		add(trans, other.trans);
+		add(weight, other.weight);
+		add(first, other.first);
+		add(second, other.second);
+		log_likelihood += other.log_likelihood;
+		sequence_count += other.sequence_count;
+	}
+};
+
+// hmm with continuous 1-d emissions, every state is a mixture of mixture_count gaussians (mixture_count = 1 : gaussian hmm)
+// same layout and scaled passes as dyn_model, only B is replaced by densities :
+//	log_b[t][s] = log sum_k weight[s][k] * N(x_t; mean[s][k], var[s][k]), evaluated in log space.
+// the forward / backward / viterbi kernels take b_scaled[t] = exp(log_b[t] - b_shift[t]), b_shift[t] = max_s log_b[t][s],
+// so a density of 1e-300 or 1e+300 does not under / overflow, and the shift is added back to the log likelihood.
+struct gmm_model
+{
+	std::size_t state_count;
+	std::size_t mixture_count;
+	// sequence length
+	std::size_t T = 0;
+
+	// [state_count][state_count]
+	std::vector<double64> A;
+	// [state_count]
+	std::vector<double64> pi;
+	// [state_count][mixture_count]
+	std::vector<double64> weight;
+	std::vector<double64> mean;
+	std::vector<double64> var;
+	// lower bound of every var, keeps a component from collapsing onto one sample
+	double64			  var_floor = 1e-6;
+
+	// observation sequence, [T]
+	std::vector<double64> observations;
+
+	// [state_count * mixture_count][T], log (weight * density) of every component, time is contiguous so the evaluation vectorizes
+	std::vector<double64> log_comp;
+	// [T][state_count]
+	std::vector<double64> log_b;
+	std::vector<double64> b_scaled;
+	// [T]
+	std::vector<double64> b_shift;
+
+	// [T][state_count], see dyn_model
+	std::vector<double64> alpha;
+	std::vector<double64> beta;
+	std::vector<double64> scale;
+	std::vector<double64> delta;
+	std::vector<t_state>  psi;
+	// [T]
+	std::vector<t_state> path;
+
+	// At[next_state][curr_state]
+	std::vector<double64> At;
+
+	const kernel::kernel_set* p_kernels = &kernel::best();
+
+	gmm_model(std::size_t state_count, std::size_t mixture_count = 1)
+		: state_count(state_count), mixture_count(mixture_count),
+		  A(state_count * state_count), pi(state_count),
+		  weight(state_count * mixture_count), mean(state_count * mixture_count), var(state_count * mixture_count),
+		  At(state_count * state_count)
+	{
+		assert(state_count > 0 and state_count <= std::numeric_limits<t_state>::max() + 1uz);
+		assert(mixture_count > 0);
+	}
+
+	double64& a(std::size_t curr_state, std::size_t next_state) { return A[curr_state * state_count + next_state]; }
+
+	// mean of the emission of state, for point predictions
+	double64 state_mean(std::size_t state) const
+	{
+		auto res = 0.0;
+		for (auto k : std::views::iota(0uz, mixture_count))
+		{
+			res += weight[state * mixture_count + k] * mean[state * mixture_count + k];
+		}
+		return res;
+	}
+
+	void update_observations(auto&& view)
+	{
+		T = std::ranges::distance(view);
+		observations.resize(T);
+		std::ranges::copy(view, observations.begin());
+	}
+
+	// deterministic start from the data : state s takes the s-th of state_count quantile slices of the sorted samples,
+	// its components split that slice again, each starting at the slice's mean and variance (what k-means on 1-d data converges near)
+	void init_from_data(std::span<const double64> data)
+	{
+		assert(data.size() >= state_count * mixture_count);
+		auto sorted = std::vector<double64>(data.begin(), data.end());
+		std::ranges::sort(sorted);
+
+		auto total_mean = 0.0;
+		for (auto x : sorted)
+		{
+			total_mean += x;
+		}
+		total_mean /= (double64)sorted.size();
+
+		auto total_var = 0.0;
+		for (auto x : sorted)
+		{
+			total_var += (x - total_mean) * (x - total_mean);
+		}
+		total_var /= (double64)sorted.size();
+		var_floor  = std::max(total_var * 1e-6, std::numeric_limits<double64>::min());
+
+		auto slice_count = state_count * mixture_count;
+		for (auto slice : std::views::iota(0uz, slice_count))
+		{
+			auto begin = sorted.size() * slice / slice_count;
+			auto end   = sorted.size() * (slice + 1) / slice_count;
+			auto sum   = 0.0;
+			for (auto idx : std::views::iota(begin, end))
+			{
+				sum += sorted[idx];
+			}
+
+			auto slice_mean = sum / (double64)(end - begin);
+			auto slice_var	= 0.0;
+			for (auto idx : std::views::iota(begin, end))
+			{
+				slice_var += (sorted[idx] - slice_mean) * (sorted[idx] - slice_mean);
+			}
+
+			mean[slice]	  = slice_mean;
+			var[slice]	  = std::max(slice_var / (double64)(end - begin), var_floor);
+			weight[slice] = 1.0 / (double64)mixture_count;
+		}
+
+		// sticky start : delay regimes last for many samples
+		auto stay = state_count == 1 ? 1.0 : 0.9;
+		for (auto curr_state : std::views::iota(0uz, state_count))
+		{
+			for (auto next_state : std::views::iota(0uz, state_count))
+			{
+				a(curr_state, next_state) = curr_state == next_state ? stay : (1.0 - stay) / (double64)(state_count - 1);
+			}
+			pi[curr_state] = 1.0 / (double64)state_count;
+		}
+	}
+
+	void update_layout()
+	{
+		for (auto curr_state : std::views::iota(0uz, state_count))
+		{
+			for (auto next_state : std::views::iota(0uz, state_count))
+			{
+				At[next_state * state_count + curr_state] = A[curr_state * state_count + next_state];
+			}
+		}
+	}
+
+	// fill log_comp, log_b, b_scaled and b_shift for the current observations
+	void emission_log_density()
+	{
+		log_comp.resize(state_count * mixture_count * T);
+		log_b.resize(T * state_count);
+		b_scaled.resize(T * state_count);
+		b_shift.resize(T);
+
+		auto* p_x = observations.data();
+		for (auto comp : std::views::iota(0uz, state_count * mixture_count))
+		{
+			// log(w * N(x; mu, var)) = c0 + c2 * (x - mu)^2, no branch, no call : one fma chain per sample
+			auto* p_comp = &log_comp[comp * T];
+			if (weight[comp] <= 0.0)
+			{
+				std::ranges::fill(std::span { p_comp, T }, -std::numeric_limits<double64>::infinity());
+				continue;
+			}
+
+			auto mu = mean[comp];
+			auto c0 = std::log(weight[comp]) - 0.5 * std::log(2.0 * std::numbers::pi * var[comp]);
+			auto c2 = -0.5 / var[comp];
+
+			for (auto t = 0uz; t < T; ++t)
+			{
+				auto d	  = p_x[t] - mu;
+				p_comp[t] = c0 + c2 * d * d;
+			}
+		}
+
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			auto* p_first = &log_comp[state * mixture_count * T];
+			if (mixture_count == 1)
+			{
+				for (auto t = 0uz; t < T; ++t)
+				{
+					log_b[t * state_count + state] = p_first[t];
+				}
+				continue;
+			}
+
+			// log-sum-exp over the components
+			for (auto t = 0uz; t < T; ++t)
+			{
+				auto max = p_first[t];
+				for (auto k = 1uz; k < mixture_count; ++k)
+				{
+					max = std::max(max, p_first[k * T + t]);
+				}
+
+				auto sum = 0.0;
+				for (auto k = 0uz; k < mixture_count; ++k)
+				{
+					sum += std::exp(p_first[k * T + t] - max);
+				}
+				log_b[t * state_count + state] = max + std::log(sum);
+			}
+		}
+
+		for (auto t = 0uz; t < T; ++t)
+		{
+			auto* p_log = &log_b[t * state_count];
+			auto  max	= *std::max_element(p_log, p_log + state_count);
+			max			= std::isfinite(max) ? max : 0.0;
+			b_shift[t]	= max;
+			for (auto state : std::views::iota(0uz, state_count))
+			{
+				b_scaled[t * state_count + state] = std::exp(p_log[state] - max);
+			}
+		}
+	}
+
+	// scaled forward on b_scaled, returns log P(O | lambda)
+	double64 forward()
+	{
+		update_layout();
+		emission_log_density();
+		alpha.resize(T * state_count);
+		scale.resize(T);
+
+		auto sum = 0.0;
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			alpha[state]  = pi[state] * b_scaled[state];
+			sum			 += alpha[state];
+		}
+		_normalize_alpha(0, sum);
+
+		for (auto t : std::views::iota(1uz, T))
+		{
+			sum = p_kernels->forward_step(A.data(), &alpha[(t - 1) * state_count], &b_scaled[t * state_count], &alpha[t * state_count], state_count);
+			_normalize_alpha(t, sum);
+		}
+
+		return log_likelihood();
+	}
+
+	// after forward()
+	double64 log_likelihood() const
+	{
+		auto res = 0.0;
+		for (auto t : std::views::iota(0uz, T))
+		{
+			res += std::log(scale[t]) + b_shift[t];
+		}
+		return res;
+	}
+
+	// after forward(), same scaling as alpha
+	void backward()
+	{
+		beta.resize(T * state_count);
+		std::fill_n(&beta[(T - 1) * state_count], state_count, 1.0);
+		for (auto t : std::views::iota(0uz, T - 1) | std::views::reverse)
+		{
+			p_kernels->backward_step(At.data(), &beta[(t + 1) * state_count], &b_scaled[(t + 1) * state_count], 1.0 / scale[t + 1], &beta[t * state_count], state_count);
+		}
+	}
+
+	// accumulate the expected statistics of the current sequence into stats
+	void e_step(gmm_stats& stats)
+	{
+		assert(stats.state_count == state_count and stats.mixture_count == mixture_count);
+		if (T == 0)
+		{
+			return;
+		}
+
+		forward();
+		backward();
+
+		auto gamma = std::vector<double64>(state_count);
+		for (auto t : std::views::iota(0uz, T))
+		{
+			auto* p_alpha = &alpha[t * state_count];
+			auto* p_beta  = &beta[t * state_count];
+			auto  norm	  = 0.0;
+			for (auto state : std::views::iota(0uz, state_count))
+			{
+				gamma[state]  = p_alpha[state] * p_beta[state];
+				norm		 += gamma[state];
+			}
+
+			for (auto state : std::views::iota(0uz, state_count))
+			{
+				gamma[state] /= norm;
+				if (t == 0)
+				{
+					stats.pi[state] += gamma[state];
+				}
+
+				// r[t][s][k] = gamma[t][s] * w N_k(x_t) / sum_k w N_k(x_t), moments are taken around the current mean
+				auto log_b_t = log_b[t * state_count + state];
+				for (auto k : std::views::iota(0uz, mixture_count))
+				{
+					auto comp  = state * mixture_count + k;
+					auto r	   = mixture_count == 1 ? gamma[state] : gamma[state] * std::exp(log_comp[comp * T + t] - log_b_t);
+					auto d	   = observations[t] - mean[comp];
+					r		   = std::isfinite(r) ? r : 0.0;
+					stats.weight[comp] += r;
+					stats.first[comp]  += r * d;
+					stats.second[comp] += r * d * d;
+				}
+			}
+
+			// xi[t][i][j] = alpha[t][i] * A[i][j] * b_j(x_t+1) * beta[t + 1][j] / scale[t + 1]
+			if (t + 1 < T)
+			{
+				p_kernels->xi_accumulate(A.data(), p_alpha, &beta[(t + 1) * state_count], &b_scaled[(t + 1) * state_count], 1.0 / scale[t + 1], stats.trans.data(), state_count);
+			}
+		}
+
+		stats.log_likelihood += log_likelihood();
+		stats.sequence_count += 1;
+	}
+
+	void m_step(const gmm_stats& stats)
+	{
+		assert(stats.sequence_count > 0);
+
+		for (auto curr_state : std::views::iota(0uz, state_count))
+		{
+			pi[curr_state] = stats.pi[curr_state] / (double64)stats.sequence_count;
+
+			auto trans_row = std::span { stats.trans.data() + curr_state * state_count, state_count };
+			auto trans_sum = std::ranges::fold_left(trans_row, 0.0, std::plus {});
+			if (trans_sum > 0.0)
+			{
+				for (auto next_state : std::views::iota(0uz, state_count))
+				{
+					a(curr_state, next_state) = trans_row[next_state] / trans_sum;
+				}
+			}
+
+			auto weight_sum = 0.0;
+			for (auto k : std::views::iota(0uz, mixture_count))
+			{
+				weight_sum += stats.weight[curr_state * mixture_count + k];
+			}
+
+			// a state nobody visits keeps its emission
+			if (weight_sum <= 0.0)
+			{
+				continue;
+			}
+
+			for (auto k : std::views::iota(0uz, mixture_count))
+			{
+				auto comp = curr_state * mixture_count + k;
+				auto r	  = stats.weight[comp];
+				weight[comp] = r / weight_sum;
+				if (r <= 0.0)
+				{
+					continue;
+				}
+
+				// centered moments : var = E[(x - c)^2] - (E[x] - c)^2, c = previous mean
+				auto shift = stats.first[comp] / r;
+				mean[comp] += shift;
+				var[comp]	= std::max(stats.second[comp] / r - shift * shift, var_floor);
+			}
+		}
+	}
+
+	// one em iteration on the current observations, returns log P(O | lambda) before the update
+	double64 baum_welch()
+	{
+		auto stats = gmm_stats(state_count, mixture_count);
+		e_step(stats);
+		m_step(stats);
+		return stats.log_likelihood;
+	}
+
+	// same stopping rule as em_trainer::fit
+	train_result fit(const train_config& config)
+	{
+		return run_em(T, config, [this]() { return baum_welch(); });
+	}
+
+	// most likely state path into path
+	void viterbi()
+	{
+		update_layout();
+		emission_log_density();
+		delta.resize(T * state_count);
+		psi.resize(T * state_count);
+		path.resize(T);
+
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			delta[state] = pi[state] * b_scaled[state];
+			psi[state]	 = 0;	 // dummy
+		}
+		_normalize_delta(0);
+
+		for (auto t : std::views::iota(1uz, T))
+		{
+			p_kernels->viterbi_step(A.data(), &delta[(t - 1) * state_count], &b_scaled[t * state_count], &delta[t * state_count], &psi[t * state_count], state_count);
+			_normalize_delta(t);
+		}
+
+		auto* p_last = &delta[(T - 1) * state_count];
+		path[T - 1]	 = (t_state)(std::max_element(p_last, p_last + state_count) - p_last);
+		for (auto t : std::views::iota(0uz, T - 1) | std::views::reverse)
+		{
+			path[t] = psi[(t + 1) * state_count + path[t + 1]];
+		}
+	}
+
+	// see dyn_model::memory_footprint
+	std::size_t memory_footprint() const
+	{
+		return sizeof(*this) + heap_bytes(A, pi, weight, mean, var, observations, log_comp, log_b, b_scaled, b_shift, alpha, beta, scale, delta, psi, path, At);
+	}
+
+	void print()
+	{
+		std::cout << "A : \n"
+				  << format_table<double64>(A, state_count) << std::endl;
+		std::cout << "weight : \n"
+				  << format_table<double64>(weight, mixture_count) << std::endl;
+		std::cout << "mean : \n"
+				  << format_table<double64>(mean, mixture_count) << std::endl;
+		std::cout << "var : \n"
+				  << format_table<double64>(var, mixture_count) << std::endl;
+		std::cout << "pi : \n"
+				  << format_table<double64>(pi, state_count) << std::endl;
+	}
+
+  private:
+	void _normalize_alpha(std::size_t t, double64 sum)
+	{
+		scale[t] = sum;
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			alpha[t * state_count + state] /= sum;
+		}
+	}
+
+	void _normalize_delta(std::size_t t)
+	{
+		auto* p_row = &delta[t * state_count];
+		auto  max	= *std::max_element(p_row, p_row + state_count);
+		if (max > 0.0)
+		{
+			for (auto state : std::views::iota(0uz, state_count))
+			{
+				p_row[state] /= max;
+			}
+		}
+	}
+};
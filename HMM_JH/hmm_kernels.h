@@ -0,0 +1,622 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <limits>
+#include "common.h"
+#include "model.h"
+
+#if defined(__x86_64__) or defined(_M_X64)
+	#define HMM_KERNEL_X86 1
+	#include <immintrin.h>
+	#if defined(_MSC_VER) and not defined(__clang__)
+		#include <intrin.h>
+	#endif
+#else
+	#define HMM_KERNEL_X86 0
+#endif
+
+// msvc emits any intrinsic without per-function target flags, gcc / clang need them
+#if HMM_KERNEL_X86 and (defined(__GNUC__) or defined(__clang__))
+	#define HMM_TARGET_AVX2	  __attribute__((target("avx2,fma")))
+	#define HMM_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+	#define HMM_TARGET_AVX2
+	#define HMM_TARGET_AVX512
+#endif
+
+// inner loops of forward / backward / viterbi / re-estimation.
+// every kernel is written lane-parallel over the output state, so the rows it reads are contiguous :
+//	forward, viterbi, xi : row i of A (A[i][0..n)), scaled by a scalar from the previous step
+//	backward			 : row j of At (the transposed A, At[j][i] == A[i][j])
+//	emission			 : row o of Bt (the transposed B, Bt[o][s] == B[s][o])
+// the scalar set keeps the summation order of the original loops, the simd sets reassociate (fma),
+// so they agree with it within rounding, viterbi compares exactly and picks the same states.
+namespace kernel
+{
+	enum class isa : uint8
+	{
+		scalar,
+		avx2,
+		avx512,
+	};
+
+	struct kernel_set
+	{
+		isa				 type;
+		std::string_view name;
+
+		// curr[j] = sum_i prev[i] * A[i][j] * b_o[j], returns sum_j curr[j]
+		double64 (*forward_step)(const double64* A, const double64* prev, const double64* b_o, double64* curr, std::size_t n);
+
+		// curr[i] = sum_j At[j][i] * next[j] * b_o[j] * inv_scale
+		void (*backward_step)(const double64* At, const double64* next, const double64* b_o, double64 inv_scale, double64* curr, std::size_t n);
+
+		// curr[j] = max_i prev[i] * A[i][j] * b_o[j], psi[j] = first argmax
+		void (*viterbi_step)(const double64* A, const double64* prev, const double64* b_o, double64* curr, t_state* psi, std::size_t n);
+
+		// max-plus : curr[j] = max_i (prev[i] + log_A[i][j]) + log_b_o[j], psi[j] = first argmax
+		void (*viterbi_step_log)(const double64* log_A, const double64* prev, const double64* log_b_o, double64* curr, t_state* psi, std::size_t n);
+
+		// trans[i][j] += alpha[i] * A[i][j] * next[j] * b_o[j] * inv_scale, xi[t] summed without being stored
+		void (*xi_accumulate)(const double64* A, const double64* alpha, const double64* next, const double64* b_o, double64 inv_scale, double64* trans, std::size_t n);
+
+		// dst[k] += src[k]
+		void (*add)(double64* dst, const double64* src, std::size_t len);
+
+		// dst[k] += x[k] * y[k] * s
+		void (*mul_add)(double64* dst, const double64* x, const double64* y, double64 s, std::size_t len);
+	};
+
+	namespace detail
+	{
+		inline double64 forward_step_scalar(const double64* A, const double64* prev, const double64* b_o, double64* curr, std::size_t n)
+		{
+			for (auto j = 0uz; j < n; ++j)
+			{
+				curr[j] = 0.0;
+			}
+
+			for (auto i = 0uz; i < n; ++i)
+			{
+				auto* p_row = A + i * n;
+				for (auto j = 0uz; j < n; ++j)
+				{
+					curr[j] += prev[i] * p_row[j];
+				}
+			}
+
+			auto sum = 0.0;
+			for (auto j = 0uz; j < n; ++j)
+			{
+				curr[j]	 *= b_o[j];
+				sum		 += curr[j];
+			}
+
+			return sum;
+		}
+
+		inline void backward_step_scalar(const double64* At, const double64* next, const double64* b_o, double64 inv_scale, double64* curr, std::size_t n)
+		{
+			for (auto i = 0uz; i < n; ++i)
+			{
+				curr[i] = 0.0;
+			}
+
+			for (auto j = 0uz; j < n; ++j)
+			{
+				auto  w		= next[j] * b_o[j];
+				auto* p_row = At + j * n;
+				for (auto i = 0uz; i < n; ++i)
+				{
+					curr[i] += p_row[i] * w;
+				}
+			}
+
+			for (auto i = 0uz; i < n; ++i)
+			{
+				curr[i] *= inv_scale;
+			}
+		}
+
+		inline void viterbi_step_scalar(const double64* A, const double64* prev, const double64* b_o, double64* curr, t_state* psi, std::size_t n)
+		{
+			for (auto j = 0uz; j < n; ++j)
+			{
+				curr[j] = 0.0;
+				psi[j]	= 0;
+			}
+
+			for (auto i = 0uz; i < n; ++i)
+			{
+				auto* p_row = A + i * n;
+				for (auto j = 0uz; j < n; ++j)
+				{
+					auto p = prev[i] * p_row[j];
+					if (p > curr[j])
+					{
+						curr[j] = p;
+						psi[j]	= (t_state)i;
+					}
+				}
+			}
+
+			for (auto j = 0uz; j < n; ++j)
+			{
+				curr[j] *= b_o[j];
+			}
+		}
+
+		inline void viterbi_step_log_scalar(const double64* log_A, const double64* prev, const double64* log_b_o, double64* curr, t_state* psi, std::size_t n)
+		{
+			for (auto j = 0uz; j < n; ++j)
+			{
+				curr[j] = -std::numeric_limits<double64>::infinity();
+				psi[j]	= 0;
+			}
+
+			for (auto i = 0uz; i < n; ++i)
+			{
+				auto* p_row = log_A + i * n;
+				for (auto j = 0uz; j < n; ++j)
+				{
+					auto p = prev[i] + p_row[j];
+					if (p > curr[j])
+					{
+						curr[j] = p;
+						psi[j]	= (t_state)i;
+					}
+				}
+			}
+
+			for (auto j = 0uz; j < n; ++j)
+			{
+				curr[j] += log_b_o[j];
+			}
+		}
+
+		inline void xi_accumulate_scalar(const double64* A, const double64* alpha, const double64* next, const double64* b_o, double64 inv_scale, double64* trans, std::size_t n)
+		{
+			for (auto i = 0uz; i < n; ++i)
+			{
+				for (auto j = 0uz; j < n; ++j)
+				{
+					trans[i * n + j] += alpha[i] * A[i * n + j] * b_o[j] * next[j] * inv_scale;
+				}
+			}
+		}
+
+		inline void add_scalar(double64* dst, const double64* src, std::size_t len)
+		{
+			for (auto k = 0uz; k < len; ++k)
+			{
+				dst[k] += src[k];
+			}
+		}
+
+		inline void mul_add_scalar(double64* dst, const double64* x, const double64* y, double64 s, std::size_t len)
+		{
+			for (auto k = 0uz; k < len; ++k)
+			{
+				dst[k] += x[k] * y[k] * s;
+			}
+		}
+
+#if HMM_KERNEL_X86
+		HMM_TARGET_AVX2 inline double64 hsum(__m256d v)
+		{
+			auto lo = _mm256_castpd256_pd128(v);
+			auto hi = _mm256_extractf128_pd(v, 1);
+			lo		= _mm_add_pd(lo, hi);
+			lo		= _mm_add_sd(lo, _mm_unpackhi_pd(lo, lo));
+			return _mm_cvtsd_f64(lo);
+		}
+
+		HMM_TARGET_AVX2 inline double64 forward_step_avx2(const double64* A, const double64* prev, const double64* b_o, double64* curr, std::size_t n)
+		{
+			auto n4 = n & ~3uz;
+			for (auto j = 0uz; j < n4; j += 4)
+			{
+				auto acc = _mm256_setzero_pd();
+				for (auto i = 0uz; i < n; ++i)
+				{
+					acc = _mm256_fmadd_pd(_mm256_set1_pd(prev[i]), _mm256_loadu_pd(A + i * n + j), acc);
+				}
+				_mm256_storeu_pd(curr + j, _mm256_mul_pd(acc, _mm256_loadu_pd(b_o + j)));
+			}
+
+			for (auto j = n4; j < n; ++j)
+			{
+				auto acc = 0.0;
+				for (auto i = 0uz; i < n; ++i)
+				{
+					acc += prev[i] * A[i * n + j];
+				}
+				curr[j] = acc * b_o[j];
+			}
+
+			auto sum = _mm256_setzero_pd();
+			for (auto j = 0uz; j < n4; j += 4)
+			{
+				sum = _mm256_add_pd(sum, _mm256_loadu_pd(curr + j));
+			}
+
+			auto res = hsum(sum);
+			for (auto j = n4; j < n; ++j)
+			{
+				res += curr[j];
+			}
+
+			return res;
+		}
+
+		HMM_TARGET_AVX2 inline void backward_step_avx2(const double64* At, const double64* next, const double64* b_o, double64 inv_scale, double64* curr, std::size_t n)
+		{
+			auto n4 = n & ~3uz;
+			for (auto i = 0uz; i < n4; i += 4)
+			{
+				auto acc = _mm256_setzero_pd();
+				for (auto j = 0uz; j < n; ++j)
+				{
+					acc = _mm256_fmadd_pd(_mm256_set1_pd(next[j] * b_o[j]), _mm256_loadu_pd(At + j * n + i), acc);
+				}
+				_mm256_storeu_pd(curr + i, _mm256_mul_pd(acc, _mm256_set1_pd(inv_scale)));
+			}
+
+			for (auto i = n4; i < n; ++i)
+			{
+				auto acc = 0.0;
+				for (auto j = 0uz; j < n; ++j)
+				{
+					acc += At[j * n + i] * next[j] * b_o[j];
+				}
+				curr[i] = acc * inv_scale;
+			}
+		}
+
+		HMM_TARGET_AVX2 inline void viterbi_step_avx2(const double64* A, const double64* prev, const double64* b_o, double64* curr, t_state* psi, std::size_t n)
+		{
+			auto n4 = n & ~3uz;
+			for (auto j = 0uz; j < n4; j += 4)
+			{
+				auto best = _mm256_setzero_pd();
+				auto idx  = _mm256_setzero_pd();
+				for (auto i = 0uz; i < n; ++i)
+				{
+					auto p	  = _mm256_mul_pd(_mm256_set1_pd(prev[i]), _mm256_loadu_pd(A + i * n + j));
+					auto mask = _mm256_cmp_pd(p, best, _CMP_GT_OQ);
+					best	  = _mm256_blendv_pd(best, p, mask);
+					idx		  = _mm256_blendv_pd(idx, _mm256_set1_pd((double64)i), mask);
+				}
+				_mm256_storeu_pd(curr + j, _mm256_mul_pd(best, _mm256_loadu_pd(b_o + j)));
+
+				alignas(32) double64 idx_buf[4];
+				_mm256_store_pd(idx_buf, idx);
+				for (auto k = 0uz; k < 4; ++k)
+				{
+					psi[j + k] = (t_state)idx_buf[k];
+				}
+			}
+
+			for (auto j = n4; j < n; ++j)
+			{
+				auto max_prob  = 0.0;
+				auto max_state = 0uz;
+				for (auto i = 0uz; i < n; ++i)
+				{
+					auto p = prev[i] * A[i * n + j];
+					if (p > max_prob)
+					{
+						max_prob  = p;
+						max_state = i;
+					}
+				}
+				curr[j] = max_prob * b_o[j];
+				psi[j]	= (t_state)max_state;
+			}
+		}
+
+		HMM_TARGET_AVX2 inline void viterbi_step_log_avx2(const double64* log_A, const double64* prev, const double64* log_b_o, double64* curr, t_state* psi, std::size_t n)
+		{
+			auto n4 = n & ~3uz;
+			for (auto j = 0uz; j < n4; j += 4)
+			{
+				auto best = _mm256_set1_pd(-std::numeric_limits<double64>::infinity());
+				auto idx  = _mm256_setzero_pd();
+				for (auto i = 0uz; i < n; ++i)
+				{
+					auto p	  = _mm256_add_pd(_mm256_set1_pd(prev[i]), _mm256_loadu_pd(log_A + i * n + j));
+					auto mask = _mm256_cmp_pd(p, best, _CMP_GT_OQ);
+					best	  = _mm256_blendv_pd(best, p, mask);
+					idx		  = _mm256_blendv_pd(idx, _mm256_set1_pd((double64)i), mask);
+				}
+				_mm256_storeu_pd(curr + j, _mm256_add_pd(best, _mm256_loadu_pd(log_b_o + j)));
+
+				alignas(32) double64 idx_buf[4];
+				_mm256_store_pd(idx_buf, idx);
+				for (auto k = 0uz; k < 4; ++k)
+				{
+					psi[j + k] = (t_state)idx_buf[k];
+				}
+			}
+
+			for (auto j = n4; j < n; ++j)
+			{
+				auto max_prob  = -std::numeric_limits<double64>::infinity();
+				auto max_state = 0uz;
+				for (auto i = 0uz; i < n; ++i)
+				{
+					auto p = prev[i] + log_A[i * n + j];
+					if (p > max_prob)
+					{
+						max_prob  = p;
+						max_state = i;
+					}
+				}
+				curr[j] = max_prob + log_b_o[j];
+				psi[j]	= (t_state)max_state;
+			}
+		}
+
+		HMM_TARGET_AVX2 inline void xi_accumulate_avx2(const double64* A, const double64* alpha, const double64* next, const double64* b_o, double64 inv_scale, double64* trans, std::size_t n)
+		{
+			auto n4 = n & ~3uz;
+			for (auto i = 0uz; i < n; ++i)
+			{
+				auto a_i = _mm256_set1_pd(alpha[i] * inv_scale);
+				for (auto j = 0uz; j < n4; j += 4)
+				{
+					auto w = _mm256_mul_pd(_mm256_loadu_pd(next + j), _mm256_loadu_pd(b_o + j));
+					_mm256_storeu_pd(trans + i * n + j, _mm256_fmadd_pd(_mm256_mul_pd(a_i, _mm256_loadu_pd(A + i * n + j)), w, _mm256_loadu_pd(trans + i * n + j)));
+				}
+
+				for (auto j = n4; j < n; ++j)
+				{
+					trans[i * n + j] += alpha[i] * inv_scale * A[i * n + j] * next[j] * b_o[j];
+				}
+			}
+		}
+
+		HMM_TARGET_AVX2 inline void add_avx2(double64* dst, const double64* src, std::size_t len)
+		{
+			auto k = 0uz;
+			for (; k + 4 <= len; k += 4)
+			{
+				_mm256_storeu_pd(dst + k, _mm256_add_pd(_mm256_loadu_pd(dst + k), _mm256_loadu_pd(src + k)));
+			}
+
+			for (; k < len; ++k)
+			{
+				dst[k] += src[k];
+			}
+		}
+
+		HMM_TARGET_AVX2 inline void mul_add_avx2(double64* dst, const double64* x, const double64* y, double64 s, std::size_t len)
+		{
+			auto k = 0uz;
+			for (; k + 4 <= len; k += 4)
+			{
+				auto xy = _mm256_mul_pd(_mm256_loadu_pd(x + k), _mm256_loadu_pd(y + k));
+				_mm256_storeu_pd(dst + k, _mm256_fmadd_pd(xy, _mm256_set1_pd(s), _mm256_loadu_pd(dst + k)));
+			}
+
+			for (; k < len; ++k)
+			{
+				dst[k] += x[k] * y[k] * s;
+			}
+		}
+
+		HMM_TARGET_AVX512 inline __mmask8 tail_mask(std::size_t remain)
+		{
+			return remain >= 8 ? (__mmask8)0xff : (__mmask8)((1u << remain) - 1);
+		}
+
+		HMM_TARGET_AVX512 inline double64 forward_step_avx512(const double64* A, const double64* prev, const double64* b_o, double64* curr, std::size_t n)
+		{
+			auto sum = _mm512_setzero_pd();
+			for (auto j = 0uz; j < n; j += 8)
+			{
+				auto mask = tail_mask(n - j);
+				auto acc  = _mm512_setzero_pd();
+				for (auto i = 0uz; i < n; ++i)
+				{
+					acc = _mm512_fmadd_pd(_mm512_set1_pd(prev[i]), _mm512_maskz_loadu_pd(mask, A + i * n + j), acc);
+				}
+				acc = _mm512_mul_pd(acc, _mm512_maskz_loadu_pd(mask, b_o + j));
+				_mm512_mask_storeu_pd(curr + j, mask, acc);
+				sum = _mm512_add_pd(sum, acc);
+			}
+
+			return _mm512_reduce_add_pd(sum);
+		}
+
+		HMM_TARGET_AVX512 inline void backward_step_avx512(const double64* At, const double64* next, const double64* b_o, double64 inv_scale, double64* curr, std::size_t n)
+		{
+			for (auto i = 0uz; i < n; i += 8)
+			{
+				auto mask = tail_mask(n - i);
+				auto acc  = _mm512_setzero_pd();
+				for (auto j = 0uz; j < n; ++j)
+				{
+					acc = _mm512_fmadd_pd(_mm512_set1_pd(next[j] * b_o[j]), _mm512_maskz_loadu_pd(mask, At + j * n + i), acc);
+				}
+				_mm512_mask_storeu_pd(curr + i, mask, _mm512_mul_pd(acc, _mm512_set1_pd(inv_scale)));
+			}
+		}
+
+		HMM_TARGET_AVX512 inline void viterbi_step_avx512(const double64* A, const double64* prev, const double64* b_o, double64* curr, t_state* psi, std::size_t n)
+		{
+			for (auto j = 0uz; j < n; j += 8)
+			{
+				auto mask = tail_mask(n - j);
+				auto best = _mm512_setzero_pd();
+				auto idx  = _mm512_setzero_si512();
+				for (auto i = 0uz; i < n; ++i)
+				{
+					auto p	= _mm512_mul_pd(_mm512_set1_pd(prev[i]), _mm512_maskz_loadu_pd(mask, A + i * n + j));
+					auto gt = _mm512_cmp_pd_mask(p, best, _CMP_GT_OQ);
+					best	= _mm512_mask_mov_pd(best, gt, p);
+					idx		= _mm512_mask_mov_epi64(idx, gt, _mm512_set1_epi64((int64)i));
+				}
+				_mm512_mask_storeu_pd(curr + j, mask, _mm512_mul_pd(best, _mm512_maskz_loadu_pd(mask, b_o + j)));
+
+				alignas(64) int64 idx_buf[8];
+				_mm512_store_si512(idx_buf, idx);
+				for (auto k = 0uz; k < 8 and j + k < n; ++k)
+				{
+					psi[j + k] = (t_state)idx_buf[k];
+				}
+			}
+		}
+
+		HMM_TARGET_AVX512 inline void viterbi_step_log_avx512(const double64* log_A, const double64* prev, const double64* log_b_o, double64* curr, t_state* psi, std::size_t n)
+		{
+			for (auto j = 0uz; j < n; j += 8)
+			{
+				auto mask = tail_mask(n - j);
+				auto best = _mm512_set1_pd(-std::numeric_limits<double64>::infinity());
+				auto idx  = _mm512_setzero_si512();
+				for (auto i = 0uz; i < n; ++i)
+				{
+					auto p	= _mm512_add_pd(_mm512_set1_pd(prev[i]), _mm512_maskz_loadu_pd(mask, log_A + i * n + j));
+					auto gt = _mm512_cmp_pd_mask(p, best, _CMP_GT_OQ);
+					best	= _mm512_mask_mov_pd(best, gt, p);
+					idx		= _mm512_mask_mov_epi64(idx, gt, _mm512_set1_epi64((int64)i));
+				}
+				_mm512_mask_storeu_pd(curr + j, mask, _mm512_add_pd(best, _mm512_maskz_loadu_pd(mask, log_b_o + j)));
+
+				alignas(64) int64 idx_buf[8];
+				_mm512_store_si512(idx_buf, idx);
+				for (auto k = 0uz; k < 8 and j + k < n; ++k)
+				{
+					psi[j + k] = (t_state)idx_buf[k];
+				}
+			}
+		}
+
+		HMM_TARGET_AVX512 inline void xi_accumulate_avx512(const double64* A, const double64* alpha, const double64* next, const double64* b_o, double64 inv_scale, double64* trans, std::size_t n)
+		{
+			for (auto i = 0uz; i < n; ++i)
+			{
+				auto a_i = _mm512_set1_pd(alpha[i] * inv_scale);
+				for (auto j = 0uz; j < n; j += 8)
+				{
+					auto mask = tail_mask(n - j);
+					auto w	  = _mm512_mul_pd(_mm512_maskz_loadu_pd(mask, next + j), _mm512_maskz_loadu_pd(mask, b_o + j));
+					auto a_ij = _mm512_mul_pd(a_i, _mm512_maskz_loadu_pd(mask, A + i * n + j));
+					_mm512_mask_storeu_pd(trans + i * n + j, mask, _mm512_fmadd_pd(a_ij, w, _mm512_maskz_loadu_pd(mask, trans + i * n + j)));
+				}
+			}
+		}
+
+		HMM_TARGET_AVX512 inline void add_avx512(double64* dst, const double64* src, std::size_t len)
+		{
+			for (auto k = 0uz; k < len; k += 8)
+			{
+				auto mask = tail_mask(len - k);
+				_mm512_mask_storeu_pd(dst + k, mask, _mm512_add_pd(_mm512_maskz_loadu_pd(mask, dst + k), _mm512_maskz_loadu_pd(mask, src + k)));
+			}
+		}
+
+		HMM_TARGET_AVX512 inline void mul_add_avx512(double64* dst, const double64* x, const double64* y, double64 s, std::size_t len)
+		{
+			for (auto k = 0uz; k < len; k += 8)
+			{
+				auto mask = tail_mask(len - k);
+				auto xy	  = _mm512_mul_pd(_mm512_maskz_loadu_pd(mask, x + k), _mm512_maskz_loadu_pd(mask, y + k));
+				_mm512_mask_storeu_pd(dst + k, mask, _mm512_fmadd_pd(xy, _mm512_set1_pd(s), _mm512_maskz_loadu_pd(mask, dst + k)));
+			}
+		}
+#endif
+
+		inline bool cpu_supports(isa type)
+		{
+#if HMM_KERNEL_X86
+	#if defined(__GNUC__) or defined(__clang__)
+			switch (type)
+			{
+			case isa::avx2:
+				return __builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma");
+			case isa::avx512:
+				return __builtin_cpu_supports("avx512f");
+			default:
+				return true;
+			}
+	#else
+			int32 info[4];
+			__cpuid(info, 1);
+			auto os_ymm = (info[2] & (1 << 27)) != 0 and (_xgetbv(0) & 0x06) == 0x06;
+			auto fma	= (info[2] & (1 << 12)) != 0;
+			__cpuidex(info, 7, 0);
+			switch (type)
+			{
+			case isa::avx2:
+				return os_ymm and fma and (info[1] & (1 << 5)) != 0;
+			case isa::avx512:
+				return os_ymm and (_xgetbv(0) & 0xe6) == 0xe6 and (info[1] & (1 << 16)) != 0;
+			default:
+				return true;
+			}
+	#endif
+#else
+			return type == isa::scalar;
+#endif
+		}
+	}	 // namespace detail
+
+	inline constexpr kernel_set scalar_set {
+		isa::scalar, "scalar",
+		detail::forward_step_scalar, detail::backward_step_scalar, detail::viterbi_step_scalar, detail::viterbi_step_log_scalar, detail::xi_accumulate_scalar, detail::add_scalar, detail::mul_add_scalar
+	};
+
+#if HMM_KERNEL_X86
+	inline constexpr kernel_set avx2_set {
+		isa::avx2, "avx2",
+		detail::forward_step_avx2, detail::backward_step_avx2, detail::viterbi_step_avx2, detail::viterbi_step_log_avx2, detail::xi_accumulate_avx2, detail::add_avx2, detail::mul_add_avx2
+	};
+
+	inline constexpr kernel_set avx512_set {
+		isa::avx512, "avx512",
+		detail::forward_step_avx512, detail::backward_step_avx512, detail::viterbi_step_avx512, detail::viterbi_step_log_avx512, detail::xi_accumulate_avx512, detail::add_avx512, detail::mul_add_avx512
+	};
+#endif
+
+	// kernel set for a given instruction set, nullptr if this cpu can not run it
+	inline const kernel_set* find(isa type)
+	{
+		if (not detail::cpu_supports(type))
+		{
+			return nullptr;
+		}
+
+		switch (type)
+		{
+#if HMM_KERNEL_X86
+		case isa::avx2:
+			return &avx2_set;
+		case isa::avx512:
+			return &avx512_set;
+#endif
+		case isa::scalar:
+			return &scalar_set;
+		default:
+			return nullptr;
+		}
+	}
+
+	// widest kernel set this cpu supports, resolved once
+	inline const kernel_set& best()
+	{
+		static const auto* p_best = []() {
+			for (auto type : { isa::avx512, isa::avx2 })
+			{
+				if (auto* p_set = find(type); p_set != nullptr)
+				{
+					return p_set;
+				}
+			}
+			return &scalar_set;
+		}();
+
+		return *p_best;
+	}
+}	 // namespace kernel
@@ -0,0 +1,535 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <ranges>
+#include <algorithm>
+#include <string>
+#include <fstream>
+#include <format>
+#include <cmath>
+#include <cassert>
+#include "common.h"
+#include "nn_kernels.h"
+#include "thread_pool.h"
+
+// lstm / dense inference for LSTM/lstm_delay.ipynb : LSTM(50) over a window of 10 min-max scaled delays, then Dense(1).
+// weights come from the export cell of the notebook (keras layout), any stack of lstm layers followed by dense layers loads.
+//
+// weight file, whitespace separated :
+//	lstm_delay 1
+//	scaler <data_min> <data_max>
+//	window <window_size> <feature_count>
+//	lstm <input_count> <unit_count> <return_sequences>
+//	<kernel [input_count][4 * unit_count]> <recurrent_kernel [unit_count][4 * unit_count]> <bias [4 * unit_count]>
+//	dense <input_count> <output_count> <linear | relu | tanh | sigmoid>
+//	<kernel [input_count][output_count]> <bias [output_count]>
+
+enum class activation
+{
+	linear,
+	relu,
+	tanh,
+	sigmoid,
+};
+
+// y = W x + bias, W [row_count][col_count] so one output is one contiguous row
+struct dense_weights
+{
+	std::size_t row_count = 0;
+	std::size_t col_count = 0;
+
+	std::vector<float32> w;
+	std::vector<float32> bias;
+
+	// after quantize() : w[r][k] ~ q[r][k] * scale[r], symmetric per row
+	std::vector<int8>	 q;
+	std::vector<float32> scale;
+	bool				 quantized = false;
+
+	dense_weights() = default;
+	dense_weights(std::size_t row_count, std::size_t col_count) : row_count(row_count), col_count(col_count), w(row_count * col_count), bias(row_count) { }
+
+	void quantize()
+	{
+		q.resize(w.size());
+		scale.resize(row_count);
+		for (auto row : std::views::iota(0uz, row_count))
+		{
+			auto* p_row = &w[row * col_count];
+			auto  max	= 0.0f;
+			for (auto k : std::views::iota(0uz, col_count))
+			{
+				max = std::max(max, std::abs(p_row[k]));
+			}
+
+			scale[row]	   = max > 0.0f ? max / 127.0f : 1.0f;
+			auto inv_scale = 1.0f / scale[row];
+			for (auto k : std::views::iota(0uz, col_count))
+			{
+				q[row * col_count + k] = (int8)std::lround(p_row[k] * inv_scale);
+			}
+		}
+		quantized = true;
+	}
+
+	// float32 rows for the batched product : w itself, or the int8 rows expanded into scratch.
+	// predict() expands a layer once per call and reuses it for every time step and every client
+	const float32* expanded(std::vector<float32>& scratch) const
+	{
+		if (not quantized)
+		{
+			return w.data();
+		}
+
+		scratch.resize(q.size());
+		for (auto row : std::views::iota(0uz, row_count))
+		{
+			for (auto k : std::views::iota(0uz, col_count))
+			{
+				scratch[row * col_count + k] = (float32)q[row * col_count + k] * scale[row];
+			}
+		}
+		return scratch.data();
+	}
+
+	// y[r][l] = W x[.][l] + bias[r] for every lane (client) l, x [col_count][lane_count], y [row_count][lane_count].
+	// p_expanded is what expanded() returned, a single lane reads w or q directly
+	void apply(const nn_kernel::kernel_set& kernels, const float32* p_expanded, const float32* x, std::size_t lane_count, float32* y) const
+	{
+		if (lane_count > 1)
+		{
+			kernels.gemm_f32(p_expanded, bias.data(), row_count, col_count, x, y, lane_count);
+			return;
+		}
+
+		for (auto row : std::views::iota(0uz, row_count))
+		{
+			y[row] = (quantized ? kernels.dot_i8(&q[row * col_count], x, col_count) * scale[row] : kernels.dot_f32(&w[row * col_count], x, col_count)) + bias[row];
+		}
+	}
+};
+
+struct lstm_layer
+{
+	std::size_t input_count;
+	std::size_t unit_count;
+	bool		return_sequences;
+	// rows [4 * unit_count] in keras gate order (input, forget, cell, output), cols [x_t ; h_t-1]
+	dense_weights gates;
+};
+
+struct dense_layer
+{
+	dense_weights weights;
+	activation	  act;
+};
+
+// scratch of one predict() caller, one per thread. everything is feature major, [feature][client]
+struct lstm_workspace
+{
+	// [t][feature][client]
+	std::vector<float32> seq;
+	std::vector<float32> seq_next;
+	// [input_count + unit_count][client], the input of time t followed by h of time t - 1
+	std::vector<float32> xh;
+	// [4 * unit_count][client]
+	std::vector<float32> gates;
+	// [unit_count][client]
+	std::vector<float32> cell;
+	std::vector<float32> features;
+	std::vector<float32> features_next;
+	// int8 weights of the current layer expanded to float32
+	std::vector<float32> dequantized;
+	// predict_next in / out
+	std::vector<float32> scaled;
+	std::vector<float32> predicted;
+};
+
+struct lstm_model
+{
+	std::size_t window_size	  = 0;
+	std::size_t feature_count = 1;
+	// MinMaxScaler of the notebook, delay -> (delay - scale_min) / (scale_max - scale_min)
+	double64	scale_min	  = 0.0;
+	double64	scale_max	  = 1.0;
+
+	std::vector<lstm_layer>	 lstm_layers;
+	std::vector<dense_layer> dense_layers;
+
+	const nn_kernel::kernel_set* p_kernels = &nn_kernel::best();
+
+	std::size_t output_count() const
+	{
+		if (not dense_layers.empty())
+		{
+			return dense_layers.back().weights.row_count;
+		}
+		return lstm_layers.empty() ? feature_count : lstm_layers.back().unit_count;
+	}
+
+	// int8 weights everywhere, about 4x less weight memory per model
+	void quantize()
+	{
+		for (auto& layer : lstm_layers)
+		{
+			layer.gates.quantize();
+		}
+		for (auto& layer : dense_layers)
+		{
+			layer.weights.quantize();
+		}
+	}
+
+	// inputs [batch_count][window_size][feature_count], already scaled, into outputs [batch_count][output_count()]
+	// clients are the simd lanes of the batched product, taken max_lanes at a time so the activations of a tile stay in L1 / L2.
+	// below 8 of them each one runs alone as a row by row dot product
+	void predict(std::span<const float32> inputs, std::size_t batch_count, std::span<float32> outputs, lstm_workspace& ws) const
+	{
+		constexpr auto max_lanes = 64uz;
+		assert(inputs.size() >= batch_count * window_size * feature_count and outputs.size() >= batch_count * output_count());
+		if (batch_count > max_lanes or (batch_count > 1 and batch_count < 8))
+		{
+			auto in_size  = window_size * feature_count;
+			auto out_size = output_count();
+			auto tile	  = batch_count > max_lanes ? max_lanes : 1uz;
+			for (auto first = 0uz; first < batch_count; first += tile)
+			{
+				auto count = std::min(tile, batch_count - first);
+				predict(inputs.subspan(first * in_size, count * in_size), count, outputs.subspan(first * out_size, count * out_size), ws);
+			}
+			return;
+		}
+
+		auto& kernels = *p_kernels;
+		auto  lanes	  = batch_count;
+
+		// [b][t][f] -> [t][f][b]
+		ws.seq.resize(window_size * feature_count * lanes);
+		for (auto b : std::views::iota(0uz, lanes))
+		{
+			for (auto idx : std::views::iota(0uz, window_size * feature_count))
+			{
+				ws.seq[idx * lanes + b] = inputs[b * window_size * feature_count + idx];
+			}
+		}
+
+		auto seq_width	  = feature_count;
+		auto seq_length	  = window_size;
+		auto feature_size = window_size * feature_count;
+		for (auto& layer : lstm_layers)
+		{
+			auto in	   = layer.input_count;
+			auto units = layer.unit_count;
+			assert(in == seq_width);
+
+			ws.xh.assign((in + units) * lanes, 0.0f);
+			ws.gates.resize(4 * units * lanes);
+			ws.cell.assign(units * lanes, 0.0f);
+			if (layer.return_sequences)
+			{
+				ws.seq_next.resize(seq_length * units * lanes);
+			}
+
+			auto* p_h = &ws.xh[in * lanes];
+			auto* p_w = lanes > 1 ? layer.gates.expanded(ws.dequantized) : nullptr;
+			for (auto t : std::views::iota(0uz, seq_length))
+			{
+				std::copy_n(&ws.seq[t * in * lanes], in * lanes, ws.xh.begin());
+				layer.gates.apply(kernels, p_w, ws.xh.data(), lanes, ws.gates.data());
+				kernels.lstm_cell(ws.gates.data(), ws.cell.data(), p_h, units * lanes);
+
+				if (layer.return_sequences)
+				{
+					std::copy_n(p_h, units * lanes, &ws.seq_next[t * units * lanes]);
+				}
+			}
+
+			if (layer.return_sequences)
+			{
+				std::swap(ws.seq, ws.seq_next);
+			}
+			else
+			{
+				// the last hidden state is a sequence of length 1 for whatever comes next
+				ws.seq.assign(p_h, p_h + units * lanes);
+				seq_length = 1;
+			}
+			seq_width	 = units;
+			feature_size = seq_length * units;
+		}
+
+		// [t][unit] flattened in keras order
+		ws.features.assign(ws.seq.begin(), ws.seq.begin() + (std::ptrdiff_t)(feature_size * lanes));
+		for (auto& layer : dense_layers)
+		{
+			auto& weights = layer.weights;
+			assert(weights.col_count == feature_size);
+			ws.features_next.resize(weights.row_count * lanes);
+			weights.apply(kernels, lanes > 1 ? weights.expanded(ws.dequantized) : nullptr, ws.features.data(), lanes, ws.features_next.data());
+
+			for (auto& val : ws.features_next)
+			{
+				switch (layer.act)
+				{
+				case activation::relu:
+					val = std::max(val, 0.0f);
+					break;
+				case activation::tanh:
+					val = nn_kernel::fast_tanh(val);
+					break;
+				case activation::sigmoid:
+					val = nn_kernel::fast_sigmoid(val);
+					break;
+				default:
+					break;
+				}
+			}
+
+			std::swap(ws.features, ws.features_next);
+			feature_size = weights.row_count;
+		}
+
+		for (auto b : std::views::iota(0uz, lanes))
+		{
+			for (auto o : std::views::iota(0uz, feature_size))
+			{
+				outputs[b * feature_size + o] = ws.features[o * lanes + b];
+			}
+		}
+	}
+
+	// same as predict(), tiles of the batch spread over the pool, one workspace per worker
+	void predict(thread_pool& pool, std::span<const float32> inputs, std::size_t batch_count, std::span<float32> outputs, std::vector<lstm_workspace>& workspaces) const
+	{
+		constexpr auto tile = 256uz;
+		workspaces.resize(pool.size());
+		auto in_size  = window_size * feature_count;
+		auto out_size = output_count();
+		pool.parallel_for((batch_count + tile - 1) / tile, [&](std::size_t idx, std::size_t worker_idx) {
+			auto first = idx * tile;
+			auto count = std::min(tile, batch_count - first);
+			predict(inputs.subspan(first * in_size, count * in_size), count, outputs.subspan(first * out_size, count * out_size), workspaces[worker_idx]);
+		});
+	}
+
+	// raw delays, windows [batch_count][window_size] oldest first, into the predicted next delay of every window
+	void predict_next(std::span<const double64> windows, std::span<double64> out, lstm_workspace& ws) const
+	{
+		assert(feature_count == 1 and output_count() == 1);
+		auto batch_count = windows.size() / window_size;
+		auto range		 = scale_max - scale_min;
+		auto inv_range	 = range > 0.0 ? 1.0 / range : 0.0;
+
+		ws.scaled.resize(windows.size());
+		for (auto idx : std::views::iota(0uz, windows.size()))
+		{
+			ws.scaled[idx] = (float32)((windows[idx] - scale_min) * inv_range);
+		}
+
+		ws.predicted.resize(batch_count);
+		predict(ws.scaled, batch_count, ws.predicted, ws);
+		for (auto b : std::views::iota(0uz, batch_count))
+		{
+			out[b] = (double64)ws.predicted[b] * range + scale_min;
+		}
+	}
+
+	bool save(const std::string& path) const
+	{
+		std::ofstream file(path);
+		if (not file.is_open())
+		{
+			return false;
+		}
+
+		auto write_values = [&file](std::span<const float32> values) {
+			for (auto idx : std::views::iota(0uz, values.size()))
+			{
+				file << std::format("{:.9g}", values[idx]) << (idx + 1 == values.size() ? '\n' : ' ');
+			}
+		};
+
+		file << "lstm_delay 1\n";
+		file << std::format("scaler {:.17g} {:.17g}\n", scale_min, scale_max);
+		file << "window " << window_size << ' ' << feature_count << '\n';
+		for (auto& layer : lstm_layers)
+		{
+			auto in	   = layer.input_count;
+			auto units = layer.unit_count;
+			auto cols  = in + units;
+			file << "lstm " << in << ' ' << units << ' ' << (layer.return_sequences ? 1 : 0) << '\n';
+
+			// back to keras [input][gate] and [unit][gate]
+			auto kernel	   = std::vector<float32>(in * 4 * units);
+			auto recurrent = std::vector<float32>(units * 4 * units);
+			for (auto gate : std::views::iota(0uz, 4 * units))
+			{
+				for (auto k : std::views::iota(0uz, in))
+				{
+					kernel[k * 4 * units + gate] = layer.gates.w[gate * cols + k];
+				}
+				for (auto k : std::views::iota(0uz, units))
+				{
+					recurrent[k * 4 * units + gate] = layer.gates.w[gate * cols + in + k];
+				}
+			}
+			write_values(kernel);
+			write_values(recurrent);
+			write_values(layer.gates.bias);
+		}
+
+		constexpr const char* activation_names[] = { "linear", "relu", "tanh", "sigmoid" };
+		for (auto& layer : dense_layers)
+		{
+			auto& weights = layer.weights;
+			file << "dense " << weights.col_count << ' ' << weights.row_count << ' ' << activation_names[(std::size_t)layer.act] << '\n';
+
+			auto kernel = std::vector<float32>(weights.w.size());
+			for (auto row : std::views::iota(0uz, weights.row_count))
+			{
+				for (auto k : std::views::iota(0uz, weights.col_count))
+				{
+					kernel[k * weights.row_count + row] = weights.w[row * weights.col_count + k];
+				}
+			}
+			write_values(kernel);
+			write_values(weights.bias);
+		}
+
+		return file.good();
+	}
+
+	// replaces this model with the one exported at path, float32 weights. every layer has to take what the one before it
+	// gives, predict() only asserts that
+	bool load(const std::string& path)
+	{
+		std::ifstream file(path);
+		if (not file.is_open())
+		{
+			return false;
+		}
+
+		auto tag	 = std::string {};
+		auto version = 0;
+		if (not(file >> tag >> version) or tag != "lstm_delay" or version != 1)
+		{
+			return false;
+		}
+
+		auto res = lstm_model {};
+		if (not(file >> tag >> res.scale_min >> res.scale_max) or tag != "scaler")
+		{
+			return false;
+		}
+		if (not(file >> tag >> res.window_size >> res.feature_count) or tag != "window" or res.window_size == 0 or res.feature_count == 0)
+		{
+			return false;
+		}
+
+		// what the next layer gets : a sequence of seq_length steps of seq_width, flattened for a dense layer
+		auto seq_width	  = res.feature_count;
+		auto seq_length	  = res.window_size;
+		auto feature_size = seq_length * seq_width;
+
+		auto read_values = [&file](std::span<float32> values) {
+			for (auto& val : values)
+			{
+				if (not(file >> val))
+				{
+					return false;
+				}
+			}
+			return true;
+		};
+
+		while (file >> tag)
+		{
+			if (tag == "lstm")
+			{
+				auto in		   = 0uz;
+				auto units	   = 0uz;
+				auto sequences = 0;
+				if (not(file >> in >> units >> sequences) or in != seq_width or units == 0 or not res.dense_layers.empty())
+				{
+					return false;
+				}
+				seq_width	 = units;
+				seq_length	 = sequences != 0 ? seq_length : 1;
+				feature_size = seq_length * seq_width;
+
+				auto kernel	   = std::vector<float32>(in * 4 * units);
+				auto recurrent = std::vector<float32>(units * 4 * units);
+				auto layer	   = lstm_layer { in, units, sequences != 0, dense_weights(4 * units, in + units) };
+				if (not read_values(kernel) or not read_values(recurrent) or not read_values(layer.gates.bias))
+				{
+					return false;
+				}
+
+				for (auto gate : std::views::iota(0uz, 4 * units))
+				{
+					for (auto k : std::views::iota(0uz, in))
+					{
+						layer.gates.w[gate * (in + units) + k] = kernel[k * 4 * units + gate];
+					}
+					for (auto k : std::views::iota(0uz, units))
+					{
+						layer.gates.w[gate * (in + units) + in + k] = recurrent[k * 4 * units + gate];
+					}
+				}
+				res.lstm_layers.push_back(std::move(layer));
+			}
+			else if (tag == "dense")
+			{
+				auto in	  = 0uz;
+				auto out  = 0uz;
+				auto name = std::string {};
+				if (not(file >> in >> out >> name) or in != feature_size or out == 0)
+				{
+					return false;
+				}
+				feature_size = out;
+
+				auto layer = dense_layer { dense_weights(out, in), activation::linear };
+				if (name == "relu")
+				{
+					layer.act = activation::relu;
+				}
+				else if (name == "tanh")
+				{
+					layer.act = activation::tanh;
+				}
+				else if (name == "sigmoid")
+				{
+					layer.act = activation::sigmoid;
+				}
+				else if (name != "linear")
+				{
+					return false;
+				}
+
+				auto kernel = std::vector<float32>(in * out);
+				if (not read_values(kernel) or not read_values(layer.weights.bias))
+				{
+					return false;
+				}
+
+				for (auto row : std::views::iota(0uz, out))
+				{
+					for (auto k : std::views::iota(0uz, in))
+					{
+						layer.weights.w[row * in + k] = kernel[k * out + row];
+					}
+				}
+				res.dense_layers.push_back(std::move(layer));
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		res.p_kernels = p_kernels;
+		*this		  = std::move(res);
+		return true;
+	}
+};
@@ -1,444 +1,246 @@
 #include <iostream>
 #include <fstream>
-#include <array>
-#include <ranges>
-#include <algorithm>
-#include <random>
+#include <chrono>
 #include <format>
-#include <sstream>
-#include <regex>
-#include <cassert>
+#include <vector>
+#include <ranges>
+#include <array>
+#include <string_view>
 #include "common.h"
-
-using t_state		= uint8;
-using t_observation = uint8;
+#include "dyn_model.h"
+#include "trainer.h"
+#include "gmm_model.h"
+#include "discretizer.h"
+#include "model_selection.h"
+#include "model_store.h"
+#include "trace_reader.h"
+#include "backtest.h"
+#include "feature_engine.h"
 
 // number of state.
 constexpr auto N = 5;
-// number of observation.
+// number of observation, delays are cut into this many equal-mass bins
 constexpr auto M = 10;
-// sequence length
-constexpr auto T = 10;
-
-// lambda = (A, B, pi)
-
-// P1 : compute P(O | lambda) -> allows us to choose the best-match model
-
-// p2 : given O, find optimal Q -> uncover hidden part of the model
-
-// p3 : given O, find optimal lambda (A, B, pi) -> train the model
-
-// p3 (find model) -> p2 (understand physical meaning of the model state) -> p1 (score each model)
-
-template <typename t, std::size_t n>
-std::string format_arr(std::array<t, n>& arr)
-{
-	std::ostringstream oss;
-	oss << "{\n";
-	for (size_t i = 0; i < n; ++i)
-	{
-		if constexpr (std::is_same_v<t, float>)
-		{
-			oss << std::format("{:.3f}", arr[i]);
-		}
-		else
-		{
-			oss << std::format("{}", arr[i]);
-		}
-
-		if (i + 1 < n)
-		{
-			oss << ", ";
-		}
-	}
-	oss << "\n}\n";
-	return oss.str();
-}
-
-template <typename t>
-std::string format_matrix(t& elem)
-{
-	if constexpr (std::is_same_v<t, float32> or std::is_same_v<t, double64>)
-	{
-		return std::format(" {:.3f}", elem);
-	}
-	else
-	{
-		return std::format(" {}", elem);
-	}
-}
-
-template <typename t, std::size_t n>
-std::string format_matrix(std::array<t, n>& arr)
+// baum-welch stops after this many iterations or once converged
+constexpr auto max_epoch_count = 200;
+// converged once the log likelihood per sample improves by less than this
+constexpr auto tolerance = 1e-7;
+// trained lambda, the next run warm starts from it
+constexpr auto model_path = "../hmm_model.txt";
+// same lambda in the binary format, mapped instead of parsed, preferred for the warm start
+constexpr auto binary_model_path = "../hmm_model.bin";
+// the trace is cut into sequences of this length, trained in parallel
+constexpr auto sequence_length = 1024;
+// gaussian hmm on the raw delays, same as GaussianHMM(n_components = 3) in LSTM/hmm_delay.ipynb
+constexpr auto gaussian_state_count	  = 3;
+constexpr auto gaussian_mixture_count = 1;
+// --select : random restarts per candidate, candidates are every (N, M) below
+constexpr auto restart_count		   = 8;
+constexpr auto candidate_state_counts  = std::array { 2uz, 3uz, 4uz, 5uz, 6uz, 8uz };
+constexpr auto candidate_symbol_counts = std::array { 8uz, 16uz, 32uz };
+// --backtest [trace files] : weights written by the export cell of LSTM/lstm_delay.ipynb, the lstm is skipped without them
+constexpr auto lstm_weights_path = "../lstm_weights.txt";
+// --features [out] : rolling feature vectors of the trace for the notebooks, min-max scaled on the trace like their MinMaxScaler
+constexpr auto features_path = "../delay_features.csv";
+
+int main(int argc, char** argv)
 {
-	std::ostringstream oss;
-	oss << "{\n";
-	for (t& elem : arr)
+	auto pool	= thread_pool();
+	auto trace	= delay_trace {};
+	auto ingest = trace_ingest::read(pool, "../delay.txt", trace);
+	if (not ingest)
 	{
-		oss << format_matrix(elem);
+		std::cout << "failed to read ../delay.txt" << std::endl;
+		return 1;
 	}
-	oss << "\n}\n";
-	return oss.str();
-}
-
-// lambda
-template <std::size_t state_count, std::size_t observation_count, std::size_t T>
-struct model
-{
-	// transition probability distribution
-	std::array<std::array<double64, state_count>, state_count> A;
-	// observation symbol probability distribution
-	std::array<std::array<double64, observation_count>, state_count> B;
-	// initial state distribution
-	std::array<double64, state_count> pi;
-
-	// observation sequence
-	std::array<uint8, T> observations;
-
-	// alpha[t][state] : t에서 상태가 state일 확률 * 해당 상태에서 관측 O_t가 나올 확률
-	// 0 ~ t 까지 observation이 주어졌을 때 t에서 상태 s 에 있을 확률
-	// t 에서 s 에 있을 확률 = t - 1에서 모든 s에서의 alpha * 전이확률 의 합 * observation 확률
-	std::array<std::array<double64, state_count>, T> alpha;
-
-	// t 에서 s에 있을 때 0(t+1), O(t+2), ... , O(T) 가 발생할 확률
-	// 마지막은 1, (이후에 발생될것이 없음)
-	std::array<std::array<double64, state_count>, T> beta;
+	std::cout << std::format("{} delays from {} lines, {:.2f} MB in {:.2f} ms ({:.2f} GB/s, {} chunks)", trace.size(), ingest->line_count,
+							 (double64)ingest->byte_count / 1e6, ingest->elapsed_ms, ingest->gb_per_second(), ingest->chunk_count)
+			  << std::endl;
+	auto& delays = trace.delay;
 
-	// probability of being at state s on time t
-	std::array<std::array<double64, state_count>, T> gamma;
-
-	// ξ
-	// probability of moving from state s1 to s2 on time t
-	// xi(curr, next) gamma(curr) * A[curr][next] * gamma(next) -> X
-	// xi(t, curr, next) = alpha[t][curr] * A[curr][next] * B[next][O[t+1] * beta[t+1][next]
-	std::array<std::array<std::array<double64, state_count>, state_count>, T> xi;
-
-	// δ
-	// t까지 관측이 진행되었을 때 다음 상태에 도달하는 가장 높은 경로의 확률
-	// alpha : t 에서 s일 총 확률
-	// delta : t 에서 s일 가장 적절한 경로의 확률
-	std::array<std::array<double64, state_count>, T> delta;
-
-	// ψ
-	// t에서 다음 상태에 도달하기 직전 최고 확률 경로의 직전 상태
-	// psi[t][j] = argmax_i (delta[t-1][i] * A[i][j])
-	std::array<std::array<t_state, state_count>, T> psi;
-
-	// 최적의 state array
-	std::array<t_state, state_count> path;
-
-	void init_A_B_pi()
+	// model order sweep instead of one run, the winner becomes the warm start of the next run
+	if (argc > 1 and std::string_view(argv[1]) == "--select")
 	{
-		std::random_device						 rd;
-		std::mt19937							 gen(rd());
-		std::uniform_real_distribution<double64> dist(0.0, 1.0);
-
-		for (size_t i = 0; i < state_count; ++i)
+		auto candidates = std::vector<candidate> {};
+		for (auto n : candidate_state_counts)
 		{
-			// 임의의 값 생성
-			for (size_t j = 0; j < state_count; ++j)
+			for (auto m : candidate_symbol_counts)
 			{
-				A[i][j] = dist(gen);
+				candidates.push_back({ n, m });
 			}
+		}
 
-			// 합 계산
-			double64 sum = *std::ranges::fold_left_first(A[i], std::plus {});
+		auto config = selection_config { .restart_count = restart_count };
+		config.train.max_iterations = max_epoch_count;
+		config.train.tolerance		= tolerance;
 
-			// 각 원소를 합으로 나누어 정규화 (합 = 1)
-			for (auto& val : A[i])
-			{
-				val /= sum;
-			}
-		}
+		auto result = select_model(pool, delays, candidates, config);
+		result.print();
+		std::cout << std::format("{} candidates x {} restarts on {} threads, {:.2f} ms", candidates.size(), restart_count, pool.size(), result.elapsed_ms) << std::endl;
 
-		for (size_t i = 0; i < state_count; ++i)
+		if (not result.best_model().save(model_path) or not model_store::save(binary_model_path, result.best_model()))
 		{
-			// 임의의 값 생성
-			for (size_t j = 0; j < observation_count; ++j)
-			{
-				B[i][j] = dist(gen);
-			}
-
-			// 합 계산
-			double64 sum = *std::ranges::fold_left_first(B[i], std::plus {});
+			std::cout << "failed to save " << model_path << std::endl;
+		}
+		return 0;
+	}
 
-			// 각 원소를 합으로 나누어 정규화 (합 = 1)
-			for (auto& val : B[i])
+	// every predictor replayed over ../delay.txt and any trace given after the flag, in parallel
+	if (argc > 1 and std::string_view(argv[1]) == "--backtest")
+	{
+		auto traces = std::vector<named_trace> { { "delay.txt", delays } };
+		for (auto idx = 2; idx < argc; ++idx)
+		{
+			auto extra = delay_trace {};
+			if (trace_ingest::read(pool, argv[idx], extra))
 			{
-				val /= sum;
+				traces.push_back({ argv[idx], std::move(extra.delay) });
 			}
 		}
 
-		auto sum = 0.f;
-		for (auto& val : pi)
-		{
-			val	 = dist(gen);
-			sum += val;
-		}
+		auto predictors = std::vector<predictor_entry> {
+			{ "last", [](std::span<const double64>) { return any_predictor(ewma_predictor(1.0)); } },
+			{ "ewma 0.1", [](std::span<const double64>) { return any_predictor(ewma_predictor(0.1)); } },
+			{ "ewma 0.3", [](std::span<const double64>) { return any_predictor(ewma_predictor(0.3)); } },
+			{ "kalman", [](std::span<const double64> warmup) { return any_predictor(kalman_predictor::fit(warmup)); } },
+			{ "hmm", [](std::span<const double64> warmup) {
+				 return any_predictor(hmm_predictor::fit(warmup, N, M, { .max_iterations = max_epoch_count, .tolerance = tolerance }));
+			 } },
+		};
 
-		for (auto& val : pi)
+		auto lstm = std::make_shared<lstm_model>();
+		if (lstm->load(lstm_weights_path))
 		{
-			val /= sum;
+			predictors.push_back({ "lstm", [lstm](std::span<const double64>) { return any_predictor(lstm_predictor(lstm)); } });
 		}
-	}
 
-	void update_observations(auto&& view)
-	{
-		std::ranges::copy(view, observations.begin());
+		auto result = backtest(pool, traces, predictors, { .horizons = { 1, 5, 10 } });
+		result.print();
+		std::cout << std::format("{} traces x {} predictors on {} threads, {:.2f} ms", traces.size(), predictors.size(), pool.size(), result.elapsed_ms) << std::endl;
+		return 0;
 	}
 
-	void gen_random_observations()
+	// the same feature_engine the server runs, one csv row per delay
+	if (argc > 1 and std::string_view(argv[1]) == "--features")
 	{
-		std::random_device					 rd;
-		std::mt19937						 gen(rd());
-		std::uniform_int_distribution<uint8> dist(0, observation_count);
+		auto begin		= std::chrono::steady_clock::now();
+		auto [lo, hi]	= std::ranges::minmax(delays);
+		auto engine		= feature_engine({ .scale_min = lo, .scale_max = hi });
+		auto path		= std::string(argc > 2 ? argv[2] : features_path);
+		auto file		= std::ofstream(path);
+		auto row		= std::vector<double64>(engine.feature_count());
 
-		for (auto i : std::views::iota(0uz, T))
+		file << "seq";
+		for (auto& name : engine.names())
 		{
-			observations[i] = dist(gen);
+			file << ',' << name;
 		}
-	}
-
-	// fill alpha
-	void forward()
-	{
-		for (auto state : std::views::iota(0uz, state_count))
-			alpha[0][state] = pi[state] * B[state][observations[0]];
+		file << '\n';
 
-		for (auto t : std::views::iota(1uz, T))
+		for (auto t : std::views::iota(0uz, delays.size()))
 		{
-			for (auto curr_state : std::views::iota(0uz, state_count))
+			engine.update(delays[t]);
+			engine.features(row);
+			file << trace.seq[t];
+			for (auto x : row)
 			{
-				auto sum = 0.f;
-				for (auto prev_state : std::views::iota(0uz, state_count))
-				{
-					sum += alpha[t - 1][prev_state] * A[prev_state][curr_state];
-				}
-
-				alpha[t][curr_state] = sum * B[curr_state][observations[t]];
+				file << std::format(",{:.6g}", x);
 			}
+			file << '\n';
 		}
-	}
 
-	// fill beta
-	void backward()
-	{
-		for (auto state : std::views::iota(0uz, state_count))
+		if (not file)
 		{
-			beta[T - 1][state] = 1.f;
-		}
-
-		for (auto t : std::views::iota(0uz, T - 1) | std::views::reverse)
-		{
-			for (auto curr_state : std::views::iota(0uz, state_count))
-			{
-				for (auto next_state : std::views::iota(0uz, state_count))
-				{
-					beta[t][curr_state] += beta[t + 1][next_state] * A[curr_state][next_state] * B[next_state][observations[t + 1]];
-				}
-			}
+			std::cout << "failed to write " << path << std::endl;
+			return 1;
 		}
+		std::cout << std::format("{} x {} features to {} in {:.2f} ms", delays.size(), engine.feature_count(), path,
+								 std::chrono::duration<double64, std::milli>(std::chrono::steady_clock::now() - begin).count())
+				  << std::endl;
+		return 0;
 	}
 
-	// compute possibility of observation given this model
-	auto likelihood()
+	// a saved model brings the bins its B was trained on, otherwise they come from this trace
+	auto hmm		 = dyn_model(N, M);
+	auto binning	 = discretizer {};
+	auto mapped		 = model_store::model_file {};
+	auto from_binary = mapped.open(binary_model_path) and mapped.model->type() == model_store::emission::discrete and mapped.model->verify();
+	auto from_file	 = from_binary;
+	if (from_binary)
 	{
-		// sum alpha
-		return std::ranges::fold_left_first(alpha[T - 1], std::plus {}).value();
-		// sum beta
-		//  return std::ranges::fold_left_first(std::views::iota(0, N) | std::views::transform([&](auto state) { return pi[state] * B[state][O[0]] * beta[0][state]; }), std::plus {}).value();
+		hmm = mapped.model->to_dyn_model();
 	}
-
-	void init_gamma()
+	else
 	{
-		auto p = likelihood();
-		for (auto t : std::views::iota(0uz, T))
-		{
-			for (auto state : std::views::iota(0uz, state_count))
-			{
-				gamma[t][state] = alpha[t][state] * beta[t][state] / p;
-			}
-		}
-
-		// sum of gamma[t] == 1;
+		from_file = hmm.load(model_path);
 	}
 
-	void init_xi()
+	if (from_file and hmm.state_count == N and not hmm.edges.empty())
 	{
-		auto p = likelihood();
-		for (auto t : std::views::iota(0uz, T - 1))
-		{
-			for (auto curr_state : std::views::iota(0uz, state_count))
-			{
-				for (auto next_state : std::views::iota(0uz, state_count))
-				{
-					xi[t][curr_state][next_state] = alpha[t][curr_state] * A[curr_state][next_state] * B[next_state][observations[t + 1]] * beta[t + 1][next_state] / p;
-				}
-			}
-		}
+		binning = discretizer(hmm.edges);
+		std::cout << "warm start from " << (from_binary ? binary_model_path : model_path) << std::endl;
 	}
-
-	// init delta, psi, and path
-	void viterbi()
+	else
 	{
-		for (auto s : std::views::iota(0uz, state_count))
-		{
-			delta[0][s] = pi[s] * B[s][observations[0]];
-			psi[0][s]	= 0;	// dummy
-		}
-
-		for (auto t : std::views::iota(1uz, T))
-		{
-			for (auto curr_state : std::views::iota(0uz, state_count))
-			{
-				auto max_prob  = 0.f;
-				auto max_state = 0;
-				for (auto prev_state : std::views::iota(0uz, state_count))
-				{
-					auto p = delta[t - 1][prev_state] * A[prev_state][curr_state];
-					if (p > max_prob)
-					{
-						max_prob  = p;
-						max_state = prev_state;
-					}
-				}
-
-				delta[t][curr_state] = max_prob * B[curr_state][observations[t]];
-				psi[t][curr_state]	 = max_state;
-			}
-		}
-
-		auto max_prob  = 0.f;
-		auto max_state = 0;
-		for (auto state : std::views::iota(0uz, state_count))
+		auto sketch = quantile_sketch();
+		for (auto delay : delays)
 		{
-			if (delta[T - 1][state] > max_prob)
-			{
-				max_prob  = delta[T - 1][state];
-				max_state = state;
-			}
+			sketch.add(delay);
 		}
 
-		path[T - 1] = std::ranges::max_element(delta[T - 1]) - delta[T - 1].begin();
-
-		for (auto t : std::views::iota(0uz, T - 1) | std::views::reverse)
-		{
-			path[t] = psi[t + 1][path[t + 1]];
-		}
+		// equal delays can merge bins, so the model takes however many symbols are left
+		binning = discretizer::quantile(sketch, M);
+		hmm		= dyn_model(N, binning.symbol_count());
+		hmm.init_A_B_pi();
+		hmm.edges = binning.edges;
 	}
 
-	void baum_welch()
-	{
-		auto it_count = 1;
-		for (auto i : std::views::iota(0, it_count))
-		{
-			forward();
-			backward();
-			init_gamma();
-			init_xi();
+	auto observations = std::vector<t_observation>(delays.size());
+	binning.batch(delays, observations);
 
-			for (auto curr_state : std::views::iota(0uz, state_count))
-			{
-				pi[curr_state] = gamma[0][curr_state];
-				auto gamma_sum = *std::ranges::fold_left_first(
-					std::views::iota(0uz, T)
-					| std::views::transform([this, curr_state](auto t) {
-						return gamma[t][curr_state];
-					}), std::plus {});
+	auto trainer   = em_trainer(pool);
+	auto sequences = em_trainer::split(observations, sequence_length);
+	auto config	   = train_config {
+		   .max_iterations = max_epoch_count,
+		   .tolerance	   = tolerance,
+		   .on_iteration   = [](const iteration_report& report) {
+			   std::cout << std::format("epoch : {}, log likelihood : {:.6f}, improvement / sample : {:.3e}, {:.2f} ms", report.iteration, report.log_likelihood, report.improvement, report.elapsed_ms) << std::endl;
+		   }
+	};
 
-				for (auto next_state : std::views::iota(0uz, state_count))
-				{
-					auto xi_sum = *std::ranges::fold_left_first(
-							std::views::iota(0uz, T)
-							| std::views::transform([this, curr_state, next_state](auto t) {
-								return xi[t][curr_state][next_state];
-							}), std::plus {});
+	auto result = trainer.fit(hmm, sequences, config);
+	std::cout << std::format("{} after {} epochs, {:.2f} ms", result.converged ? "converged" : "not converged", result.iterations.size(), result.elapsed_ms) << std::endl;
 
-					A[curr_state][next_state] = xi_sum / gamma_sum;
-				}
-
-				for (auto o : std::views::iota(0uz, observation_count))
-				{
-					B[curr_state][o]  = *std::ranges::fold_left_first(
-					std::views::iota(0uz, T)
-					| std::views::filter([this, o](auto t){return observations[t] == o; })
-					| std::views::transform([this, curr_state](auto t) {
-						return gamma[t][curr_state];
-					}), std::plus {}) / gamma_sum;
-				}
-			}
-		}
-	}
-
-	void print()
-	{
-		std::cout << "A : \n"
-				  << format_matrix(A) << std::endl;
-		std::cout << "B : \n"
-				  << format_matrix(B) << std::endl;
-		std::cout << "pi : \n"
-				  << format_matrix(pi) << std::endl;
-		std::cout << "observations : \n"
-				  << format_matrix(observations) << std::endl;
-		std::cout << "alpha : \n"
-				  << format_matrix(alpha) << std::endl;
-		std::cout << "beta : \n"
-				  << format_matrix(beta) << std::endl;
-		std::cout << "gamma : \n"
-				  << format_matrix(gamma) << std::endl;
-		std::cout << "xi : \n"
-				  << format_matrix(xi) << std::endl;
-		std::cout << "delta : \n"
-				  << format_matrix(delta) << std::endl;
-		std::cout << "psi : \n"
-				  << format_matrix(psi) << std::endl;
-		std::cout << "path : \n"
-				  << format_arr(path) << std::endl;
-	}
-};
-
-int main()
-{
-	model<5, 10, T> hmm;
-	hmm.init_A_B_pi();
-	hmm.gen_random_observations();
-
-	std::ifstream file("../delay.txt");
-	assert(file.is_open() and "invalid file");
-	std::regex num_regex(R"((\d+)\s*$)");
-	auto epoch_num = 0;
-	auto end_of_file = false;
-	while (not end_of_file)
+	if (not hmm.save(model_path) or not model_store::save(binary_model_path, hmm))
 	{
-		std::cout << "epoch : " << epoch_num++ << std::endl;
-		hmm.update_observations(
-			std::views::iota(0, T)
-				| std::views::transform([&file, &num_regex, &end_of_file](auto i) {
-				std::string line;
-				std::smatch match;
-				if (std::getline(file, line))
-				{
-					if (std::regex_search(line, match, num_regex))
-					{
-						return std::stoi(match[1]) % 10;
-					}
-				}
-				end_of_file = true;
-				return 0;
-		}));
-		hmm.baum_welch();
+		std::cout << "failed to save " << model_path << std::endl;
 	}
 
+	hmm.update_observations(observations);
+	hmm.viterbi_log();
 
+	hmm.print();
 
+	auto gaussian = gmm_model(gaussian_state_count, gaussian_mixture_count);
+	gaussian.update_observations(delays);
+	gaussian.init_from_data(delays);
 
+	auto gaussian_result = gaussian.fit({ .max_iterations = max_epoch_count, .tolerance = tolerance });
+	std::cout << std::format("gaussian hmm : {} after {} epochs, log likelihood : {:.6f}, {:.2f} ms", gaussian_result.converged ? "converged" : "not converged", gaussian_result.iterations.size(), gaussian_result.log_likelihood, gaussian_result.elapsed_ms) << std::endl;
 
+	// every sample predicted by the mean of its viterbi state, as in the notebook
+	gaussian.viterbi();
+	auto abs_error = 0.0;
+	auto sq_error  = 0.0;
+	for (auto t : std::views::iota(0uz, delays.size()))
+	{
+		auto err   = delays[t] - gaussian.state_mean(gaussian.path[t]);
+		abs_error += std::abs(err);
+		sq_error  += err * err;
+	}
 
-
-
-	hmm.viterbi();
-
-	hmm.print();
+	std::cout << std::format("MAE : {:.3f}, RMSE : {:.3f}", abs_error / (double64)delays.size(), std::sqrt(sq_error / (double64)delays.size())) << std::endl;
+	gaussian.print();
 
 	return 0;
 	// TIP See CLion help at <a href="https://www.jetbrains.com/help/clion/">jetbrains.com/help/clion/</a>. Also, you can try interactive lessons for CLion by selecting 'Help | Learn IDE Features' from the main menu.
@@ -0,0 +1,151 @@
+#pragma once
+#include <span>
+#include <string>
+#include <cstddef>
+#include <utility>
+#include "common.h"
+
+#ifdef _WIN32
+	#ifndef NOMINMAX
+		#define NOMINMAX
+	#endif
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+// read only file mapping, unmapped on destruction
+struct mapped_file
+{
+	const std::byte* p_data = nullptr;
+	std::size_t		 size	= 0;
+#ifdef _WIN32
+	HANDLE h_file	 = INVALID_HANDLE_VALUE;
+	HANDLE h_mapping = nullptr;
+#else
+	int32 fd = -1;
+#endif
+
+	mapped_file() = default;
+	mapped_file(const mapped_file&)			   = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+
+	mapped_file(mapped_file&& other) noexcept { _take(other); }
+
+	mapped_file& operator=(mapped_file&& other) noexcept
+	{
+		if (this != &other)
+		{
+			close();
+			_take(other);
+		}
+		return *this;
+	}
+
+	~mapped_file() { close(); }
+
+	bool open(const std::string& path)
+	{
+		close();
+#ifdef _WIN32
+		h_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (h_file == INVALID_HANDLE_VALUE)
+		{
+			return false;
+		}
+
+		auto file_size = LARGE_INTEGER {};
+		if (not GetFileSizeEx(h_file, &file_size) or file_size.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+
+		h_mapping = CreateFileMappingA(h_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (h_mapping == nullptr)
+		{
+			close();
+			return false;
+		}
+
+		p_data = (const std::byte*)MapViewOfFile(h_mapping, FILE_MAP_READ, 0, 0, 0);
+		size   = (std::size_t)file_size.QuadPart;
+#else
+		fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return false;
+		}
+
+		struct stat st = {};
+		if (fstat(fd, &st) != 0 or st.st_size == 0)
+		{
+			close();
+			return false;
+		}
+
+		auto* p_map = mmap(nullptr, (std::size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		p_data		= p_map == MAP_FAILED ? nullptr : (const std::byte*)p_map;
+		size		= (std::size_t)st.st_size;
+#endif
+		if (p_data == nullptr)
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (p_data != nullptr)
+		{
+			UnmapViewOfFile(p_data);
+		}
+		if (h_mapping != nullptr)
+		{
+			CloseHandle(h_mapping);
+		}
+		if (h_file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(h_file);
+		}
+		h_file	  = INVALID_HANDLE_VALUE;
+		h_mapping = nullptr;
+#else
+		if (p_data != nullptr)
+		{
+			munmap((void*)p_data, size);
+		}
+		if (fd >= 0)
+		{
+			::close(fd);
+		}
+		fd = -1;
+#endif
+		p_data = nullptr;
+		size   = 0;
+	}
+
+	std::span<const std::byte> bytes() const { return { p_data, size }; }
+
+  private:
+	void _take(mapped_file& other)
+	{
+		p_data = std::exchange(other.p_data, nullptr);
+		size   = std::exchange(other.size, 0);
+#ifdef _WIN32
+		h_file	  = std::exchange(other.h_file, INVALID_HANDLE_VALUE);
+		h_mapping = std::exchange(other.h_mapping, nullptr);
+#else
+		fd = std::exchange(other.fd, -1);
+#endif
+	}
+};
@@ -0,0 +1,428 @@
+#pragma once
+#include <iostream>
+#include <array>
+#include <ranges>
+#include <algorithm>
+#include <random>
+#include <format>
+#include <sstream>
+#include <cmath>
+#include <limits>
+#include "common.h"
+
+using t_state		= uint8;
+using t_observation = uint8;
+
+// lambda = (A, B, pi)
+
+// P1 : compute P(O | lambda) -> allows us to choose the best-match model
+
+// p2 : given O, find optimal Q -> uncover hidden part of the model
+
+// p3 : given O, find optimal lambda (A, B, pi) -> train the model
+
+// p3 (find model) -> p2 (understand physical meaning of the model state) -> p1 (score each model)
+
+template <typename t, std::size_t n>
+std::string format_arr(std::array<t, n>& arr)
+{
+	std::ostringstream oss;
+	oss << "{\n";
+	for (size_t i = 0; i < n; ++i)
+	{
+		if constexpr (std::is_same_v<t, float>)
+		{
+			oss << std::format("{:.3f}", arr[i]);
+		}
+		else
+		{
+			oss << std::format("{}", arr[i]);
+		}
+
+		if (i + 1 < n)
+		{
+			oss << ", ";
+		}
+	}
+	oss << "\n}\n";
+	return oss.str();
+}
+
+template <typename t>
+std::string format_matrix(t& elem)
+{
+	if constexpr (std::is_same_v<t, float32> or std::is_same_v<t, double64>)
+	{
+		return std::format(" {:.3f}", elem);
+	}
+	else
+	{
+		return std::format(" {}", elem);
+	}
+}
+
+template <typename t, std::size_t n>
+std::string format_matrix(std::array<t, n>& arr)
+{
+	std::ostringstream oss;
+	oss << "{\n";
+	for (t& elem : arr)
+	{
+		oss << format_matrix(elem);
+	}
+	oss << "\n}\n";
+	return oss.str();
+}
+
+// lambda
+template <std::size_t state_count, std::size_t observation_count, std::size_t T>
+struct model
+{
+	// transition probability distribution
+	std::array<std::array<double64, state_count>, state_count> A;
+	// observation symbol probability distribution
+	std::array<std::array<double64, observation_count>, state_count> B;
+	// initial state distribution
+	std::array<double64, state_count> pi;
+
+	// observation sequence
+	std::array<uint8, T> observations;
+
+	// alpha[t][state] : t에서 상태가 state일 확률 * 해당 상태에서 관측 O_t가 나올 확률
+	// 0 ~ t 까지 observation이 주어졌을 때 t에서 상태 s 에 있을 확률
+	// t 에서 s 에 있을 확률 = t - 1에서 모든 s에서의 alpha * 전이확률 의 합 * observation 확률
+	std::array<std::array<double64, state_count>, T> alpha;
+
+	// t 에서 s에 있을 때 0(t+1), O(t+2), ... , O(T) 가 발생할 확률
+	// 마지막은 1, (이후에 발생될것이 없음)
+	std::array<std::array<double64, state_count>, T> beta;
+
+	// alpha, beta are scaled (rabiner) : alpha[t] sums to 1 and the dropped mass is kept here
+	// log P(O | lambda) = sum log(scale[t])
+	std::array<double64, T> scale;
+
+	// probability of being at state s on time t
+	std::array<std::array<double64, state_count>, T> gamma;
+
+	// ξ
+	// probability of moving from state s1 to s2 on time t
+	// xi(curr, next) gamma(curr) * A[curr][next] * gamma(next) -> X
+	// xi(t, curr, next) = alpha[t][curr] * A[curr][next] * B[next][O[t+1] * beta[t+1][next]
+	std::array<std::array<std::array<double64, state_count>, state_count>, T> xi;
+
+	// δ
+	// t까지 관측이 진행되었을 때 다음 상태에 도달하는 가장 높은 경로의 확률
+	// alpha : t 에서 s일 총 확률
+	// delta : t 에서 s일 가장 적절한 경로의 확률
+	// log 값으로 저장, 긴 T 에서도 underflow 없음
+	std::array<std::array<double64, state_count>, T> delta;
+
+	// ψ
+	// t에서 다음 상태에 도달하기 직전 최고 확률 경로의 직전 상태
+	// psi[t][j] = argmax_i (delta[t-1][i] + log A[i][j])
+	std::array<std::array<t_state, state_count>, T> psi;
+
+	// 최적의 state array, [T]
+	std::array<t_state, T> path;
+
+	void init_A_B_pi()
+	{
+		std::random_device rd;
+		init_A_B_pi(rd());
+	}
+
+	// same seed, same lambda
+	void init_A_B_pi(uint64 seed)
+	{
+		std::mt19937_64							 gen(seed);
+		std::uniform_real_distribution<double64> dist(0.0, 1.0);
+
+		for (size_t i = 0; i < state_count; ++i)
+		{
+			// 임의의 값 생성
+			for (size_t j = 0; j < state_count; ++j)
+			{
+				A[i][j] = dist(gen);
+			}
+
+			// 합 계산
+			double64 sum = *std::ranges::fold_left_first(A[i], std::plus {});
+
+			// 각 원소를 합으로 나누어 정규화 (합 = 1)
+			for (auto& val : A[i])
+			{
+				val /= sum;
+			}
+		}
+
+		for (size_t i = 0; i < state_count; ++i)
+		{
+			// 임의의 값 생성
+			for (size_t j = 0; j < observation_count; ++j)
+			{
+				B[i][j] = dist(gen);
+			}
+
+			// 합 계산
+			double64 sum = *std::ranges::fold_left_first(B[i], std::plus {});
+
+			// 각 원소를 합으로 나누어 정규화 (합 = 1)
+			for (auto& val : B[i])
+			{
+				val /= sum;
+			}
+		}
+
+		auto sum = 0.f;
+		for (auto& val : pi)
+		{
+			val	 = dist(gen);
+			sum += val;
+		}
+
+		for (auto& val : pi)
+		{
+			val /= sum;
+		}
+	}
+
+	void update_observations(auto&& view)
+	{
+		std::ranges::copy(view, observations.begin());
+	}
+
+	void gen_random_observations()
+	{
+		std::random_device					 rd;
+		std::mt19937						 gen(rd());
+		std::uniform_int_distribution<uint8> dist(0, observation_count);
+
+		for (auto i : std::views::iota(0uz, T))
+		{
+			observations[i] = dist(gen);
+		}
+	}
+
+	// fill alpha
+	void forward()
+	{
+		auto sum = 0.0;
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			alpha[0][state]	 = pi[state] * B[state][observations[0]];
+			sum				+= alpha[0][state];
+		}
+
+		normalize_alpha(0, sum);
+
+		for (auto t : std::views::iota(1uz, T))
+		{
+			sum = 0.0;
+			for (auto curr_state : std::views::iota(0uz, state_count))
+			{
+				auto acc = 0.0;
+				for (auto prev_state : std::views::iota(0uz, state_count))
+				{
+					acc += alpha[t - 1][prev_state] * A[prev_state][curr_state];
+				}
+
+				alpha[t][curr_state]  = acc * B[curr_state][observations[t]];
+				sum					 += alpha[t][curr_state];
+			}
+
+			normalize_alpha(t, sum);
+		}
+	}
+
+	void normalize_alpha(std::size_t t, double64 sum)
+	{
+		scale[t] = sum;
+		for (auto& val : alpha[t])
+		{
+			val /= sum;
+		}
+	}
+
+	// fill beta
+	void backward()
+	{
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			beta[T - 1][state] = 1.0;
+		}
+
+		for (auto t : std::views::iota(0uz, T - 1) | std::views::reverse)
+		{
+			for (auto curr_state : std::views::iota(0uz, state_count))
+			{
+				auto sum = 0.0;
+				for (auto next_state : std::views::iota(0uz, state_count))
+				{
+					sum += beta[t + 1][next_state] * A[curr_state][next_state] * B[next_state][observations[t + 1]];
+				}
+
+				beta[t][curr_state] = sum / scale[t + 1];
+			}
+		}
+	}
+
+	// log P(O | lambda), valid after forward()
+	double64 log_likelihood()
+	{
+		return std::ranges::fold_left(scale | std::views::transform([](auto val) { return std::log(val); }), 0.0, std::plus {});
+	}
+
+	// compute possibility of observation given this model
+	auto likelihood()
+	{
+		return std::exp(log_likelihood());
+	}
+
+	void init_gamma()
+	{
+		for (auto t : std::views::iota(0uz, T))
+		{
+			for (auto state : std::views::iota(0uz, state_count))
+			{
+				gamma[t][state] = alpha[t][state] * beta[t][state];
+			}
+		}
+
+		// sum of gamma[t] == 1;
+	}
+
+	void init_xi()
+	{
+		for (auto t : std::views::iota(0uz, T - 1))
+		{
+			for (auto curr_state : std::views::iota(0uz, state_count))
+			{
+				for (auto next_state : std::views::iota(0uz, state_count))
+				{
+					xi[t][curr_state][next_state] = alpha[t][curr_state] * A[curr_state][next_state] * B[next_state][observations[t + 1]] * beta[t + 1][next_state] / scale[t + 1];
+				}
+			}
+		}
+	}
+
+	// init delta, psi, and path
+	// max-plus on log probabilities
+	void viterbi()
+	{
+		auto log_A = A;
+		for (auto& row : log_A)
+		{
+			for (auto& val : row)
+			{
+				val = std::log(val);
+			}
+		}
+
+		for (auto s : std::views::iota(0uz, state_count))
+		{
+			delta[0][s] = std::log(pi[s]) + std::log(B[s][observations[0]]);
+			psi[0][s]	= 0;	// dummy
+		}
+
+		for (auto t : std::views::iota(1uz, T))
+		{
+			for (auto curr_state : std::views::iota(0uz, state_count))
+			{
+				auto max_prob  = -std::numeric_limits<double64>::infinity();
+				auto max_state = 0uz;
+				for (auto prev_state : std::views::iota(0uz, state_count))
+				{
+					auto p = delta[t - 1][prev_state] + log_A[prev_state][curr_state];
+					if (p > max_prob)
+					{
+						max_prob  = p;
+						max_state = prev_state;
+					}
+				}
+
+				delta[t][curr_state] = max_prob + std::log(B[curr_state][observations[t]]);
+				psi[t][curr_state]	 = (t_state)max_state;
+			}
+		}
+
+		path[T - 1] = (t_state)(std::ranges::max_element(delta[T - 1]) - delta[T - 1].begin());
+
+		for (auto t : std::views::iota(0uz, T - 1) | std::views::reverse)
+		{
+			path[t] = psi[t + 1][path[t + 1]];
+		}
+	}
+
+	void baum_welch()
+	{
+		forward();
+		backward();
+		init_gamma();
+		init_xi();
+
+		// expected counts, one pass over t
+		std::array<std::array<double64, state_count>, state_count>		  xi_sum {};
+		std::array<std::array<double64, observation_count>, state_count> emit_sum {};
+		std::array<double64, state_count>								  gamma_sum {};
+		for (auto t : std::views::iota(0uz, T))
+		{
+			for (auto curr_state : std::views::iota(0uz, state_count))
+			{
+				emit_sum[curr_state][observations[t]] += gamma[t][curr_state];
+				if (t + 1 == T)
+				{
+					continue;
+				}
+
+				gamma_sum[curr_state] += gamma[t][curr_state];
+				for (auto next_state : std::views::iota(0uz, state_count))
+				{
+					xi_sum[curr_state][next_state] += xi[t][curr_state][next_state];
+				}
+			}
+		}
+
+		for (auto curr_state : std::views::iota(0uz, state_count))
+		{
+			pi[curr_state] = gamma[0][curr_state];
+
+			// transitions are counted over t = 0 .. T - 2, emissions over t = 0 .. T - 1
+			for (auto next_state : std::views::iota(0uz, state_count))
+			{
+				A[curr_state][next_state] = xi_sum[curr_state][next_state] / gamma_sum[curr_state];
+			}
+
+			auto emit_count = gamma_sum[curr_state] + gamma[T - 1][curr_state];
+			for (auto o : std::views::iota(0uz, observation_count))
+			{
+				B[curr_state][o] = emit_sum[curr_state][o] / emit_count;
+			}
+		}
+	}
+
+	void print()
+	{
+		std::cout << "A : \n"
+				  << format_matrix(A) << std::endl;
+		std::cout << "B : \n"
+				  << format_matrix(B) << std::endl;
+		std::cout << "pi : \n"
+				  << format_matrix(pi) << std::endl;
+		std::cout << "observations : \n"
+				  << format_matrix(observations) << std::endl;
+		std::cout << "alpha : \n"
+				  << format_matrix(alpha) << std::endl;
+		std::cout << "beta : \n"
+				  << format_matrix(beta) << std::endl;
+		std::cout << "gamma : \n"
+				  << format_matrix(gamma) << std::endl;
+		std::cout << "xi : \n"
+				  << format_matrix(xi) << std::endl;
+		std::cout << "delta : \n"
+				  << format_matrix(delta) << std::endl;
+		std::cout << "psi : \n"
+				  << format_matrix(psi) << std::endl;
+		std::cout << "path : \n"
+				  << format_arr(path) << std::endl;
+	}
+};
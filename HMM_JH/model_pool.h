@@ -0,0 +1,413 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <ranges>
+#include <algorithm>
+#include <unordered_map>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <format>
+#include <utility>
+#include <cassert>
+#include "common.h"
+#include "dyn_model.h"
+#include "online_model.h"
+#include "trainer.h"
+#include "thread_pool.h"
+#include "model_store.h"
+
+struct model_pool_config
+{
+	std::size_t	 state_count;
+	std::size_t	 observation_count;
+	// resident models above this are evicted, least recently fed first, down to low_watermark of it
+	std::size_t	 max_resident  = 1024;
+	double64	 low_watermark = 0.9;
+	// an eviction writes <store_dir>/<client_id>.hmm, the directory must exist
+	std::string	 store_dir	   = ".";
+	// last history_size symbols of a resident client are kept, every retrain_after new ones start a batch retrain on them
+	std::size_t	 history_size  = 4096;
+	std::size_t	 retrain_after = 2048;
+	std::size_t	 train_seq_len = 1024;
+	train_config train { .max_iterations = 20, .tolerance = 1e-5 };
+	// symbols that arrive while an evicted model is read back, the ones past it are dropped
+	std::size_t	 max_pending   = 256;
+};
+
+// one online hmm per client, bounded in memory
+// update() is what the receive threads call : a map lookup and the client's own lock, never i/o or training. a caller
+// that keeps the client's slot from find_or_create() skips the lookup, the map is sharded for the ones that don't
+//	- a new client starts resident with a random model
+//	- once more than max_resident are resident, a worker evicts the least recently fed ones to the binary model store
+//	  and keeps a stub in the map
+//	- the next sample of an evicted client marks it loading, is buffered, and a worker maps the file back and replays
+//	  the buffer. an unreadable file gives a fresh model
+//	- every retrain_after samples a worker runs baum-welch on the client's history, warm started from the online
+//	  parameters, and swaps the result in. samples fed during the training are in the history of the next one
+// the online counts are not part of the store, a model read back or retrained keeps its parameters, not their weight.
+// tasks point back at the pool, the destructor waits for the worker pool, which has to outlive it
+struct model_pool
+{
+	enum class slot_state : uint8
+	{
+		resident,
+		evicting,
+		evicted,
+		loading,
+	};
+
+	struct slot
+	{
+		std::mutex					  mutex;
+		uint64						  client_id;
+		slot_state					  state = slot_state::resident;
+		std::unique_ptr<online_model> p_online;
+		// ring, oldest at history_pos once full
+		std::vector<t_observation>	  history;
+		std::size_t					  history_pos	= 0;
+		std::size_t					  new_samples	= 0;
+		std::vector<t_observation>	  pending;
+		bool						  training		= false;
+		// pool tick of the last sample, for lru
+		std::atomic<uint64>			  last_tick		= 0;
+	};
+
+	struct pool_stats
+	{
+		std::atomic<uint64> samples			= 0;
+		std::atomic<uint64> resident		= 0;
+		std::atomic<uint64> evictions		= 0;
+		std::atomic<uint64> loads			= 0;
+		std::atomic<uint64> load_failures	= 0;
+		std::atomic<uint64> trainings		= 0;
+		std::atomic<uint64> dropped_samples = 0;
+	};
+
+	// slots are never erased, an evicted client keeps its stub. a lookup locks one shard, an eviction round walks them
+	// one at a time
+	struct map_shard
+	{
+		std::mutex										  mutex;
+		std::unordered_map<uint64, std::shared_ptr<slot>> slots;
+	};
+
+	static constexpr auto shard_bits = 6uz;
+
+	thread_pool&							 workers;
+	model_pool_config						 config;
+	pool_stats								 stats;
+
+	std::array<map_shard, 1uz << shard_bits> shards;
+	std::atomic<uint64>						 tick	  = 0;
+	std::atomic<bool>						 evicting = false;
+
+	model_pool(thread_pool& workers, model_pool_config config) : workers(workers), config(std::move(config)) { }
+
+	model_pool(const model_pool&)			 = delete;
+	model_pool& operator=(const model_pool&) = delete;
+
+	~model_pool() { workers.wait(); }
+
+	std::string path(uint64 client_id) const { return std::format("{}/{}.hmm", config.store_dir, client_id); }
+
+	// feeds one symbol. on_model(const online_model&) runs under the client's lock after the update, only when the model
+	// is resident : false means the symbol was buffered for a model still on its way back from the store (or dropped)
+	template <typename t_on_model>
+	bool update(uint64 client_id, t_observation o, t_on_model&& on_model)
+	{
+		return update(find_or_create(client_id), o, std::forward<t_on_model>(on_model));
+	}
+
+	bool update(uint64 client_id, t_observation o)
+	{
+		return update(client_id, o, [](const online_model&) { });
+	}
+
+	// same with the client's slot, valid as long as the pool
+	template <typename t_on_model>
+	bool update(const std::shared_ptr<slot>& p_slot, t_observation o, t_on_model&& on_model)
+	{
+		++stats.samples;
+		auto lock = std::lock_guard(p_slot->mutex);
+		p_slot->last_tick.store(++tick, std::memory_order_relaxed);
+
+		switch (p_slot->state)
+		{
+		case slot_state::evicted:
+			p_slot->state = slot_state::loading;
+			workers.submit([this, p_slot](std::size_t) { _load(p_slot); });
+			[[fallthrough]];
+		case slot_state::loading:
+			if (p_slot->pending.size() < config.max_pending)
+			{
+				p_slot->pending.push_back(o);
+			}
+			else
+			{
+				++stats.dropped_samples;
+			}
+			return false;
+		case slot_state::evicting:
+			// the image being written is stale now, the eviction sees the new tick and keeps the model
+		case slot_state::resident:
+			break;
+		}
+
+		_feed(p_slot, o);
+		on_model(std::as_const(*p_slot->p_online));
+		return true;
+	}
+
+	// a new client's model is built outside the shard's lock, a racing caller's one is dropped
+	std::shared_ptr<slot> find_or_create(uint64 client_id)
+	{
+		auto& shard = _shard(client_id);
+		{
+			auto lock = std::lock_guard(shard.mutex);
+			auto it	  = shard.slots.find(client_id);
+			if (it != shard.slots.end())
+			{
+				return it->second;
+			}
+		}
+
+		auto p_new		 = std::make_shared<slot>();
+		p_new->client_id = client_id;
+		p_new->p_online	 = std::make_unique<online_model>(config.state_count, config.observation_count);
+		p_new->p_online->init_random(client_id);
+		p_new->history.reserve(config.history_size);
+
+		auto inserted = false;
+		auto p_slot	  = std::shared_ptr<slot> {};
+		{
+			auto lock		  = std::lock_guard(shard.mutex);
+			auto [it, is_new] = shard.slots.try_emplace(client_id, std::move(p_new));
+			inserted		  = is_new;
+			p_slot			  = it->second;
+		}
+		if (inserted)
+		{
+			_on_resident();
+		}
+		return p_slot;
+	}
+
+	// writes every resident model to the store, e.g. before shutdown. waits for the worker pool, so not from a task
+	void flush()
+	{
+		workers.wait();
+		for (auto& p_slot : _snapshot())
+		{
+			auto lock = std::lock_guard(p_slot->mutex);
+			if (p_slot->p_online != nullptr)
+			{
+				model_store::save(path(p_slot->client_id), p_slot->p_online->to_model());
+			}
+		}
+	}
+
+	std::size_t client_count()
+	{
+		auto res = 0uz;
+		for (auto& shard : shards)
+		{
+			auto lock  = std::lock_guard(shard.mutex);
+			res		  += shard.slots.size();
+		}
+		return res;
+	}
+
+  private:
+	// fibonacci hashing, sequential ids spread over every shard
+	map_shard& _shard(uint64 client_id) { return shards[(client_id * 0x9e3779b97f4a7c15ull) >> (64 - shard_bits)]; }
+
+	// one shard locked at a time, a lookup waits at most for the copy of its own shard
+	std::vector<std::shared_ptr<slot>> _snapshot()
+	{
+		auto res = std::vector<std::shared_ptr<slot>> {};
+		for (auto& shard : shards)
+		{
+			auto lock = std::lock_guard(shard.mutex);
+			for (auto& [_, p_slot] : shard.slots)
+			{
+				res.push_back(p_slot);
+			}
+		}
+		return res;
+	}
+
+	// one more resident model, schedules an eviction round past the limit
+	void _on_resident()
+	{
+		if (++stats.resident > config.max_resident and not evicting.exchange(true))
+		{
+			// residents that arrived during a round are over the limit with nobody left to trigger the next one.
+			// a round that evicted nothing (store failing, everything training or just fed) ends it, the next resident
+			// tries again instead of a worker spinning on the same slots
+			workers.submit([this](std::size_t) {
+				auto evicted = 0uz;
+				do
+				{
+					evicted	 = _evict();
+					evicting = false;
+				} while (evicted > 0 and stats.resident > config.max_resident and not evicting.exchange(true));
+			});
+		}
+	}
+
+	// slot locked, model resident
+	void _feed(const std::shared_ptr<slot>& p_slot, t_observation o)
+	{
+		auto& s = *p_slot;
+		s.p_online->update(o);
+
+		if (s.history.size() < config.history_size)
+		{
+			s.history.push_back(o);
+		}
+		else
+		{
+			s.history[s.history_pos] = o;
+			s.history_pos			 = (s.history_pos + 1) % s.history.size();
+		}
+
+		if (++s.new_samples >= config.retrain_after and not s.training)
+		{
+			s.training	  = true;
+			s.new_samples = 0;
+
+			// oldest first
+			auto history = std::vector<t_observation>(s.history.size());
+			std::ranges::rotate_copy(s.history, s.history.begin() + (std::ptrdiff_t)s.history_pos, history.begin());
+			workers.submit([this, p_slot, history = std::move(history), start = s.p_online->to_model()](std::size_t) mutable {
+				_train(p_slot, history, std::move(start));
+			});
+		}
+	}
+
+	void _train(const std::shared_ptr<slot>& p_slot, std::span<const t_observation> history, dyn_model hmm)
+	{
+		// single threaded, it already runs on a worker
+		auto em_stats = suff_stats(hmm.state_count, hmm.observation_count);
+		run_em(history.size(), config.train, [&]() {
+			em_stats.clear();
+			for (auto seq : em_trainer::split(history, config.train_seq_len))
+			{
+				hmm.update_observations(seq);
+				hmm.e_step(em_stats);
+			}
+
+			if (em_stats.sequence_count > 0)
+			{
+				hmm.m_step(em_stats);
+			}
+			return em_stats.log_likelihood;
+		});
+
+		auto lock		 = std::lock_guard(p_slot->mutex);
+		p_slot->training = false;
+		if (p_slot->p_online == nullptr)
+		{
+			// evicted meanwhile, the trained parameters go nowhere
+			return;
+		}
+
+		_install(*p_slot->p_online, hmm);
+		++stats.trainings;
+	}
+
+	// new parameters, same sample count so the step size stays where the client's stream left it
+	static void _install(online_model& online, const dyn_model& hmm)
+	{
+		auto sample_count	= online.sample_count;
+		auto log_likelihood = online.log_likelihood;
+		online.init(hmm);
+		online.sample_count	  = sample_count;
+		online.log_likelihood = log_likelihood;
+	}
+
+	void _load(const std::shared_ptr<slot>& p_slot)
+	{
+		auto file	= model_store::model_file {};
+		auto online = std::make_unique<online_model>(config.state_count, config.observation_count);
+		if (file.open(path(p_slot->client_id)) and file.model->type() == model_store::emission::discrete
+			and file.model->state_count() == config.state_count and file.model->symbol_count() == config.observation_count)
+		{
+			online->init(file.model->to_dyn_model());
+		}
+		else
+		{
+			online->init_random(p_slot->client_id);
+			++stats.load_failures;
+		}
+		++stats.loads;
+
+		auto lock		 = std::lock_guard(p_slot->mutex);
+		p_slot->p_online = std::move(online);
+		p_slot->state	 = slot_state::resident;
+		p_slot->history.reserve(config.history_size);
+		for (auto o : p_slot->pending)
+		{
+			_feed(p_slot, o);
+		}
+		p_slot->pending.clear();
+		p_slot->pending.shrink_to_fit();
+		_on_resident();
+	}
+
+	// least recently fed resident models out until low_watermark * max_resident are left, returns how many went
+	std::size_t _evict()
+	{
+		auto evicted   = 0uz;
+		auto target	   = (std::size_t)((double64)config.max_resident * config.low_watermark);
+		auto resident  = std::vector<std::pair<uint64, std::shared_ptr<slot>>> {};
+		for (auto& p_slot : _snapshot())
+		{
+			resident.emplace_back(p_slot->last_tick.load(std::memory_order_relaxed), std::move(p_slot));
+		}
+		std::ranges::sort(resident, {}, [](const auto& entry) { return entry.first; });
+
+		for (auto& [seen_tick, p_slot] : resident)
+		{
+			if (stats.resident <= target)
+			{
+				break;
+			}
+
+			// image under the lock, the write without it : the client's receive thread never waits on the disk
+			auto image = std::vector<std::byte> {};
+			{
+				auto lock = std::lock_guard(p_slot->mutex);
+				if (p_slot->state != slot_state::resident or p_slot->training or p_slot->last_tick != seen_tick)
+				{
+					continue;
+				}
+				p_slot->state = slot_state::evicting;
+				image		  = model_store::serialize(p_slot->p_online->to_model());
+			}
+
+			auto written = model_store::write_file(path(p_slot->client_id), image);
+
+			auto lock = std::lock_guard(p_slot->mutex);
+			if (not written or p_slot->last_tick != seen_tick)
+			{
+				// fed while writing, or the store failed : it stays
+				p_slot->state = slot_state::resident;
+				continue;
+			}
+
+			p_slot->p_online.reset();
+			p_slot->history		= {};
+			p_slot->history_pos = 0;
+			p_slot->new_samples = 0;
+			p_slot->state		= slot_state::evicted;
+			--stats.resident;
+			++stats.evictions;
+			++evicted;
+		}
+		return evicted;
+	}
+};
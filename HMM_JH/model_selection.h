@@ -0,0 +1,255 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <ranges>
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <iostream>
+#include <cmath>
+#include <limits>
+#include <optional>
+#include "common.h"
+#include "dyn_model.h"
+#include "trainer.h"
+#include "thread_pool.h"
+#include "discretizer.h"
+
+// one (state_count, observation_count) to try
+struct candidate
+{
+	std::size_t state_count;
+	std::size_t observation_count;
+};
+
+enum class selection_criterion
+{
+	held_out,
+	bic,
+	aic,
+};
+
+struct selection_config
+{
+	std::size_t restart_count = 8;
+	// restart r of candidate c is seeded from (base_seed, N, M, r) only, never from the schedule
+	uint64		base_seed	  = 42;
+	// the tail of the trace kept out of training, scored with the trained lambda
+	double64	held_out_fraction = 0.2;
+	std::size_t sequence_length	  = 1024;
+	// every restart runs to convergence on its own
+	train_config		train;
+	selection_criterion criterion = selection_criterion::held_out;
+};
+
+// best restart of one candidate
+// likelihoods are "gain" : log P(O | lambda) + n log(symbol_count), the gain over drawing equal-mass symbols independently.
+// with quantile bins that baseline is what any M scores without a model, so candidates with different M stay comparable.
+struct candidate_score
+{
+	std::size_t state_count;
+	std::size_t observation_count;
+	uint64		seed;
+	// per sample
+	double64	train_gain;
+	double64	held_out_gain;
+	double64	bic;
+	double64	aic;
+	std::size_t parameter_count;
+	std::size_t iteration_count;
+	bool		converged;
+	// spread of the final train log likelihood over the restarts, per sample
+	double64	restart_min_gain;
+	double64	restart_max_gain;
+	dyn_model	model;
+};
+
+struct selection_result
+{
+	std::vector<candidate_score> scores;
+	std::size_t					 best = 0;
+	double64					 elapsed_ms;
+
+	const dyn_model& best_model() const { return scores[best].model; }
+
+	void print() const
+	{
+		std::cout << std::format("{:>3} {:>4} | {:>10} {:>10} | {:>13} {:>13} | {:>6} {:>5} | {:>21}\n",
+								 "N", "M", "train", "held out", "BIC", "AIC", "params", "iters", "restart spread");
+		for (auto idx : std::views::iota(0uz, scores.size()))
+		{
+			auto& score = scores[idx];
+			std::cout << std::format("{:>3} {:>4} | {:>10.5f} {:>10.5f} | {:>13.1f} {:>13.1f} | {:>6} {:>5} | {:>10.5f} {:>10.5f}{}\n",
+									 score.state_count, score.observation_count, score.train_gain, score.held_out_gain, score.bic, score.aic,
+									 score.parameter_count, score.iteration_count, score.restart_min_gain, score.restart_max_gain, idx == best ? " <- best" : "");
+		}
+	}
+};
+
+// random restarts x candidate sweep
+// every (candidate, restart) pair is one task on the pool and trains serially, so K restarts of C candidates
+// take about (C * K / cores) single runs of wall clock. each candidate keeps the restart with the best train likelihood,
+// then candidates are ranked by config.criterion.
+inline selection_result select_model(thread_pool& pool, std::span<const double64> trace, std::span<const candidate> candidates, const selection_config& config)
+{
+	auto begin = std::chrono::steady_clock::now();
+
+	auto held_out_len = (std::size_t)((double64)trace.size() * config.held_out_fraction);
+	auto train_values = trace.first(trace.size() - held_out_len);
+	auto test_values  = trace.last(held_out_len);
+
+	// bins come from the training part only
+	auto sketch = quantile_sketch();
+	for (auto x : train_values)
+	{
+		sketch.add(x);
+	}
+
+	struct binned_trace
+	{
+		discretizer				   binning;
+		std::vector<t_observation> train;
+		std::vector<t_observation> test;
+		std::vector<t_sequence>	   train_sequences;
+		std::vector<t_sequence>	   test_sequences;
+	};
+
+	auto binned = std::vector<binned_trace>(candidates.size());
+	for (auto idx : std::views::iota(0uz, candidates.size()))
+	{
+		auto& data	 = binned[idx];
+		data.binning = discretizer::quantile(sketch, candidates[idx].observation_count);
+		data.train.resize(train_values.size());
+		data.test.resize(test_values.size());
+		data.binning.batch(train_values, data.train);
+		data.binning.batch(test_values, data.test);
+		data.train_sequences = em_trainer::split(data.train, config.sequence_length);
+		data.test_sequences	 = em_trainer::split(data.test, config.sequence_length);
+	}
+
+	struct restart_run
+	{
+		uint64					 seed;
+		train_result			 result;
+		double64				 held_out_log_likelihood = 0.0;
+		std::optional<dyn_model> model;
+	};
+
+	auto restart_count = std::max(config.restart_count, 1uz);
+	auto runs		   = std::vector<restart_run>(candidates.size() * restart_count);
+
+	pool.parallel_for(runs.size(), [&](std::size_t run_idx, std::size_t) {
+		auto  cand_idx = run_idx / restart_count;
+		auto& data	   = binned[cand_idx];
+		auto& run	   = runs[run_idx];
+
+		// splitmix64 of (base_seed, N, M, restart)
+		auto seed = config.base_seed;
+		for (auto val : { (uint64)candidates[cand_idx].state_count, (uint64)data.binning.symbol_count(), (uint64)(run_idx % restart_count) })
+		{
+			seed += 0x9e3779b97f4a7c15ull + val;
+			seed  = (seed ^ (seed >> 30)) * 0xbf58476d1ce4e5b9ull;
+			seed  = (seed ^ (seed >> 27)) * 0x94d049bb133111ebull;
+			seed ^= seed >> 31;
+		}
+		run.seed = seed;
+
+		auto hmm = dyn_model(candidates[cand_idx].state_count, data.binning.symbol_count());
+		hmm.init_A_B_pi(seed);
+		hmm.edges = data.binning.edges;
+
+		auto stats = suff_stats(hmm.state_count, hmm.observation_count);
+		run.result = run_em(data.train.size(), config.train, [&]() {
+			stats.clear();
+			for (auto seq : data.train_sequences)
+			{
+				hmm.update_observations(seq);
+				hmm.e_step(stats);
+			}
+
+			if (stats.sequence_count > 0)
+			{
+				hmm.m_step(stats);
+			}
+			return stats.log_likelihood;
+		});
+
+		// run_em reports the likelihood before the last update, score the parameters that are kept
+		auto train_log_likelihood = 0.0;
+		for (auto seq : data.train_sequences)
+		{
+			hmm.update_observations(seq);
+			hmm.forward();
+			train_log_likelihood += hmm.log_likelihood();
+		}
+		run.result.log_likelihood = train_log_likelihood;
+
+		for (auto seq : data.test_sequences)
+		{
+			hmm.update_observations(seq);
+			hmm.forward();
+			run.held_out_log_likelihood += hmm.log_likelihood();
+		}
+
+		run.model = std::move(hmm);
+	});
+
+	auto res = selection_result {};
+	for (auto cand_idx : std::views::iota(0uz, candidates.size()))
+	{
+		auto& data		   = binned[cand_idx];
+		auto  n_train	   = (double64)std::max(data.train.size(), 1uz);
+		auto  n_test	   = (double64)std::max(data.test.size(), 1uz);
+		auto  log_symbols  = std::log((double64)data.binning.symbol_count());
+		auto  first		   = runs.begin() + (std::ptrdiff_t)(cand_idx * restart_count);
+		auto  last		   = first + (std::ptrdiff_t)restart_count;
+		auto& best_run	   = *std::ranges::max_element(first, last, {}, [](const restart_run& run) { return run.result.log_likelihood; });
+		auto& worst_run	   = *std::ranges::min_element(first, last, {}, [](const restart_run& run) { return run.result.log_likelihood; });
+		auto& hmm		   = *best_run.model;
+
+		auto n = hmm.state_count;
+		auto m = hmm.observation_count;
+		// free parameters : rows of A and B and pi, each sums to 1
+		auto parameter_count = n * (n - 1) + n * (m - 1) + (n - 1);
+		auto train_gain		 = best_run.result.log_likelihood + (double64)data.train.size() * log_symbols;
+
+		res.scores.push_back({
+			.state_count	   = n,
+			.observation_count = m,
+			.seed			   = best_run.seed,
+			.train_gain		   = train_gain / n_train,
+			.held_out_gain	   = (best_run.held_out_log_likelihood + (double64)data.test.size() * log_symbols) / n_test,
+			.bic			   = -2.0 * train_gain + (double64)parameter_count * std::log(n_train),
+			.aic			   = -2.0 * train_gain + 2.0 * (double64)parameter_count,
+			.parameter_count   = parameter_count,
+			.iteration_count   = best_run.result.iterations.size(),
+			.converged		   = best_run.result.converged,
+			.restart_min_gain  = worst_run.result.log_likelihood / n_train + log_symbols,
+			.restart_max_gain  = best_run.result.log_likelihood / n_train + log_symbols,
+			.model			   = std::move(hmm),
+		});
+	}
+
+	auto rank = [&](const candidate_score& score) {
+		switch (config.criterion)
+		{
+		case selection_criterion::bic:
+			return -score.bic;
+		case selection_criterion::aic:
+			return -score.aic;
+		default:
+			return score.held_out_gain;
+		}
+	};
+
+	for (auto idx : std::views::iota(0uz, res.scores.size()))
+	{
+		if (rank(res.scores[idx]) > rank(res.scores[res.best]))
+		{
+			res.best = idx;
+		}
+	}
+
+	res.elapsed_ms = std::chrono::duration<double64, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	return res;
+}
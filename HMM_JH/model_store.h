@@ -0,0 +1,402 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <ranges>
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <cassert>
+#include "common.h"
+#include "dyn_model.h"
+#include "gmm_model.h"
+#include "mapped_file.h"
+
+// binary lambda, loaded by mapping the file and pointing into it
+//
+// model file (little endian, every section 64 byte aligned) :
+//	[model_header][A][B | weight][pi][edges][mean][var]
+//	discrete			: A [N][N], B [N][M], pi [N], edges [M - 1] or none
+//	gaussian_mixture	: A [N][N], weight [N][K], pi [N], mean [N][K], var [N][K]
+// pack file, many models behind one mapping :
+//	[pack_header][pack_entry x count, sorted by key][model file][model file]...
+//
+// nothing is parsed on load : the header is checked, then the sections are read in place as double64.
+// views stay valid as long as the mapping that produced them, and the mapping is read only, so processes that
+// map the same file share its pages.
+namespace model_store
+{
+	inline constexpr uint32		 format_version = 1;
+	inline constexpr std::size_t alignment		= 64;
+
+	enum class emission : uint32
+	{
+		discrete		 = 0,
+		gaussian_mixture = 1,
+	};
+
+	enum section_id : uint32
+	{
+		section_A,
+		section_B,	  // weight for gaussian_mixture
+		section_pi,
+		section_edges,
+		section_mean,
+		section_var,
+		section_count,
+	};
+
+	struct model_header
+	{
+		char	 magic[8];
+		uint32	 version;
+		emission type;
+		uint64	 state_count;
+		// discrete : observation_count, gaussian_mixture : mixture_count
+		uint64	 symbol_count;
+		uint64	 edge_count;
+		// header + sections, multiple of alignment
+		uint64	 total_size;
+		// from the start of this header, 0 if the section is absent
+		uint64	 section_offset[section_count];
+		// fnv-1a of everything after the header
+		uint64	 checksum;
+		uint64	 reserved[3];
+	};
+	static_assert(sizeof(model_header) % alignment == 0);
+
+	struct pack_header
+	{
+		char   magic[8];
+		uint32 version;
+		uint32 reserved0;
+		uint64 model_count;
+		uint64 reserved[5];
+	};
+	static_assert(sizeof(pack_header) == alignment);
+
+	struct pack_entry
+	{
+		uint64 key;
+		// from the start of the file
+		uint64 offset;
+		uint64 size;
+	};
+
+	inline constexpr char model_magic[8] = { 'H', 'M', 'M', 'J', 'H', 'M', 'D', 'L' };
+	inline constexpr char pack_magic[8]	 = { 'H', 'M', 'M', 'J', 'H', 'P', 'A', 'K' };
+
+	inline std::size_t align_up(std::size_t size) { return (size + alignment - 1) / alignment * alignment; }
+
+	inline uint64 fnv1a(std::span<const std::byte> bytes)
+	{
+		auto hash = 0xcbf29ce484222325ull;
+		for (auto byte : bytes)
+		{
+			hash ^= (uint64)byte;
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	// sections of one model, in place
+	struct model_view
+	{
+		const model_header* p_header = nullptr;
+
+		emission	type() const { return p_header->type; }
+		std::size_t state_count() const { return p_header->state_count; }
+		std::size_t symbol_count() const { return p_header->symbol_count; }
+
+		std::span<const double64> section(section_id id) const
+		{
+			auto* p_base = (const std::byte*)p_header;
+			auto  offset = p_header->section_offset[id];
+			if (offset == 0)
+			{
+				return {};
+			}
+			return { (const double64*)(p_base + offset), section_size(*p_header, id) };
+		}
+
+		std::span<const double64> A() const { return section(section_A); }
+		std::span<const double64> B() const { return section(section_B); }
+		std::span<const double64> pi() const { return section(section_pi); }
+		std::span<const double64> edges() const { return section(section_edges); }
+
+		double64 a(std::size_t curr_state, std::size_t next_state) const { return A()[curr_state * state_count() + next_state]; }
+		double64 b(std::size_t state, std::size_t observation) const { return B()[state * symbol_count() + observation]; }
+
+		// fnv-1a over the sections, not checked by view() so startup stays O(1) per model
+		bool verify() const
+		{
+			auto* p_base = (const std::byte*)p_header;
+			return fnv1a({ p_base + sizeof(model_header), p_header->total_size - sizeof(model_header) }) == p_header->checksum;
+		}
+
+		// copies of the sections, one memcpy each
+		dyn_model to_dyn_model() const
+		{
+			assert(type() == emission::discrete);
+			auto res = dyn_model(state_count(), symbol_count());
+			std::ranges::copy(A(), res.A.begin());
+			std::ranges::copy(B(), res.B.begin());
+			std::ranges::copy(pi(), res.pi.begin());
+			res.edges.assign(edges().begin(), edges().end());
+			return res;
+		}
+
+		gmm_model to_gmm_model() const
+		{
+			assert(type() == emission::gaussian_mixture);
+			auto res = gmm_model(state_count(), symbol_count());
+			std::ranges::copy(A(), res.A.begin());
+			std::ranges::copy(B(), res.weight.begin());
+			std::ranges::copy(pi(), res.pi.begin());
+			std::ranges::copy(section(section_mean), res.mean.begin());
+			std::ranges::copy(section(section_var), res.var.begin());
+			return res;
+		}
+
+		// element count of a section
+		static std::size_t section_size(const model_header& header, section_id id)
+		{
+			auto n = header.state_count;
+			switch (id)
+			{
+			case section_A:
+				return n * n;
+			case section_pi:
+				return n;
+			case section_edges:
+				return header.edge_count;
+			default:
+				return n * header.symbol_count;
+			}
+		}
+	};
+
+	// header checks and bounds only, nullopt if bytes do not hold a model of this version
+	inline std::optional<model_view> view(std::span<const std::byte> bytes)
+	{
+		if (bytes.size() < sizeof(model_header) or (std::uintptr_t)bytes.data() % alignof(double64) != 0)
+		{
+			return std::nullopt;
+		}
+
+		auto* p_header = (const model_header*)bytes.data();
+		if (std::memcmp(p_header->magic, model_magic, sizeof(model_magic)) != 0 or p_header->version != format_version
+			or p_header->total_size < sizeof(model_header) or p_header->total_size > bytes.size()
+			or p_header->state_count == 0 or p_header->symbol_count == 0)
+		{
+			return std::nullopt;
+		}
+
+		// counts bounded by what total_size can hold before any product of them, a crafted header cannot wrap a size
+		auto max_count = p_header->total_size / sizeof(double64);
+		if (p_header->state_count > max_count / p_header->state_count or p_header->symbol_count > max_count / p_header->state_count
+			or p_header->edge_count > max_count)
+		{
+			return std::nullopt;
+		}
+
+		for (auto id : std::views::iota(0u, (uint32)section_count))
+		{
+			auto offset = p_header->section_offset[id];
+			auto size	= model_view::section_size(*p_header, (section_id)id) * sizeof(double64);
+			if (offset != 0 and (offset % alignment != 0 or offset > p_header->total_size or size > p_header->total_size - offset))
+			{
+				return std::nullopt;
+			}
+		}
+
+		return model_view { p_header };
+	}
+
+	// model file image, header included
+	inline std::vector<std::byte> serialize(emission type, std::size_t state_count, std::size_t symbol_count,
+											std::initializer_list<std::pair<section_id, std::span<const double64>>> sections)
+	{
+		auto header			= model_header {};
+		std::memcpy(header.magic, model_magic, sizeof(model_magic));
+		header.version		= format_version;
+		header.type			= type;
+		header.state_count	= state_count;
+		header.symbol_count = symbol_count;
+
+		auto size = sizeof(model_header);
+		for (auto& [id, data] : sections)
+		{
+			if (data.empty())
+			{
+				continue;
+			}
+			header.section_offset[id] = size;
+			size					  = align_up(size + data.size_bytes());
+			if (id == section_edges)
+			{
+				header.edge_count = data.size();
+			}
+		}
+		header.total_size = size;
+
+		auto res = std::vector<std::byte>(size);
+		for (auto& [id, data] : sections)
+		{
+			if (not data.empty())
+			{
+				std::memcpy(res.data() + header.section_offset[id], data.data(), data.size_bytes());
+			}
+		}
+
+		header.checksum = fnv1a({ res.data() + sizeof(model_header), size - sizeof(model_header) });
+		std::memcpy(res.data(), &header, sizeof(model_header));
+		return res;
+	}
+
+	inline std::vector<std::byte> serialize(const dyn_model& hmm)
+	{
+		return serialize(emission::discrete, hmm.state_count, hmm.observation_count,
+						 { { section_A, hmm.A }, { section_B, hmm.B }, { section_pi, hmm.pi }, { section_edges, hmm.edges } });
+	}
+
+	inline std::vector<std::byte> serialize(const gmm_model& hmm)
+	{
+		return serialize(emission::gaussian_mixture, hmm.state_count, hmm.mixture_count,
+						 { { section_A, hmm.A }, { section_B, hmm.weight }, { section_pi, hmm.pi }, { section_mean, hmm.mean }, { section_var, hmm.var } });
+	}
+
+	// written next to path and renamed over it, a crash midway leaves the old file or none, never a torn one
+	inline bool write_file(const std::string& path, std::span<const std::byte> bytes)
+	{
+		auto tmp_path = path + ".tmp";
+		auto ec		  = std::error_code {};
+		{
+			std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+			if (not file.is_open())
+			{
+				return false;
+			}
+
+			file.write((const char*)bytes.data(), (std::streamsize)bytes.size());
+			file.close();
+			if (not file.good())
+			{
+				std::filesystem::remove(tmp_path, ec);
+				return false;
+			}
+		}
+
+		std::filesystem::rename(tmp_path, path, ec);
+		if (ec)
+		{
+			std::filesystem::remove(tmp_path, ec);
+			return false;
+		}
+		return true;
+	}
+
+	inline bool save(const std::string& path, const dyn_model& hmm) { return write_file(path, serialize(hmm)); }
+
+	inline bool save(const std::string& path, const gmm_model& hmm) { return write_file(path, serialize(hmm)); }
+
+	// one model file, mapped
+	struct model_file
+	{
+		mapped_file				  file;
+		std::optional<model_view> model;
+
+		bool open(const std::string& path)
+		{
+			model.reset();
+			if (file.open(path))
+			{
+				model = view(file.bytes());
+			}
+			return model.has_value();
+		}
+	};
+
+	// many models in one file, built in memory and written once
+	struct pack_writer
+	{
+		std::vector<std::pair<uint64, std::vector<std::byte>>> models;
+
+		void add(uint64 key, std::vector<std::byte> image) { models.emplace_back(key, std::move(image)); }
+
+		void add(uint64 key, const dyn_model& hmm) { add(key, serialize(hmm)); }
+
+		void add(uint64 key, const gmm_model& hmm) { add(key, serialize(hmm)); }
+
+		bool save(const std::string& path)
+		{
+			std::ranges::sort(models, {}, [](const auto& entry) { return entry.first; });
+
+			auto header = pack_header {};
+			std::memcpy(header.magic, pack_magic, sizeof(pack_magic));
+			header.version	   = format_version;
+			header.model_count = models.size();
+
+			auto index = std::vector<pack_entry>(models.size());
+			auto size  = align_up(sizeof(pack_header) + index.size() * sizeof(pack_entry));
+			for (auto idx : std::views::iota(0uz, models.size()))
+			{
+				index[idx] = { models[idx].first, size, models[idx].second.size() };
+				size	   = align_up(size + models[idx].second.size());
+			}
+
+			auto res = std::vector<std::byte>(size);
+			std::memcpy(res.data(), &header, sizeof(pack_header));
+			std::memcpy(res.data() + sizeof(pack_header), index.data(), index.size() * sizeof(pack_entry));
+			for (auto idx : std::views::iota(0uz, models.size()))
+			{
+				std::memcpy(res.data() + index[idx].offset, models[idx].second.data(), models[idx].second.size());
+			}
+
+			return write_file(path, res);
+		}
+	};
+
+	// mapped pack, find() is a binary search over the index and a header check
+	struct pack
+	{
+		mapped_file					file;
+		std::span<const pack_entry> index;
+
+		bool open(const std::string& path)
+		{
+			index = {};
+			if (not file.open(path) or file.size < sizeof(pack_header))
+			{
+				return false;
+			}
+
+			auto* p_header = (const pack_header*)file.p_data;
+			if (std::memcmp(p_header->magic, pack_magic, sizeof(pack_magic)) != 0 or p_header->version != format_version
+				or sizeof(pack_header) + p_header->model_count * sizeof(pack_entry) > file.size)
+			{
+				return false;
+			}
+
+			index = { (const pack_entry*)(file.p_data + sizeof(pack_header)), (std::size_t)p_header->model_count };
+			return true;
+		}
+
+		std::size_t size() const { return index.size(); }
+
+		std::optional<model_view> find(uint64 key) const
+		{
+			auto it = std::ranges::lower_bound(index, key, {}, &pack_entry::key);
+			if (it == index.end() or it->key != key or it->offset + it->size > file.size)
+			{
+				return std::nullopt;
+			}
+			return view(file.bytes().subspan(it->offset, it->size));
+		}
+	};
+}	 // namespace model_store
@@ -0,0 +1,341 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <algorithm>
+#include "common.h"
+#include "hmm_kernels.h"
+
+// inner loops of the lstm / dense inference, same dispatch as hmm_kernels.h
+// every layer is a row-major weight matrix times its input. a batch of clients is laid out feature major,
+// x[k][lane] with one client per lane, so the batched product broadcasts one weight and multiplies a vector of clients :
+// no horizontal sums, and the weight block is read once for the whole batch. a single client is a plain dot product per row.
+namespace nn_kernel
+{
+	// tanh as a rational function, |error| < 1e-6 : no call, no branch
+	inline float32 fast_tanh(float32 x)
+	{
+		x		= std::clamp(x, -7.90531110763549805f, 7.90531110763549805f);
+		auto x2 = x * x;
+
+		auto p = x2 * -2.76076847742355e-16f + 2.00018790482477e-13f;
+		p	   = x2 * p + -8.60467152213735e-11f;
+		p	   = x2 * p + 5.12229709037114e-08f;
+		p	   = x2 * p + 1.48572235717979e-05f;
+		p	   = x2 * p + 6.37261928875436e-04f;
+		p	   = x2 * p + 4.89352455891786e-03f;
+		p	   = x * p;
+
+		auto q = x2 * 1.19825839466702e-06f + 1.18534705686654e-04f;
+		q	   = x2 * q + 2.26843463243900e-03f;
+		q	   = x2 * q + 4.89352518554385e-03f;
+		return p / q;
+	}
+
+	inline float32 fast_sigmoid(float32 x) { return 0.5f * fast_tanh(0.5f * x) + 0.5f; }
+
+	struct kernel_set
+	{
+		kernel::isa		 type;
+		std::string_view name;
+
+		// sum_k w[k] * x[k]
+		float32 (*dot_f32)(const float32* w, const float32* x, std::size_t len);
+
+		// sum_k w[k] * x[k], the row scale is applied by the caller
+		float32 (*dot_i8)(const int8* w, const float32* x, std::size_t len);
+
+		// y[r][l] = bias[r] + sum_k w[r][k] * x[k][l], w [row_count][col_count], x [col_count][lane_count], y [row_count][lane_count]
+		void (*gemm_f32)(const float32* w, const float32* bias, std::size_t row_count, std::size_t col_count, const float32* x, float32* y, std::size_t lane_count);
+
+		// lstm cell on count values, gates = [i][f][g][o] blocks of count each :
+		// cell = sigmoid(f) * cell + sigmoid(i) * tanh(g), h = sigmoid(o) * tanh(cell)
+		void (*lstm_cell)(const float32* gates, float32* cell, float32* h, std::size_t count);
+	};
+
+	namespace detail
+	{
+		inline float32 dot_f32_scalar(const float32* w, const float32* x, std::size_t len)
+		{
+			auto res = 0.0f;
+			for (auto k = 0uz; k < len; ++k)
+			{
+				res += w[k] * x[k];
+			}
+			return res;
+		}
+
+		inline float32 dot_i8_scalar(const int8* w, const float32* x, std::size_t len)
+		{
+			auto res = 0.0f;
+			for (auto k = 0uz; k < len; ++k)
+			{
+				res += (float32)w[k] * x[k];
+			}
+			return res;
+		}
+
+		inline void gemm_f32_scalar(const float32* w, const float32* bias, std::size_t row_count, std::size_t col_count, const float32* x, float32* y, std::size_t lane_count)
+		{
+			for (auto r = 0uz; r < row_count; ++r)
+			{
+				auto* p_y = y + r * lane_count;
+				std::fill_n(p_y, lane_count, bias[r]);
+				for (auto k = 0uz; k < col_count; ++k)
+				{
+					auto  w_rk = w[r * col_count + k];
+					auto* p_x  = x + k * lane_count;
+					for (auto l = 0uz; l < lane_count; ++l)
+					{
+						p_y[l] += w_rk * p_x[l];
+					}
+				}
+			}
+		}
+
+		inline void lstm_cell_scalar(const float32* gates, float32* cell, float32* h, std::size_t count)
+		{
+			for (auto k = 0uz; k < count; ++k)
+			{
+				auto i	= fast_sigmoid(gates[k]);
+				auto f	= fast_sigmoid(gates[count + k]);
+				auto g	= fast_tanh(gates[2 * count + k]);
+				auto o	= fast_sigmoid(gates[3 * count + k]);
+				cell[k] = f * cell[k] + i * g;
+				h[k]	= o * fast_tanh(cell[k]);
+			}
+		}
+
+#if HMM_KERNEL_X86
+		HMM_TARGET_AVX2 inline float32 hsum(__m256 v)
+		{
+			auto lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+			lo		= _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+			lo		= _mm_add_ss(lo, _mm_movehdup_ps(lo));
+			return _mm_cvtss_f32(lo);
+		}
+
+		HMM_TARGET_AVX2 inline float32 dot_f32_avx2(const float32* w, const float32* x, std::size_t len)
+		{
+			auto acc0 = _mm256_setzero_ps();
+			auto acc1 = _mm256_setzero_ps();
+			auto k	  = 0uz;
+			for (; k + 16 <= len; k += 16)
+			{
+				acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(w + k), _mm256_loadu_ps(x + k), acc0);
+				acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(w + k + 8), _mm256_loadu_ps(x + k + 8), acc1);
+			}
+			for (; k + 8 <= len; k += 8)
+			{
+				acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(w + k), _mm256_loadu_ps(x + k), acc0);
+			}
+
+			auto res = hsum(_mm256_add_ps(acc0, acc1));
+			for (; k < len; ++k)
+			{
+				res += w[k] * x[k];
+			}
+			return res;
+		}
+
+		HMM_TARGET_AVX2 inline float32 dot_i8_avx2(const int8* w, const float32* x, std::size_t len)
+		{
+			auto acc0 = _mm256_setzero_ps();
+			auto acc1 = _mm256_setzero_ps();
+			auto k	  = 0uz;
+			for (; k + 16 <= len; k += 16)
+			{
+				// 16 int8 -> two 8 x int32 -> float32
+				auto q	   = _mm_loadu_si128((const __m128i*)(w + k));
+				auto w_lo  = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(q));
+				auto w_hi  = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(q, 8)));
+				acc0	   = _mm256_fmadd_ps(w_lo, _mm256_loadu_ps(x + k), acc0);
+				acc1	   = _mm256_fmadd_ps(w_hi, _mm256_loadu_ps(x + k + 8), acc1);
+			}
+			for (; k + 8 <= len; k += 8)
+			{
+				auto q = _mm_loadl_epi64((const __m128i*)(w + k));
+				acc0   = _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(q)), _mm256_loadu_ps(x + k), acc0);
+			}
+
+			auto res = hsum(_mm256_add_ps(acc0, acc1));
+			for (; k < len; ++k)
+			{
+				res += (float32)w[k] * x[k];
+			}
+			return res;
+		}
+
+		// 16 lanes of x (col_count x 64 bytes) stay in L1 while every row block of w passes over them.
+		// 4 rows x 2 vectors of accumulators, written out so they stay in registers without relying on unrolling
+		HMM_TARGET_AVX2 inline void gemm_f32_avx2(const float32* w, const float32* bias, std::size_t row_count, std::size_t col_count, const float32* x, float32* y, std::size_t lane_count)
+		{
+			auto l = 0uz;
+			for (; l + 16 <= lane_count; l += 16)
+			{
+				auto r = 0uz;
+				for (; r + 4 <= row_count; r += 4)
+				{
+					auto* w0   = w + r * col_count;
+					auto* w1   = w0 + col_count;
+					auto* w2   = w1 + col_count;
+					auto* w3   = w2 + col_count;
+					auto  acc0 = _mm256_set1_ps(bias[r]);
+					auto  acc1 = acc0;
+					auto  acc2 = _mm256_set1_ps(bias[r + 1]);
+					auto  acc3 = acc2;
+					auto  acc4 = _mm256_set1_ps(bias[r + 2]);
+					auto  acc5 = acc4;
+					auto  acc6 = _mm256_set1_ps(bias[r + 3]);
+					auto  acc7 = acc6;
+					for (auto k = 0uz; k < col_count; ++k)
+					{
+						auto x0 = _mm256_loadu_ps(x + k * lane_count + l);
+						auto x1 = _mm256_loadu_ps(x + k * lane_count + l + 8);
+						auto b0 = _mm256_broadcast_ss(w0 + k);
+						auto b1 = _mm256_broadcast_ss(w1 + k);
+						auto b2 = _mm256_broadcast_ss(w2 + k);
+						auto b3 = _mm256_broadcast_ss(w3 + k);
+						acc0	= _mm256_fmadd_ps(b0, x0, acc0);
+						acc1	= _mm256_fmadd_ps(b0, x1, acc1);
+						acc2	= _mm256_fmadd_ps(b1, x0, acc2);
+						acc3	= _mm256_fmadd_ps(b1, x1, acc3);
+						acc4	= _mm256_fmadd_ps(b2, x0, acc4);
+						acc5	= _mm256_fmadd_ps(b2, x1, acc5);
+						acc6	= _mm256_fmadd_ps(b3, x0, acc6);
+						acc7	= _mm256_fmadd_ps(b3, x1, acc7);
+					}
+
+					auto* p_y = y + r * lane_count + l;
+					_mm256_storeu_ps(p_y, acc0);
+					_mm256_storeu_ps(p_y + 8, acc1);
+					_mm256_storeu_ps(p_y + lane_count, acc2);
+					_mm256_storeu_ps(p_y + lane_count + 8, acc3);
+					_mm256_storeu_ps(p_y + 2 * lane_count, acc4);
+					_mm256_storeu_ps(p_y + 2 * lane_count + 8, acc5);
+					_mm256_storeu_ps(p_y + 3 * lane_count, acc6);
+					_mm256_storeu_ps(p_y + 3 * lane_count + 8, acc7);
+				}
+
+				for (; r < row_count; ++r)
+				{
+					auto acc0 = _mm256_set1_ps(bias[r]);
+					auto acc1 = acc0;
+					for (auto k = 0uz; k < col_count; ++k)
+					{
+						auto b = _mm256_broadcast_ss(w + r * col_count + k);
+						acc0   = _mm256_fmadd_ps(b, _mm256_loadu_ps(x + k * lane_count + l), acc0);
+						acc1   = _mm256_fmadd_ps(b, _mm256_loadu_ps(x + k * lane_count + l + 8), acc1);
+					}
+					_mm256_storeu_ps(y + r * lane_count + l, acc0);
+					_mm256_storeu_ps(y + r * lane_count + l + 8, acc1);
+				}
+			}
+
+			for (auto r = 0uz; r < row_count; ++r)
+			{
+				for (auto lane = l; lane < lane_count; ++lane)
+				{
+					auto sum = bias[r];
+					for (auto k = 0uz; k < col_count; ++k)
+					{
+						sum += w[r * col_count + k] * x[k * lane_count + lane];
+					}
+					y[r * lane_count + lane] = sum;
+				}
+			}
+		}
+
+		HMM_TARGET_AVX2 inline __m256 tanh_avx2(__m256 x)
+		{
+			x		= _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-7.90531110763549805f)), _mm256_set1_ps(7.90531110763549805f));
+			auto x2 = _mm256_mul_ps(x, x);
+
+			auto p = _mm256_fmadd_ps(x2, _mm256_set1_ps(-2.76076847742355e-16f), _mm256_set1_ps(2.00018790482477e-13f));
+			p	   = _mm256_fmadd_ps(x2, p, _mm256_set1_ps(-8.60467152213735e-11f));
+			p	   = _mm256_fmadd_ps(x2, p, _mm256_set1_ps(5.12229709037114e-08f));
+			p	   = _mm256_fmadd_ps(x2, p, _mm256_set1_ps(1.48572235717979e-05f));
+			p	   = _mm256_fmadd_ps(x2, p, _mm256_set1_ps(6.37261928875436e-04f));
+			p	   = _mm256_fmadd_ps(x2, p, _mm256_set1_ps(4.89352455891786e-03f));
+			p	   = _mm256_mul_ps(x, p);
+
+			auto q = _mm256_fmadd_ps(x2, _mm256_set1_ps(1.19825839466702e-06f), _mm256_set1_ps(1.18534705686654e-04f));
+			q	   = _mm256_fmadd_ps(x2, q, _mm256_set1_ps(2.26843463243900e-03f));
+			q	   = _mm256_fmadd_ps(x2, q, _mm256_set1_ps(4.89352518554385e-03f));
+
+			// p / q with the 12 bit reciprocal estimate and one newton step (~22 bits), a fraction of the cost of a divide
+			auto inv = _mm256_rcp_ps(q);
+			inv		 = _mm256_mul_ps(inv, _mm256_fnmadd_ps(q, inv, _mm256_set1_ps(2.0f)));
+			return _mm256_mul_ps(p, inv);
+		}
+
+		HMM_TARGET_AVX2 inline __m256 sigmoid_avx2(__m256 x)
+		{
+			auto half = _mm256_set1_ps(0.5f);
+			return _mm256_fmadd_ps(half, tanh_avx2(_mm256_mul_ps(half, x)), half);
+		}
+
+		HMM_TARGET_AVX2 inline void lstm_cell_avx2(const float32* gates, float32* cell, float32* h, std::size_t count)
+		{
+			auto k = 0uz;
+			for (; k + 8 <= count; k += 8)
+			{
+				auto i = sigmoid_avx2(_mm256_loadu_ps(gates + k));
+				auto f = sigmoid_avx2(_mm256_loadu_ps(gates + count + k));
+				auto g = tanh_avx2(_mm256_loadu_ps(gates + 2 * count + k));
+				auto o = sigmoid_avx2(_mm256_loadu_ps(gates + 3 * count + k));
+				auto c = _mm256_fmadd_ps(f, _mm256_loadu_ps(cell + k), _mm256_mul_ps(i, g));
+				_mm256_storeu_ps(cell + k, c);
+				_mm256_storeu_ps(h + k, _mm256_mul_ps(o, tanh_avx2(c)));
+			}
+
+			for (; k < count; ++k)
+			{
+				auto i	= fast_sigmoid(gates[k]);
+				auto f	= fast_sigmoid(gates[count + k]);
+				auto g	= fast_tanh(gates[2 * count + k]);
+				auto o	= fast_sigmoid(gates[3 * count + k]);
+				cell[k] = f * cell[k] + i * g;
+				h[k]	= o * fast_tanh(cell[k]);
+			}
+		}
+#endif
+	}	 // namespace detail
+
+	inline constexpr kernel_set scalar_set { kernel::isa::scalar, "scalar", detail::dot_f32_scalar, detail::dot_i8_scalar, detail::gemm_f32_scalar, detail::lstm_cell_scalar };
+
+#if HMM_KERNEL_X86
+	inline constexpr kernel_set avx2_set { kernel::isa::avx2, "avx2", detail::dot_f32_avx2, detail::dot_i8_avx2, detail::gemm_f32_avx2, detail::lstm_cell_avx2 };
+#endif
+
+	// kernel set for a given instruction set, nullptr if this cpu can not run it or there is none.
+	// rows of a delay model are a few dozen floats, 8 lanes already cover them, so there is no avx512 set.
+	inline const kernel_set* find(kernel::isa type)
+	{
+		if (not kernel::detail::cpu_supports(type))
+		{
+			return nullptr;
+		}
+
+		switch (type)
+		{
+#if HMM_KERNEL_X86
+		case kernel::isa::avx2:
+			return &avx2_set;
+#endif
+		case kernel::isa::scalar:
+			return &scalar_set;
+		default:
+			return nullptr;
+		}
+	}
+
+	inline const kernel_set& best()
+	{
+		static const auto* p_best = []() {
+			auto* p_set = nn_kernel::find(kernel::isa::avx2);
+			return p_set != nullptr ? p_set : &scalar_set;
+		}();
+
+		return *p_best;
+	}
+}	 // namespace nn_kernel
@@ -0,0 +1,223 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <ranges>
+#include <algorithm>
+#include <random>
+#include <cmath>
+#include <cassert>
+#include "common.h"
+#include "dyn_model.h"
+
+struct online_config
+{
+	// step size eta_t = max(min_step, (t + t0) ^ -kappa), kappa in (0.5, 1]
+	double64 kappa = 0.6;
+	double64 t0	   = 10.0;
+	// floor, so the model keeps tracking a link whose regime drifts
+	double64 min_step = 1e-3;
+};
+
+// online em for a discrete hmm, one sample at a time (stochastic approximation of the e-step, cappe & moulines style)
+// every sample : filter update, pair posterior P(q_t-1, q_t | O_1..t), decayed expected counts.
+// A and B are never stored, they are the row-normalized expected counts :
+//	A[i][j] = trans_stat[i][j] / trans_row[i], B[i][o] = emit_stat[i][o] / emit_row[i]
+// so the re-estimation is implicit and a sample costs O(state_count^2), memory is O(state_count * (state_count + observation_count)).
+// the decay is lazy : the stored counts are the real ones divided by stat_weight, and only stat_weight shrinks every sample.
+struct online_model
+{
+	std::size_t	  state_count;
+	std::size_t	  observation_count;
+	online_config config;
+
+	// state occupancy, decayed like the counts. starts the filter on the first sample and after a restart
+	std::vector<double64> pi;
+
+	// [state_count][state_count], expected transition counts / stat_weight
+	std::vector<double64> trans_stat;
+	std::vector<double64> trans_row;
+	// [state_count][observation_count], expected emission counts / stat_weight
+	std::vector<double64> emit_stat;
+	std::vector<double64> emit_row;
+	double64			  stat_weight = 1.0;
+
+	// P(q_t | O_1..t)
+	std::vector<double64> filter;
+	// scratch, [state_count]
+	std::vector<double64> u;
+	std::vector<double64> num;
+	std::vector<double64> b_o;
+
+	uint64	 sample_count	= 0;
+	// sum of log P(O_t | O_1..t-1), predictive log likelihood of everything seen so far
+	double64 log_likelihood = 0.0;
+
+	online_model(std::size_t state_count, std::size_t observation_count, online_config config = {})
+		: state_count(state_count), observation_count(observation_count), config(config),
+		  pi(state_count), trans_stat(state_count * state_count), trans_row(state_count),
+		  emit_stat(state_count * observation_count), emit_row(state_count),
+		  filter(state_count), u(state_count), num(state_count), b_o(state_count)
+	{
+	}
+
+	// start from an offline model, its A and B count as one sample worth of prior
+	void init(const dyn_model& hmm)
+	{
+		assert(hmm.state_count == state_count and hmm.observation_count == observation_count);
+		trans_stat	= hmm.A;
+		emit_stat	= hmm.B;
+		pi			= hmm.pi;
+		stat_weight = 1.0;
+		std::ranges::fill(trans_row, 1.0);
+		std::ranges::fill(emit_row, 1.0);
+		sample_count   = 0;
+		log_likelihood = 0.0;
+	}
+
+	// random start, deterministic for a given seed
+	void init_random(uint64 seed)
+	{
+		auto hmm = dyn_model(state_count, observation_count);
+		hmm.init_A_B_pi(seed);
+		init(hmm);
+	}
+
+	double64 a(std::size_t curr_state, std::size_t next_state) const { return trans_stat[curr_state * state_count + next_state] / trans_row[curr_state]; }
+
+	double64 b(std::size_t state, std::size_t observation) const { return emit_stat[state * observation_count + observation] / emit_row[state]; }
+
+	double64 step_size() const
+	{
+		return std::max(config.min_step, std::pow((double64)sample_count + config.t0, -config.kappa));
+	}
+
+	// one em step for the next observed symbol
+	void update(t_observation o)
+	{
+		assert(o < observation_count);
+
+		auto eta = step_size();
+		auto sum = 0.0;
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			b_o[state] = b(state, o);
+		}
+
+		if (sample_count == 0)
+		{
+			for (auto state : std::views::iota(0uz, state_count))
+			{
+				num[state]	= pi[state] * b_o[state];
+				sum		   += num[state];
+			}
+		}
+		else
+		{
+			// predictive P(q_t = j | O_1..t-1) = sum_i filter[i] * A[i][j], times b_j(o)
+			for (auto curr_state : std::views::iota(0uz, state_count))
+			{
+				u[curr_state] = filter[curr_state] / trans_row[curr_state];
+			}
+
+			std::ranges::fill(num, 0.0);
+			for (auto curr_state : std::views::iota(0uz, state_count))
+			{
+				auto* p_row = &trans_stat[curr_state * state_count];
+				for (auto next_state : std::views::iota(0uz, state_count))
+				{
+					num[next_state] += u[curr_state] * p_row[next_state];
+				}
+			}
+
+			for (auto state : std::views::iota(0uz, state_count))
+			{
+				num[state]	*= b_o[state];
+				sum			+= num[state];
+			}
+		}
+
+		if (sum <= 0.0 or not std::isfinite(sum))
+		{
+			// the model gave this symbol no mass, restart the filter from pi
+			std::ranges::copy(pi, filter.begin());
+			++sample_count;
+			return;
+		}
+
+		log_likelihood += std::log(sum);
+
+		// decay every count by (1 - eta) lazily, then add eta * (this sample's expected counts)
+		stat_weight *= (1.0 - eta);
+		auto gain	 = eta / stat_weight;
+
+		if (sample_count > 0)
+		{
+			// xi(i, j) = filter[i] * A[i][j] * b_j(o) / sum, applied in place :
+			//	trans_stat[i][j] += gain * xi(i, j) == trans_stat[i][j] * (1 + gain * u[i] * b_j(o) / sum)
+			for (auto curr_state : std::views::iota(0uz, state_count))
+			{
+				auto* p_row	  = &trans_stat[curr_state * state_count];
+				auto  coef	  = gain * u[curr_state] / sum;
+				auto  row_add = 0.0;
+				for (auto next_state : std::views::iota(0uz, state_count))
+				{
+					auto add		  = coef * p_row[next_state] * b_o[next_state];
+					p_row[next_state] += add;
+					row_add			  += add;
+				}
+				trans_row[curr_state] += row_add;
+			}
+		}
+
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			filter[state]								 = num[state] / sum;
+			emit_stat[state * observation_count + o]	+= gain * filter[state];
+			emit_row[state]								+= gain * filter[state];
+			pi[state]									 = (1.0 - eta) * pi[state] + eta * filter[state];
+		}
+
+		if (stat_weight < 1e-100)
+		{
+			_rescale();
+		}
+
+		++sample_count;
+	}
+
+	// current lambda as a regular model, for viterbi / saving
+	dyn_model to_model() const
+	{
+		auto hmm = dyn_model(state_count, observation_count);
+		for (auto curr_state : std::views::iota(0uz, state_count))
+		{
+			for (auto next_state : std::views::iota(0uz, state_count))
+			{
+				hmm.a(curr_state, next_state) = a(curr_state, next_state);
+			}
+
+			for (auto o : std::views::iota(0uz, observation_count))
+			{
+				hmm.b(curr_state, o) = b(curr_state, o);
+			}
+		}
+
+		hmm.pi = pi;
+		return hmm;
+	}
+
+  private:
+	// fold stat_weight back into the counts before it underflows
+	void _rescale()
+	{
+		for (auto* p_table : { &trans_stat, &trans_row, &emit_stat, &emit_row })
+		{
+			for (auto& val : *p_table)
+			{
+				val *= stat_weight;
+			}
+		}
+
+		stat_weight = 1.0;
+	}
+};
@@ -0,0 +1,239 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <ranges>
+#include <algorithm>
+#include <memory>
+#include <variant>
+#include <string>
+#include <concepts>
+#include <cmath>
+#include <cassert>
+#include "common.h"
+#include "dyn_model.h"
+#include "trainer.h"
+#include "discretizer.h"
+#include "stream_filter.h"
+#include "lstm_model.h"
+
+// one delay forecaster : update(x) feeds the delay just observed, predict(k) returns the expected delay k samples
+// after the last one fed, k >= 1. predict never changes what later updates see.
+template <typename t>
+concept predictor = requires(t p, double64 x, std::size_t k) {
+	{ p.update(x) };
+	{ p.predict(k) } -> std::convertible_to<double64>;
+};
+
+// exponentially weighted moving average, the forecast is the level for every k
+struct ewma_predictor
+{
+	double64 alpha;
+	double64 level		 = 0.0;
+	bool	 initialized = false;
+
+	explicit ewma_predictor(double64 alpha = 0.1) : alpha(alpha) { }
+
+	void update(double64 x)
+	{
+		level		= initialized ? level + alpha * (x - level) : x;
+		initialized = true;
+	}
+
+	double64 predict(std::size_t) const { return level; }
+};
+
+// local level model : level_t = level_t-1 + w (process_var), x_t = level_t + v (measurement_var).
+// the forecast of a random walk is its current estimate for every k, only its variance grows with k
+struct kalman_predictor
+{
+	double64 process_var;
+	double64 measurement_var;
+	double64 level		 = 0.0;
+	double64 level_var	 = 0.0;
+	bool	 initialized = false;
+
+	kalman_predictor(double64 process_var, double64 measurement_var) : process_var(process_var), measurement_var(measurement_var) { }
+
+	// measurement_var from the spread of the warm-up data, process_var a fraction of it
+	static kalman_predictor fit(std::span<const double64> values, double64 process_ratio = 0.05)
+	{
+		auto mean = 0.0;
+		for (auto x : values)
+		{
+			mean += x;
+		}
+		mean /= (double64)std::max(values.size(), 1uz);
+
+		auto var = 0.0;
+		for (auto x : values)
+		{
+			var += (x - mean) * (x - mean);
+		}
+		var = std::max(var / (double64)std::max(values.size(), 1uz), 1e-12);
+		return kalman_predictor(var * process_ratio, var);
+	}
+
+	void update(double64 x)
+	{
+		if (not initialized)
+		{
+			level		= x;
+			level_var	= measurement_var;
+			initialized = true;
+			return;
+		}
+
+		auto prior_var = level_var + process_var;
+		auto gain	   = prior_var / (prior_var + measurement_var);
+		level		  += gain * (x - level);
+		level_var	   = (1.0 - gain) * prior_var;
+	}
+
+	double64 predict(std::size_t) const { return level; }
+};
+
+// discrete hmm on binned delays : the filter's k step symbol distribution, each symbol worth the mean training delay of its bin
+struct hmm_predictor
+{
+	// heap, the filter points into it and the predictor moves
+	std::unique_ptr<dyn_model> p_model;
+	discretizer				   binning;
+	std::vector<double64>	   symbol_value;
+	stream_filter			   filter;
+	std::vector<double64>	   forecast;
+
+	hmm_predictor(std::unique_ptr<dyn_model> model, discretizer bins, std::vector<double64> values)
+		: p_model(std::move(model)), binning(std::move(bins)), symbol_value(std::move(values)), filter(*p_model), forecast(p_model->observation_count)
+	{
+		assert(symbol_value.size() == p_model->observation_count);
+	}
+
+	// equal-mass bins and baum-welch on the warm-up data, single threaded so it can run inside a pool task
+	static hmm_predictor fit(std::span<const double64> values, std::size_t state_count, std::size_t symbol_count, const train_config& config = {}, uint64 seed = 42)
+	{
+		auto sketch = quantile_sketch();
+		for (auto x : values)
+		{
+			sketch.add(x);
+		}
+
+		auto bins		  = discretizer::quantile(sketch, symbol_count);
+		auto observations = std::vector<t_observation>(values.size());
+		bins.batch(values, observations);
+
+		auto model = std::make_unique<dyn_model>(state_count, bins.symbol_count());
+		model->init_A_B_pi(seed);
+		model->edges = bins.edges;
+
+		auto stats = suff_stats(model->state_count, model->observation_count);
+		run_em(observations.size(), config, [&]() {
+			stats.clear();
+			for (auto seq : em_trainer::split(observations, 1024))
+			{
+				model->update_observations(seq);
+				model->e_step(stats);
+			}
+
+			if (stats.sequence_count > 0)
+			{
+				model->m_step(stats);
+			}
+			return stats.log_likelihood;
+		});
+
+		// mean delay of every bin, empty bins take their nearest edge
+		auto sum   = std::vector<double64>(bins.symbol_count(), 0.0);
+		auto count = std::vector<std::size_t>(bins.symbol_count(), 0);
+		for (auto t : std::views::iota(0uz, values.size()))
+		{
+			sum[observations[t]] += values[t];
+			++count[observations[t]];
+		}
+		for (auto o : std::views::iota(0uz, sum.size()))
+		{
+			if (count[o] > 0)
+			{
+				sum[o] /= (double64)count[o];
+			}
+			else if (not bins.edges.empty())
+			{
+				sum[o] = bins.edges[std::min(o, bins.edges.size() - 1)];
+			}
+		}
+
+		return hmm_predictor(std::move(model), std::move(bins), std::move(sum));
+	}
+
+	void update(double64 x) { filter.update(binning(x)); }
+
+	double64 predict(std::size_t k)
+	{
+		if (filter.sample_count == 0)
+		{
+			return 0.0;
+		}
+
+		filter.predict(std::max(k, 1uz), forecast);
+		auto res = 0.0;
+		for (auto o : std::views::iota(0uz, forecast.size()))
+		{
+			res += forecast[o] * symbol_value[o];
+		}
+		return res;
+	}
+};
+
+// windowed lstm of the notebook, k > 1 feeds its own forecasts back into the window
+struct lstm_predictor
+{
+	// shared, read only, many predictors run one model
+	std::shared_ptr<const lstm_model> p_model;
+	lstm_workspace					  workspace;
+	// last window_size delays, oldest first
+	std::vector<double64>			  window;
+	std::vector<double64>			  rollout;
+	std::size_t						  sample_count = 0;
+
+	explicit lstm_predictor(std::shared_ptr<const lstm_model> model) : p_model(std::move(model)), window(p_model->window_size, 0.0) { }
+
+	void update(double64 x)
+	{
+		std::shift_left(window.begin(), window.end(), 1);
+		window.back() = x;
+		++sample_count;
+	}
+
+	double64 predict(std::size_t k)
+	{
+		// until the window is full the last delay is the best there is
+		if (sample_count < window.size())
+		{
+			return sample_count == 0 ? 0.0 : window.back();
+		}
+
+		rollout		 = window;
+		auto next	 = 0.0;
+		for (auto _ : std::views::iota(0uz, std::max(k, 1uz)))
+		{
+			p_model->predict_next(rollout, { &next, 1 }, workspace);
+			std::shift_left(rollout.begin(), rollout.end(), 1);
+			rollout.back() = next;
+		}
+		return next;
+	}
+};
+
+static_assert(predictor<ewma_predictor> and predictor<kalman_predictor> and predictor<hmm_predictor> and predictor<lstm_predictor>);
+
+// every predictor behind one type, dispatched without virtual calls or a heap allocation per predictor
+using any_predictor = std::variant<ewma_predictor, kalman_predictor, hmm_predictor, lstm_predictor>;
+
+inline void update(any_predictor& p, double64 x)
+{
+	std::visit([x](auto& impl) { impl.update(x); }, p);
+}
+
+inline double64 predict(any_predictor& p, std::size_t k)
+{
+	return std::visit([k](auto& impl) { return (double64)impl.predict(k); }, p);
+}
@@ -0,0 +1,224 @@
+#pragma once
+#include <vector>
+#include <array>
+#include <ranges>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <functional>
+#include <utility>
+#include <cstdio>
+#include <exception>
+#include "common.h"
+
+// quiescent state based reclamation (qsbr flavour of rcu)
+// readers never lock, count or write on the read path : they load the published pointer with acquire and use it.
+// instead every reader thread says now and then that it holds no pointer anymore, quiescent(), or that it will not
+// read for a while, offline() (a thread about to block on i/o). a writer publishes a new version with one exchange
+// and retires the old one tagged with a bumped epoch, the old one is deleted once every online reader has been
+// quiescent in that epoch or later : nobody can still be looking at it.
+//
+//	reader thread				writer (any thread, rare)
+//	auto reader = domain.reader();
+//	loop :						domain.publish(slot, std::make_unique<const t>(...));
+//		reader.offline();		domain.reclaim();			// frees what is past its grace period, never blocks
+//		block on i/o			or domain.synchronize();	// waits for the grace period, then frees
+//		reader.online();
+//		auto* p = slot.load();
+//		...
+//		reader.quiescent();
+struct rcu_domain
+{
+	static constexpr std::size_t max_reader_count = 64;
+
+	// epoch the reader announced, 0 offline or unused
+	struct alignas(64) reader_slot
+	{
+		std::atomic<uint64> epoch = 0;
+		std::atomic<bool>	used  = false;
+	};
+
+	struct retired
+	{
+		uint64				  epoch;
+		std::function<void()> destroy;
+	};
+
+	struct reader_handle
+	{
+		rcu_domain* p_domain = nullptr;
+		std::size_t idx		 = 0;
+
+		reader_handle() = default;
+
+		reader_handle(rcu_domain& domain, std::size_t idx) : p_domain(&domain), idx(idx) { online(); }
+
+		reader_handle(reader_handle&& other) noexcept : p_domain(std::exchange(other.p_domain, nullptr)), idx(other.idx) { }
+
+		reader_handle& operator=(reader_handle&& other) noexcept
+		{
+			release();
+			p_domain = std::exchange(other.p_domain, nullptr);
+			idx		 = other.idx;
+			return *this;
+		}
+
+		~reader_handle() { release(); }
+
+		// no pointer loaded before this call is used after it
+		void quiescent() { p_domain->readers[idx].epoch.store(p_domain->epoch.load(std::memory_order_acquire), std::memory_order_release); }
+
+		// no pointer is held and none is loaded until online()
+		void offline() { p_domain->readers[idx].epoch.store(0, std::memory_order_release); }
+
+		// the fence orders the announcement before the loads that follow : a writer that saw this reader offline
+		// has already published, so those loads see the new version
+		void online()
+		{
+			quiescent();
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+		}
+
+		void release()
+		{
+			if (p_domain != nullptr)
+			{
+				offline();
+				p_domain->readers[idx].used.store(false, std::memory_order_release);
+				p_domain = nullptr;
+			}
+		}
+	};
+
+	std::atomic<uint64>						  epoch = 1;
+	std::array<reader_slot, max_reader_count> readers;
+	std::mutex								  retire_mutex;
+	std::vector<retired>					  retired_list;
+	std::atomic<uint64>						  reclaimed_count = 0;
+
+	rcu_domain() = default;
+
+	rcu_domain(const rcu_domain&)			 = delete;
+	rcu_domain& operator=(const rcu_domain&) = delete;
+
+	// every reader is gone by now, nothing retired can be in use
+	~rcu_domain()
+	{
+		for (auto& entry : retired_list)
+		{
+			entry.destroy();
+		}
+	}
+
+	// one per reader thread, online from the start. more than max_reader_count at once is a bug of the caller and ends
+	// the process in every build : a handle without a slot has nothing to announce its epoch in
+	reader_handle reader()
+	{
+		for (auto idx : std::views::iota(0uz, max_reader_count))
+		{
+			auto expected = false;
+			if (readers[idx].used.compare_exchange_strong(expected, true, std::memory_order_acq_rel))
+			{
+				return reader_handle(*this, idx);
+			}
+		}
+
+		std::fputs("rcu_domain : out of reader slots\n", stderr);
+		std::terminate();
+	}
+
+	// whatever destroy() frees is unreachable from now on, it runs once the readers that could have loaded it moved on
+	void retire(std::function<void()> destroy)
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto tag  = epoch.fetch_add(1, std::memory_order_acq_rel) + 1;
+		auto lock = std::lock_guard(retire_mutex);
+		retired_list.push_back({ tag, std::move(destroy) });
+	}
+
+	// epoch every online reader reached, retired entries tagged at or below it are free to go
+	uint64 safe_epoch() const
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto res = epoch.load(std::memory_order_acquire);
+		for (auto& slot : readers)
+		{
+			auto reader_epoch = slot.epoch.load(std::memory_order_acquire);
+			if (reader_epoch != 0)
+			{
+				res = std::min(res, reader_epoch);
+			}
+		}
+		return res;
+	}
+
+	// destroys everything past its grace period, returns how many. never waits on a reader
+	std::size_t reclaim()
+	{
+		auto safe  = safe_epoch();
+		auto ready = std::vector<retired> {};
+		{
+			auto lock = std::lock_guard(retire_mutex);
+			auto it	  = std::ranges::partition(retired_list, [safe](const retired& entry) { return entry.epoch > safe; }).begin();
+			std::move(it, retired_list.end(), std::back_inserter(ready));
+			retired_list.erase(it, retired_list.end());
+		}
+
+		for (auto& entry : ready)
+		{
+			entry.destroy();
+		}
+		reclaimed_count += ready.size();
+		return ready.size();
+	}
+
+	// waits until everything retired so far is destroyed. not from a reader thread that is online
+	void synchronize()
+	{
+		auto target = epoch.load(std::memory_order_acquire);
+		while (safe_epoch() < target)
+		{
+			std::this_thread::yield();
+		}
+		reclaim();
+	}
+
+	std::size_t pending_count()
+	{
+		auto lock = std::lock_guard(retire_mutex);
+		return retired_list.size();
+	}
+
+	// swaps the version readers see, the previous one is retired
+	template <typename t>
+	void publish(std::atomic<const t*>& slot, std::unique_ptr<const t> p_new)
+	{
+		auto* p_old = slot.exchange(p_new.release(), std::memory_order_acq_rel);
+		if (p_old != nullptr)
+		{
+			retire([p_old]() { delete p_old; });
+		}
+	}
+};
+
+// a published version, one acquire load to read
+template <typename t>
+struct rcu_ptr
+{
+	std::atomic<const t*> p_value = nullptr;
+
+	rcu_ptr() = default;
+
+	rcu_ptr(const rcu_ptr&)			   = delete;
+	rcu_ptr& operator=(const rcu_ptr&) = delete;
+
+	// readers are gone by now
+	~rcu_ptr() { delete p_value.load(std::memory_order_acquire); }
+
+	// valid until the calling reader's next quiescent() or offline()
+	const t* load() const { return p_value.load(std::memory_order_acquire); }
+
+	void publish(rcu_domain& domain, std::unique_ptr<const t> p_new) { domain.publish(p_value, std::move(p_new)); }
+};
@@ -0,0 +1,123 @@
+#include <cstdio>
+#include <string_view>
+#include <algorithm>
+#include <ranges>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include "common.h"
+#include "rcu.h"
+
+// rcu stress : reader threads load the published model and check it on every read while a writer swaps versions
+// back to back. a version poisons itself when destroyed, so a reader that sees poison or a version going backwards
+// caught a use after free
+namespace
+{
+	auto failures = 0;
+
+	void check(bool ok, std::string_view what)
+	{
+		std::printf("%s %.*s\n", ok ? "ok  " : "FAIL", (int)what.size(), what.data());
+		failures += ok ? 0 : 1;
+	}
+
+	// one published model version, poisoned when destroyed
+	struct rcu_version
+	{
+		static inline std::atomic<int64> live = 0;
+
+		uint64				number;
+		std::vector<uint64> payload;
+		std::atomic<uint64> canary = 0x600d600d600d600dull;
+
+		explicit rcu_version(uint64 number) : number(number), payload(64, number) { ++live; }
+
+		~rcu_version()
+		{
+			canary = 0xdeaddeaddeaddeadull;
+			std::ranges::fill(payload, ~0ull);
+			--live;
+		}
+	};
+
+	// also reports the worst single read, which would show any stall behind the writer
+	void stress(std::size_t reader_count, double64 seconds)
+	{
+		auto domain	   = rcu_domain {};
+		auto published = rcu_ptr<rcu_version> {};
+		published.publish(domain, std::make_unique<const rcu_version>(0));
+
+		auto running  = std::atomic<bool>(true);
+		auto errors	  = std::atomic<uint64>(0);
+		auto reads	  = std::atomic<uint64>(0);
+		auto worst_ns = std::vector<double64>(reader_count, 0.0);
+		auto readers  = std::vector<std::thread> {};
+		for (auto reader_idx : std::views::iota(0uz, reader_count))
+		{
+			readers.emplace_back([&, reader_idx]() {
+				auto reader = domain.reader();
+				auto last	= 0ull;
+				auto count	= 0ull;
+				while (running.load(std::memory_order_relaxed))
+				{
+					auto  begin = std::chrono::steady_clock::now();
+					auto* p	    = published.load();
+					auto  sum	= 0ull;
+					for (auto x : p->payload)
+					{
+						sum += x;
+					}
+					if (p->canary.load(std::memory_order_relaxed) != 0x600d600d600d600dull or sum != p->number * p->payload.size() or p->number < last)
+					{
+						++errors;
+					}
+					last = p->number;
+					reader.quiescent();
+					worst_ns[reader_idx] = std::max(worst_ns[reader_idx], std::chrono::duration<double64, std::nano>(std::chrono::steady_clock::now() - begin).count());
+
+					// now and then go offline like a receive thread waiting on the socket
+					if (++count % 1024 == 0)
+					{
+						reader.offline();
+						std::this_thread::yield();
+						reader.online();
+					}
+				}
+				reads += count;
+			});
+		}
+
+		auto publish_count = 0ull;
+		auto begin		   = std::chrono::steady_clock::now();
+		while (std::chrono::duration<double64>(std::chrono::steady_clock::now() - begin).count() < seconds)
+		{
+			published.publish(domain, std::make_unique<const rcu_version>(++publish_count));
+			domain.reclaim();
+		}
+		running = false;
+		for (auto& thread : readers)
+		{
+			thread.join();
+		}
+		domain.synchronize();
+
+		std::printf("rcu %zu readers, %.1f s | %llu reads, %llu versions published | worst read %.1f us\n", reader_count, seconds,
+					(unsigned long long)reads.load(), (unsigned long long)publish_count, std::ranges::max(worst_ns) / 1e3);
+		check(errors == 0, "no reader saw a destroyed or older version");
+		check(reads > 0 and publish_count > 0, "readers and writer both made progress");
+		check(rcu_version::live == 1, "only the published version is alive after synchronize");
+		check(domain.reclaimed_count == publish_count, "every replaced version was reclaimed");
+		check(domain.pending_count() == 0, "nothing is left retired after synchronize");
+	}
+}	 // namespace
+
+int main()
+{
+	stress(3, 1.0);
+	check(rcu_version::live == 0, "the published version goes with its rcu_ptr");
+
+	std::printf("%d failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <ranges>
+#include <algorithm>
+#include <optional>
+#include <cmath>
+#include <cassert>
+#include "common.h"
+#include "dyn_model.h"
+
+// fixed-lag viterbi on an endless stream
+// update() runs one max-plus step and, once lag samples are buffered, traces back lag steps from the best state now
+// and emits the state of time t - lag. memory is the log delta row plus a ring of the last lag psi rows.
+// a decision is final when emitted : later samples can not change it, so with a short lag a decision can
+// disagree with what full viterbi over the whole stream would pick. lag of a few times the expected dwell time makes that rare.
+struct stream_decoder
+{
+	dyn_model*	p_model = nullptr;
+	std::size_t state_count;
+	std::size_t lag;
+
+	std::vector<double64> log_A;
+	// [observation_count][state_count]
+	std::vector<double64> log_Bt;
+	std::vector<double64> log_pi;
+
+	// log delta of the newest sample, shifted so its max is 0
+	std::vector<double64> delta;
+	std::vector<double64> delta_next;
+	// [lag + 1][state_count], psi of time t lives in slot t % (lag + 1)
+	std::vector<t_state> psi;
+
+	uint64 sample_count = 0;
+
+	stream_decoder(dyn_model& hmm, std::size_t lag = 16)
+		: state_count(hmm.state_count), lag(lag),
+		  delta(hmm.state_count), delta_next(hmm.state_count), psi((lag + 1) * hmm.state_count)
+	{
+		set_model(hmm);
+	}
+
+	// new parameters (same dimensions), decoding continues from the current delta
+	void set_model(dyn_model& hmm)
+	{
+		assert(hmm.state_count == state_count);
+		p_model = &hmm;
+		hmm.update_layout();
+		log_A  = dyn_model::log_table(hmm.A);
+		log_Bt = dyn_model::log_table(hmm.Bt);
+		log_pi = dyn_model::log_table(hmm.pi);
+	}
+
+	void reset() { sample_count = 0; }
+
+	// state of time sample_count - 1 - lag once it is decided
+	std::optional<t_state> update(t_observation o)
+	{
+		auto* p_log_b = &log_Bt[o * state_count];
+		if (sample_count == 0)
+		{
+			for (auto state : std::views::iota(0uz, state_count))
+			{
+				delta[state] = log_pi[state] + p_log_b[state];
+			}
+		}
+		else
+		{
+			p_model->p_kernels->viterbi_step_log(log_A.data(), delta.data(), p_log_b, delta_next.data(), &psi[(sample_count % (lag + 1)) * state_count], state_count);
+			std::swap(delta, delta_next);
+		}
+
+		// only differences matter, keep the numbers small
+		auto max = std::ranges::max(delta);
+		if (std::isfinite(max))
+		{
+			for (auto& val : delta)
+			{
+				val -= max;
+			}
+		}
+
+		++sample_count;
+		if (sample_count <= lag)
+		{
+			return std::nullopt;
+		}
+
+		return _trace_back(lag);
+	}
+
+	// best guess for the newest sample, lag 0
+	t_state current() const { return (t_state)(std::ranges::max_element(delta) - delta.begin()); }
+
+	// end of stream : the states still held back, oldest first, min(lag, sample_count) of them
+	std::vector<t_state> flush() const
+	{
+		auto count = (std::size_t)std::min<uint64>(lag, sample_count);
+		auto res   = std::vector<t_state>(count);
+		if (count == 0)
+		{
+			return res;
+		}
+
+		auto state		   = current();
+		res[count - 1]	   = state;
+		auto newest		   = sample_count - 1;
+		for (auto back : std::views::iota(1uz, count))
+		{
+			state			   = psi[((newest - back + 1) % (lag + 1)) * state_count + state];
+			res[count - 1 - back] = state;
+		}
+		return res;
+	}
+
+  private:
+	t_state _trace_back(std::size_t steps) const
+	{
+		auto state = current();
+		auto slot  = (std::size_t)((sample_count - 1) % (lag + 1));
+		for (auto _ : std::views::iota(0uz, steps))
+		{
+			state = psi[slot * state_count + state];
+			slot  = slot == 0 ? lag : slot - 1;
+		}
+		return state;
+	}
+};
@@ -0,0 +1,193 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <ranges>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <cassert>
+#include "common.h"
+#include "dyn_model.h"
+
+// streaming inference on a fixed lambda, one sample at a time
+//	update()		: filter P(q_t | O_1..t), O(state_count^2)
+//	smoothed()		: fixed-lag smoothed P(q_t-lag | O_1..t), O(lag * state_count^2)
+//	predict()		: k-step ahead P(o_t+k | O_1..t) over the observation bins, O(k * state_count^2 + state_count * observation_count)
+// the last lag + 1 filtered rows are kept in a ring, nothing grows with the stream.
+// uses the transposed tables of the model, so call set_model() again after its parameters change.
+struct stream_filter
+{
+	dyn_model*	p_model = nullptr;
+	std::size_t state_count;
+	std::size_t lag;
+
+	// [lag + 1][state_count], filtered row of time t lives in slot t % (lag + 1)
+	std::vector<double64>	   history;
+	std::vector<t_observation> history_obs;
+
+	uint64	 sample_count	= 0;
+	// sum of log P(o_t | O_1..t-1)
+	double64 log_likelihood = 0.0;
+
+	// scratch, [state_count]
+	std::vector<double64> beta;
+	std::vector<double64> beta_next;
+	std::vector<double64> state_dist;
+	std::vector<double64> state_next;
+	std::vector<double64> ones;
+
+	stream_filter(dyn_model& hmm, std::size_t lag = 4)
+		: state_count(hmm.state_count), lag(lag),
+		  history((lag + 1) * hmm.state_count), history_obs(lag + 1),
+		  beta(hmm.state_count), beta_next(hmm.state_count), state_dist(hmm.state_count), state_next(hmm.state_count), ones(hmm.state_count, 1.0)
+	{
+		set_model(hmm);
+	}
+
+	// new parameters (same dimensions), the filter keeps going from where it is
+	void set_model(dyn_model& hmm)
+	{
+		assert(hmm.state_count == state_count);
+		p_model = &hmm;
+		p_model->update_layout();
+	}
+
+	void reset()
+	{
+		sample_count   = 0;
+		log_likelihood = 0.0;
+	}
+
+	// filter step for the next symbol, returns log P(o_t | O_1..t-1)
+	double64 update(t_observation o)
+	{
+		auto& hmm	 = *p_model;
+		auto* p_curr = _row(sample_count);
+		auto  sum	 = 0.0;
+		if (sample_count == 0)
+		{
+			for (auto state : std::views::iota(0uz, state_count))
+			{
+				p_curr[state]  = hmm.pi[state] * hmm.b(state, o);
+				sum			  += p_curr[state];
+			}
+		}
+		else
+		{
+			sum = hmm.p_kernels->forward_step(hmm.A.data(), _row(sample_count - 1), hmm.b_col(o), p_curr, state_count);
+		}
+
+		history_obs[sample_count % (lag + 1)] = o;
+		++sample_count;
+
+		if (sum <= 0.0 or not std::isfinite(sum))
+		{
+			// the model gave this symbol no mass, start over from pi
+			std::ranges::copy(hmm.pi, p_curr);
+			return -std::numeric_limits<double64>::infinity();
+		}
+
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			p_curr[state] /= sum;
+		}
+
+		log_likelihood += std::log(sum);
+		return std::log(sum);
+	}
+
+	// P(q_t | O_1..t)
+	std::span<const double64> filtered() const
+	{
+		assert(sample_count > 0);
+		return { _row(sample_count - 1), state_count };
+	}
+
+	std::size_t most_likely_state() const
+	{
+		auto row = filtered();
+		return std::ranges::max_element(row) - row.begin();
+	}
+
+	// P(q_t-lag | O_1..t), or of the first sample while fewer than lag + 1 were seen
+	std::span<const double64> smoothed()
+	{
+		assert(sample_count > 0);
+		auto& hmm	 = *p_model;
+		auto  newest = sample_count - 1;
+		auto  oldest = sample_count > lag ? sample_count - 1 - lag : 0;
+
+		// beta over the window, normalized every step, only its shape matters
+		std::ranges::fill(beta, 1.0);
+		for (auto t = newest; t > oldest; --t)
+		{
+			std::swap(beta, beta_next);
+			hmm.p_kernels->backward_step(hmm.At.data(), beta_next.data(), hmm.b_col(history_obs[t % (lag + 1)]), 1.0, beta.data(), state_count);
+			_normalize(beta);
+		}
+
+		auto* p_alpha = _row(oldest);
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			state_dist[state] = p_alpha[state] * beta[state];
+		}
+
+		_normalize(state_dist);
+		return state_dist;
+	}
+
+	// P(q_t+k | O_1..t)
+	std::span<const double64> predict_state(std::size_t k)
+	{
+		auto& hmm = *p_model;
+		std::ranges::copy(filtered(), state_dist.begin());
+		for (auto _ : std::views::iota(0uz, k))
+		{
+			// forward step with b_o = 1 is one multiplication by A
+			hmm.p_kernels->forward_step(hmm.A.data(), state_dist.data(), ones.data(), state_next.data(), state_count);
+			std::swap(state_dist, state_next);
+		}
+
+		return state_dist;
+	}
+
+	// P(o_t+k | O_1..t) into out[observation_count], k >= 1 for the next sample
+	void predict(std::size_t k, std::span<double64> out)
+	{
+		auto& hmm = *p_model;
+		assert(out.size() == hmm.observation_count);
+
+		auto dist = predict_state(k);
+		std::ranges::fill(out, 0.0);
+		for (auto state : std::views::iota(0uz, state_count))
+		{
+			auto* p_row = &hmm.B[state * hmm.observation_count];
+			for (auto o : std::views::iota(0uz, hmm.observation_count))
+			{
+				out[o] += dist[state] * p_row[o];
+			}
+		}
+	}
+
+  private:
+	double64* _row(uint64 t) { return &history[(t % (lag + 1)) * state_count]; }
+
+	const double64* _row(uint64 t) const { return &history[(t % (lag + 1)) * state_count]; }
+
+	static void _normalize(std::span<double64> row)
+	{
+		auto sum = 0.0;
+		for (auto val : row)
+		{
+			sum += val;
+		}
+
+		if (sum > 0.0)
+		{
+			for (auto& val : row)
+			{
+				val /= sum;
+			}
+		}
+	}
+};
@@ -0,0 +1,163 @@
+#pragma once
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <ranges>
+#include "common.h"
+
+// work-stealing thread pool
+// every worker owns a deque : it takes its own tasks from the back (most recently pushed, still in cache)
+// and, when that runs dry, steals from the front of the other workers' deques.
+// tasks get the index of the worker running them, so callers can keep per-worker scratch buffers.
+struct thread_pool
+{
+	using t_task = std::function<void(std::size_t worker_idx)>;
+
+	struct worker_queue
+	{
+		std::mutex			mutex;
+		std::deque<t_task> tasks;
+	};
+
+	std::vector<std::unique_ptr<worker_queue>> queues;
+	std::vector<std::thread>				   workers;
+
+	std::mutex				 wake_mutex;
+	std::condition_variable	 wake_cv;
+	std::condition_variable	 done_cv;
+	std::atomic<std::size_t> queued		= 0;	// pushed, not taken yet
+	std::atomic<std::size_t> unfinished = 0;	// pushed, not finished yet
+	std::atomic<std::size_t> next_queue = 0;
+	bool					 running	= true;
+
+	explicit thread_pool(std::size_t worker_count = std::thread::hardware_concurrency())
+	{
+		worker_count = std::max(worker_count, 1uz);
+		for (auto _ : std::views::iota(0uz, worker_count))
+		{
+			queues.emplace_back(std::make_unique<worker_queue>());
+		}
+
+		for (auto worker_idx : std::views::iota(0uz, worker_count))
+		{
+			workers.emplace_back([this, worker_idx]() { _worker_loop(worker_idx); });
+		}
+	}
+
+	~thread_pool()
+	{
+		wait();
+		{
+			auto lock = std::lock_guard(wake_mutex);
+			running	  = false;
+		}
+		wake_cv.notify_all();
+
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	thread_pool(const thread_pool&)			   = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	std::size_t size() const { return workers.size(); }
+
+	// tasks are spread round robin, idle workers steal the rest
+	void submit(t_task task)
+	{
+		++unfinished;
+		auto& queue = *queues[next_queue++ % queues.size()];
+		{
+			auto lock = std::lock_guard(queue.mutex);
+			queue.tasks.emplace_back(std::move(task));
+		}
+		{
+			auto lock = std::lock_guard(wake_mutex);
+			++queued;
+		}
+		wake_cv.notify_one();
+	}
+
+	// block until every submitted task finished, must not be called from a task
+	void wait()
+	{
+		auto lock = std::unique_lock(wake_mutex);
+		done_cv.wait(lock, [this]() { return unfinished == 0; });
+	}
+
+	// func(idx, worker_idx) for idx in [0, count), returns when all of them are done
+	void parallel_for(std::size_t count, const std::function<void(std::size_t idx, std::size_t worker_idx)>& func)
+	{
+		for (auto idx : std::views::iota(0uz, count))
+		{
+			submit([&func, idx](std::size_t worker_idx) { func(idx, worker_idx); });
+		}
+
+		wait();
+	}
+
+  private:
+	bool _try_pop(std::size_t worker_idx, t_task& task)
+	{
+		{
+			auto& own  = *queues[worker_idx];
+			auto  lock = std::lock_guard(own.mutex);
+			if (not own.tasks.empty())
+			{
+				task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+
+		for (auto offset : std::views::iota(1uz, queues.size()))
+		{
+			auto& victim = *queues[(worker_idx + offset) % queues.size()];
+			auto  lock	 = std::lock_guard(victim.mutex);
+			if (not victim.tasks.empty())
+			{
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void _worker_loop(std::size_t worker_idx)
+	{
+		auto task = t_task {};
+		while (true)
+		{
+			if (_try_pop(worker_idx, task))
+			{
+				--queued;
+				task(worker_idx);
+				task = nullptr;
+
+				if (--unfinished == 0)
+				{
+					auto lock = std::lock_guard(wake_mutex);
+					done_cv.notify_all();
+				}
+				continue;
+			}
+
+			auto lock = std::unique_lock(wake_mutex);
+			wake_cv.wait(lock, [this]() { return queued > 0 or not running; });
+			if (not running and queued == 0)
+			{
+				return;
+			}
+		}
+	}
+};
@@ -0,0 +1,195 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <ranges>
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <limits>
+#include "common.h"
+#include "thread_pool.h"
+#include "mapped_file.h"
+
+// delay trace, one column per field
+struct delay_trace
+{
+	// the n of "seq[n]", no_seq when the line has none
+	std::vector<uint64>	  seq;
+	std::vector<double64> delay;
+
+	static constexpr uint64 no_seq = std::numeric_limits<uint64>::max();
+
+	std::size_t size() const { return delay.size(); }
+
+	void clear()
+	{
+		seq.clear();
+		delay.clear();
+	}
+};
+
+struct ingest_report
+{
+	std::size_t byte_count		   = 0;
+	std::size_t line_count		   = 0;
+	// lines without a trailing number, blank lines included
+	std::size_t skipped_line_count = 0;
+	std::size_t chunk_count		   = 0;
+	double64	elapsed_ms		   = 0.0;
+
+	double64 gb_per_second() const { return elapsed_ms > 0.0 ? (double64)byte_count / (elapsed_ms * 1e6) : 0.0; }
+};
+
+namespace trace_ingest
+{
+	// chunks smaller than this are not worth a task
+	inline constexpr std::size_t min_chunk_size = 1uz << 20;
+
+	inline bool is_digit(char c) { return (uint8)(c - '0') < 10; }
+
+	inline bool is_blank(char c) { return c == ' ' or c == '\t' or c == '\r' or c == '\v' or c == '\f'; }
+
+	// "seq[n], delay = d" lines, d is the last number on the line as with the old (\d+)\s*$ regex.
+	// memchr finds the line ends (vectorized in every libc we build with), the line itself is read backward from
+	// its end for the delay and forward to the first '[' for the seq, so the bytes in between are never touched.
+	// returns the number of lines skipped
+	inline std::size_t parse(std::string_view text, delay_trace& out)
+	{
+		auto skipped = 0uz;
+		auto* p_cur	 = text.data();
+		auto* p_end	 = text.data() + text.size();
+		while (p_cur < p_end)
+		{
+			auto* p_eol = (const char*)std::memchr(p_cur, '\n', (std::size_t)(p_end - p_cur));
+			if (p_eol == nullptr)
+			{
+				p_eol = p_end;
+			}
+
+			auto* p_last = p_eol;
+			while (p_last > p_cur and is_blank(p_last[-1]))
+			{
+				--p_last;
+			}
+
+			auto* p_first = p_last;
+			while (p_first > p_cur and is_digit(p_first[-1]))
+			{
+				--p_first;
+			}
+
+			if (p_first == p_last)
+			{
+				++skipped;
+			}
+			else
+			{
+				auto value = 0ull;
+				for (auto* p = p_first; p < p_last; ++p)
+				{
+					value = value * 10 + (uint64)(*p - '0');
+				}
+
+				auto seq	 = delay_trace::no_seq;
+				auto* p_open = (const char*)std::memchr(p_cur, '[', (std::size_t)(p_first - p_cur));
+				if (p_open != nullptr and p_open + 1 < p_first and is_digit(p_open[1]))
+				{
+					seq = 0;
+					for (auto* p = p_open + 1; p < p_first and is_digit(*p); ++p)
+					{
+						seq = seq * 10 + (uint64)(*p - '0');
+					}
+				}
+
+				out.seq.push_back(seq);
+				out.delay.push_back((double64)value);
+			}
+
+			p_cur = p_eol + 1;
+		}
+		return skipped;
+	}
+
+	// [begin, end) of every chunk, each cut just after a '\n' so no line is split
+	inline std::vector<std::pair<std::size_t, std::size_t>> split(std::string_view text, std::size_t chunk_count)
+	{
+		auto res   = std::vector<std::pair<std::size_t, std::size_t>> {};
+		auto begin = 0uz;
+		for (auto idx : std::views::iota(1uz, chunk_count + 1))
+		{
+			auto end = idx == chunk_count ? text.size() : std::max(begin, text.size() * idx / chunk_count);
+			if (end < text.size())
+			{
+				auto eol = text.find('\n', end);
+				end		 = eol == std::string_view::npos ? text.size() : eol + 1;
+			}
+
+			if (end > begin)
+			{
+				res.emplace_back(begin, end);
+			}
+			begin = end;
+		}
+		return res;
+	}
+
+	// whole text, chunks parsed in parallel and concatenated in file order
+	inline ingest_report parse(thread_pool& pool, std::string_view text, delay_trace& out)
+	{
+		auto begin	= std::chrono::steady_clock::now();
+		auto chunks = split(text, std::clamp(text.size() / min_chunk_size, 1uz, pool.size() * 4));
+		auto parts	= std::vector<delay_trace>(chunks.size());
+		auto skips	= std::vector<std::size_t>(chunks.size());
+
+		pool.parallel_for(chunks.size(), [&](std::size_t idx, std::size_t) {
+			auto [first, last] = chunks[idx];
+			// about 24 bytes per line, one reallocation at most
+			parts[idx].seq.reserve((last - first) / 16);
+			parts[idx].delay.reserve((last - first) / 16);
+			skips[idx] = parse(text.substr(first, last - first), parts[idx]);
+		});
+
+		auto offsets = std::vector<std::size_t>(parts.size() + 1, out.size());
+		for (auto idx : std::views::iota(0uz, parts.size()))
+		{
+			offsets[idx + 1] = offsets[idx] + parts[idx].size();
+		}
+
+		out.seq.resize(offsets.back());
+		out.delay.resize(offsets.back());
+		pool.parallel_for(parts.size(), [&](std::size_t idx, std::size_t) {
+			std::ranges::copy(parts[idx].seq, out.seq.begin() + (std::ptrdiff_t)offsets[idx]);
+			std::ranges::copy(parts[idx].delay, out.delay.begin() + (std::ptrdiff_t)offsets[idx]);
+		});
+
+		auto res			   = ingest_report {};
+		res.byte_count		   = text.size();
+		res.skipped_line_count = 0;
+		for (auto skip : skips)
+		{
+			res.skipped_line_count += skip;
+		}
+		res.line_count	= offsets.back() - offsets.front() + res.skipped_line_count;
+		res.chunk_count = chunks.size();
+		res.elapsed_ms	= std::chrono::duration<double64, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		return res;
+	}
+
+	// maps the file and parses it in place, nullopt if it can not be mapped (missing or empty)
+	inline std::optional<ingest_report> read(thread_pool& pool, const std::string& path, delay_trace& out)
+	{
+		auto begin = std::chrono::steady_clock::now();
+		auto file  = mapped_file {};
+		if (not file.open(path))
+		{
+			return std::nullopt;
+		}
+
+		auto res	   = parse(pool, std::string_view((const char*)file.p_data, file.size), out);
+		res.elapsed_ms = std::chrono::duration<double64, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		return res;
+	}
+}	 // namespace trace_ingest
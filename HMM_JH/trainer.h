@@ -0,0 +1,191 @@
+#pragma once
+#include <vector>
+#include <span>
+#include <ranges>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <cmath>
+#include <limits>
+#include "common.h"
+#include "dyn_model.h"
+#include "thread_pool.h"
+
+using t_sequence = std::span<const t_observation>;
+
+struct iteration_report
+{
+	std::size_t iteration;
+	// log P(O | lambda) of the parameters this iteration started from
+	double64 log_likelihood;
+	// change against the previous iteration, per sample
+	double64 improvement;
+	double64 elapsed_ms;
+};
+
+struct train_config
+{
+	std::size_t max_iterations = 200;
+	// converged once log P(O | lambda) per sample improves by less than this
+	double64 tolerance = 1e-7;
+	// called after every iteration, for progress output
+	std::function<void(const iteration_report&)> on_iteration;
+};
+
+struct train_result
+{
+	std::vector<iteration_report> iterations;
+	bool						  converged		 = false;
+	double64					  log_likelihood = -std::numeric_limits<double64>::infinity();
+	double64					  elapsed_ms	 = 0.0;
+};
+
+// em loop shared by every trainer : step() runs one iteration and returns log P(O | lambda) before its update,
+// stops once the per-sample improvement drops under config.tolerance or after max_iterations
+template <typename t_step>
+train_result run_em(std::size_t sample_count, const train_config& config, t_step&& step)
+{
+	auto res = train_result {};
+	if (sample_count == 0)
+	{
+		return res;
+	}
+
+	auto fit_begin = std::chrono::steady_clock::now();
+	for (auto iteration : std::views::iota(0uz, config.max_iterations))
+	{
+		auto begin			= std::chrono::steady_clock::now();
+		auto log_likelihood = step();
+		auto end			= std::chrono::steady_clock::now();
+
+		auto improvement = res.iterations.empty() ? std::numeric_limits<double64>::infinity() : (log_likelihood - res.log_likelihood) / (double64)sample_count;
+		res.log_likelihood = log_likelihood;
+		res.iterations.push_back({ iteration, log_likelihood, improvement, std::chrono::duration<double64, std::milli>(end - begin).count() });
+		if (config.on_iteration)
+		{
+			config.on_iteration(res.iterations.back());
+		}
+
+		// em never decreases the likelihood, a drop is rounding noise around the optimum
+		if (std::abs(improvement) < config.tolerance or not std::isfinite(log_likelihood))
+		{
+			res.converged = std::isfinite(log_likelihood);
+			break;
+		}
+	}
+
+	res.elapsed_ms = std::chrono::duration<double64, std::milli>(std::chrono::steady_clock::now() - fit_begin).count();
+	return res;
+}
+
+// multi-sequence baum-welch
+// one iteration runs the e-step of every sequence on the pool and re-estimates lambda once from the summed statistics.
+// sequences are grouped into chunks of chunk_size, each chunk is summed in sequence order into its own slot,
+// and the slots are merged in chunk order, so the result does not depend on the worker count or on who stole what.
+struct em_trainer
+{
+	thread_pool& pool;
+	std::size_t	 chunk_size = 8;
+
+	// per-worker model holding the alpha / beta / ... tables of the sequence it is working on
+	std::vector<dyn_model> scratch;
+	// per-chunk statistics
+	std::vector<suff_stats> chunk_stats;
+
+	explicit em_trainer(thread_pool& pool) : pool(pool) { }
+
+	// e-step over all sequences with the current parameters of hmm
+	suff_stats expectation(const dyn_model& hmm, std::span<const t_sequence> sequences)
+	{
+		_prepare(hmm, sequences.size());
+
+		pool.parallel_for(chunk_stats.size(), [&](std::size_t chunk_idx, std::size_t worker_idx) {
+			auto& worker = scratch[worker_idx];
+			auto& stats	 = chunk_stats[chunk_idx];
+			stats.clear();
+
+			auto seq_begin = chunk_idx * chunk_size;
+			auto seq_end   = std::min(sequences.size(), seq_begin + chunk_size);
+			for (auto seq_idx : std::views::iota(seq_begin, seq_end))
+			{
+				if (sequences[seq_idx].empty())
+				{
+					continue;
+				}
+
+				worker.update_observations(sequences[seq_idx]);
+				worker.e_step(stats);
+			}
+		});
+
+		auto total = suff_stats(hmm.state_count, hmm.observation_count);
+		for (auto& stats : chunk_stats)
+		{
+			total.merge(stats);
+		}
+
+		return total;
+	}
+
+	// one em iteration, returns log P(O | lambda) of all sequences under the parameters before the update
+	double64 step(dyn_model& hmm, std::span<const t_sequence> sequences)
+	{
+		auto stats = expectation(hmm, sequences);
+		if (stats.sequence_count > 0)
+		{
+			hmm.m_step(stats);
+		}
+
+		return stats.log_likelihood;
+	}
+
+	void train(dyn_model& hmm, std::span<const t_sequence> sequences, std::size_t iteration_count)
+	{
+		for (auto _ : std::views::iota(0uz, iteration_count))
+		{
+			step(hmm, sequences);
+		}
+	}
+
+	// iterate until the per-sample improvement drops under config.tolerance or max_iterations is reached
+	// hmm is used as the starting point, so a model loaded from disk warm starts the training
+	train_result fit(dyn_model& hmm, std::span<const t_sequence> sequences, const train_config& config)
+	{
+		auto sample_count = 0uz;
+		for (auto& seq : sequences)
+		{
+			sample_count += seq.size();
+		}
+
+		return run_em(sample_count, config, [&]() { return step(hmm, sequences); });
+	}
+
+	// cut one long trace into consecutive sequences of seq_len (the last one may be shorter)
+	static std::vector<t_sequence> split(t_sequence trace, std::size_t seq_len)
+	{
+		auto res = std::vector<t_sequence> {};
+		for (auto begin = 0uz; begin < trace.size(); begin += seq_len)
+		{
+			res.emplace_back(trace.subspan(begin, std::min(seq_len, trace.size() - begin)));
+		}
+
+		return res;
+	}
+
+  private:
+	void _prepare(const dyn_model& hmm, std::size_t sequence_count)
+	{
+		if (scratch.size() != pool.size() or scratch.front().state_count != hmm.state_count or scratch.front().observation_count != hmm.observation_count)
+		{
+			scratch.assign(pool.size(), dyn_model(hmm.state_count, hmm.observation_count));
+		}
+
+		for (auto& worker : scratch)
+		{
+			worker.copy_parameters(hmm);
+			worker.p_kernels = hmm.p_kernels;
+		}
+
+		chunk_stats.assign((sequence_count + chunk_size - 1) / chunk_size, suff_stats(hmm.state_count, hmm.observation_count));
+	}
+};
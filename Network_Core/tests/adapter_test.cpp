@@ -0,0 +1,164 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <ranges>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <poll.h>
+#include <core.h>
+
+// get_adapter_addrs and bind_sock against the loopback, and a veth pair when the process may create one (CAP_NET_ADMIN)
+namespace
+{
+	auto failures = 0;
+
+	void check(bool ok, std::string_view what)
+	{
+		std::printf("%s %.*s\n", ok ? "ok  " : "FAIL", (int)what.size(), what.data());
+		failures += ok ? 0 : 1;
+	}
+
+	bool has(const std::vector<net_core::adapter_addr>& adapters, std::string_view name)
+	{
+		return std::ranges::any_of(adapters, [&](const auto& adapter) { return adapter.name == name; });
+	}
+
+	const uint64 loopback_filter[] = { IF_TYPE_SOFTWARE_LOOPBACK };
+	const uint64 nic_filter[]	   = { IF_TYPE_ETHERNET_CSMACD, IF_TYPE_IEEE80211 };
+
+	void loopback_filtering()
+	{
+		check(has(net_core::get_adapter_addrs(nic_filter), "lo") is_false, "lo is left out without IF_TYPE_SOFTWARE_LOOPBACK in the filter");
+
+		auto adapters = net_core::get_adapter_addrs(loopback_filter, AF_INET);
+		auto it		  = std::ranges::find(adapters, std::string("lo"), &net_core::adapter_addr::name);
+		check(it != adapters.end(), "lo is returned with IF_TYPE_SOFTWARE_LOOPBACK in the filter");
+		if (it != adapters.end())
+		{
+			check(it->if_type == IF_TYPE_SOFTWARE_LOOPBACK, "lo is typed IF_TYPE_SOFTWARE_LOOPBACK");
+			check(it->addr == *net_core::endpoint::parse("127.0.0.1", 0), "lo carries 127.0.0.1");
+		}
+	}
+
+	// two sockets pinned to lo, a datagram there and back
+	void loopback_echo()
+	{
+		auto adapters = net_core::get_adapter_addrs(loopback_filter, AF_INET);
+		if (adapters.empty())
+		{
+			check(false, "loopback echo : no lo address");
+			return;
+		}
+
+		auto sock_a = net_core::bind_sock(adapters[0], 0, true);
+		auto sock_b = net_core::bind_sock(adapters[0], 0, true);
+		if (sock_a == INVALID_SOCKET or sock_b == INVALID_SOCKET)
+		{
+			// SO_BINDTODEVICE wants CAP_NET_RAW
+			check(::geteuid() != 0, "loopback echo : bind_sock with bind_device");
+			std::printf("skip loopback echo, no CAP_NET_RAW\n");
+			return;
+		}
+
+		auto addr_b		= net_core::endpoint {};
+		auto addr_b_len = (socklen_t)sizeof(addr_b);
+		::getsockname(sock_b, addr_b.get(), &addr_b_len);
+
+		const auto msg = std::string_view("net_core echo");
+		::sendto(sock_a, msg.data(), msg.size(), 0, addr_b.get(), addr_b.size());
+
+		auto buf	  = std::array<char, 64> {};
+		auto from	  = net_core::endpoint {};
+		auto from_len = (socklen_t)sizeof(from);
+		auto pfd	  = pollfd { .fd = sock_b, .events = POLLIN };
+		auto len	  = ::poll(&pfd, 1, 1000) == 1 ? ::recvfrom(sock_b, buf.data(), buf.size(), 0, from.get(), &from_len) : -1;
+		check(len == (ssize_t)msg.size() and std::string_view(buf.data(), msg.size()) == msg, "loopback echo : datagram arrives on the pinned socket");
+
+		::sendto(sock_b, buf.data(), len, 0, from.get(), from.size());
+		pfd = pollfd { .fd = sock_a, .events = POLLIN };
+		len = ::poll(&pfd, 1, 1000) == 1 ? ::recv(sock_a, buf.data(), buf.size(), 0) : -1;
+		check(len == (ssize_t)msg.size(), "loopback echo : and back");
+
+		::closesocket(sock_a);
+		::closesocket(sock_b);
+	}
+
+	// a veth end is ARPHRD_ETHER without a wireless directory, so ethernet
+	void veth_classification()
+	{
+		// a leftover of an aborted run
+		std::system("ip link del nc_test0 2>/dev/null");
+		if (std::system("ip link add nc_test0 type veth peer name nc_test1 2>/dev/null") != 0)
+		{
+			std::printf("skip veth classification, no CAP_NET_ADMIN\n");
+			return;
+		}
+
+		std::system("ip addr add 10.213.7.1/30 dev nc_test0 && ip link set nc_test1 up && ip link set nc_test0 up");
+
+		// the carrier of a veth comes up a moment after its peer
+		auto adapters = std::vector<net_core::adapter_addr> {};
+		for (auto _ : std::views::iota(0, 100))
+		{
+			adapters = net_core::get_adapter_addrs(nic_filter, AF_INET);
+			if (has(adapters, "nc_test0"))
+			{
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+
+		auto it = std::ranges::find(adapters, std::string("nc_test0"), &net_core::adapter_addr::name);
+		check(it != adapters.end(), "veth is returned with IF_TYPE_ETHERNET_CSMACD in the filter");
+		if (it != adapters.end())
+		{
+			check(it->if_type == IF_TYPE_ETHERNET_CSMACD, "veth is typed IF_TYPE_ETHERNET_CSMACD");
+			check(it->addr == *net_core::endpoint::parse("10.213.7.1", 0), "veth carries its address");
+		}
+		check(has(net_core::get_adapter_addrs(loopback_filter, AF_INET), "nc_test0") is_false, "veth is left out of a loopback-only filter");
+
+		// a v6 address alone has to wake the watcher, what a v6-only client rebinds on
+		auto changes = std::atomic<int> { 0 };
+		auto watcher = net_core::interface_watcher {};
+		watcher.start([&]() { ++changes; }, std::chrono::milliseconds(50));
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		auto before = changes.load();
+		std::system("ip -6 addr add fd13:7::1/64 dev nc_test0 nodad");
+		for (auto _ : std::views::iota(0, 100))
+		{
+			if (changes > before)
+			{
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+		check(changes > before, "interface_watcher reports a new v6 address");
+		watcher.stop();
+
+		// a deprecated v6 address is left out like windows leaves out one that is not DadState Preferred
+		std::system("ip -6 addr add fd13:7::2/64 dev nc_test0 nodad preferred_lft 0");
+		auto v6_adapters = net_core::get_adapter_addrs(nic_filter, AF_INET6);
+		auto has_v6		 = [&](const char* host) {
+			return std::ranges::any_of(v6_adapters, [&](const auto& adapter) { return adapter.addr == *net_core::endpoint::parse(host, 0); });
+		};
+		check(has_v6("fd13:7::1"), "preferred v6 address of the veth is returned");
+		check(has_v6("fd13:7::2") is_false, "deprecated v6 address of the veth is left out");
+
+		std::system("ip link del nc_test0");
+	}
+}	 // namespace
+
+int main()
+{
+	logger::init("adapter_test_log.txt");
+	loopback_filtering();
+	loopback_echo();
+	veth_classification();
+
+	logger::clear();
+	std::printf("%d failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,286 @@
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <format>
+#include <vector>
+#include <array>
+#include <ranges>
+#include <algorithm>
+#include <poll.h>
+#include <stun.h>
+
+// net_core::stun against the rfc 5769 test vectors, a responder in this process over loopback, and simulated time
+// against fake nats : one that drops requests, one that moves the mapping, ones with a fixed idle timeout
+namespace
+{
+	using namespace net_core;
+
+	auto failures = 0;
+
+	void check(bool ok, std::string_view what)
+	{
+		std::printf("%s %.*s\n", ok ? "ok  " : "FAIL", (int)what.size(), what.data());
+		failures += ok ? 0 : 1;
+	}
+
+	constexpr uint64 ms = 1'000'000;
+	constexpr uint64 s	= 1'000'000'000;
+
+	template <std::size_t n>
+	std::span<const char> bytes(const unsigned char (&data)[n])
+	{
+		return { (const char*)data, n };
+	}
+
+	// rfc 5769 2.1, with a software, priority, ice-controlled, username and message-integrity attribute
+	const unsigned char sample_request[] = {
+		0x00, 0x01, 0x00, 0x58, 0x21, 0x12, 0xa4, 0x42, 0xb7, 0xe7, 0xa7, 0x01, 0xbc, 0x34, 0xd6, 0x86, 0xfa, 0x87, 0xdf, 0xae, 0x80, 0x22, 0x00, 0x10,
+		0x53, 0x54, 0x55, 0x4e, 0x20, 0x74, 0x65, 0x73, 0x74, 0x20, 0x63, 0x6c, 0x69, 0x65, 0x6e, 0x74, 0x00, 0x24, 0x00, 0x04, 0x6e, 0x00, 0x01, 0xff,
+		0x80, 0x29, 0x00, 0x08, 0x93, 0x2f, 0xf9, 0xb1, 0x51, 0x26, 0x3b, 0x36, 0x00, 0x06, 0x00, 0x09, 0x65, 0x76, 0x74, 0x6a, 0x3a, 0x68, 0x36, 0x76,
+		0x59, 0x20, 0x20, 0x20, 0x00, 0x08, 0x00, 0x14, 0x9a, 0xea, 0xa7, 0x0c, 0xbf, 0xd8, 0xcb, 0x56, 0x78, 0x1e, 0xf2, 0xb5, 0xb2, 0xd3, 0xf2, 0x49,
+		0xc1, 0xb5, 0x71, 0xa2, 0x80, 0x28, 0x00, 0x04, 0xe5, 0x7a, 0x3b, 0xcf,
+	};
+
+	// rfc 5769 2.2, 192.0.2.1:32853
+	const unsigned char sample_response_v4[] = {
+		0x01, 0x01, 0x00, 0x3c, 0x21, 0x12, 0xa4, 0x42, 0xb7, 0xe7, 0xa7, 0x01, 0xbc, 0x34, 0xd6, 0x86, 0xfa, 0x87, 0xdf, 0xae, 0x80, 0x22, 0x00, 0x0b,
+		0x74, 0x65, 0x73, 0x74, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x00, 0x20, 0x00, 0x08, 0x00, 0x01, 0xa1, 0x47, 0xe1, 0x12, 0xa6, 0x43,
+		0x00, 0x08, 0x00, 0x14, 0x2b, 0x91, 0xf5, 0x99, 0xfd, 0x9e, 0x90, 0xc3, 0x8c, 0x74, 0x89, 0xf9, 0x2a, 0xf9, 0xba, 0x53, 0xf0, 0x6b, 0xe7, 0xd7,
+		0x80, 0x28, 0x00, 0x04, 0xc0, 0x7d, 0x4c, 0x96,
+	};
+
+	// rfc 5769 2.3, [2001:db8:1234:5678:11:2233:4455:6677]:32853
+	const unsigned char sample_response_v6[] = {
+		0x01, 0x01, 0x00, 0x48, 0x21, 0x12, 0xa4, 0x42, 0xb7, 0xe7, 0xa7, 0x01, 0xbc, 0x34, 0xd6, 0x86, 0xfa, 0x87, 0xdf, 0xae, 0x80, 0x22, 0x00, 0x0b,
+		0x74, 0x65, 0x73, 0x74, 0x20, 0x76, 0x65, 0x63, 0x74, 0x6f, 0x72, 0x20, 0x00, 0x20, 0x00, 0x14, 0x00, 0x02, 0xa1, 0x47, 0x01, 0x13, 0xa9, 0xfa,
+		0xa5, 0xd3, 0xf1, 0x79, 0xbc, 0x25, 0xf4, 0xb5, 0xbe, 0xd2, 0xb9, 0xd9, 0x00, 0x08, 0x00, 0x14, 0xa3, 0x82, 0x95, 0x4e, 0x4b, 0xe6, 0x7b, 0xf1,
+		0x17, 0x84, 0xc9, 0x7c, 0x82, 0x92, 0xc2, 0x75, 0xbf, 0xe3, 0xed, 0x41, 0x80, 0x28, 0x00, 0x04, 0xc8, 0xfb, 0x0b, 0x4c,
+	};
+
+	void rfc5769_vectors()
+	{
+		auto request = stun::parse(bytes(sample_request));
+		check(request.has_value() and request->type == stun::binding_request, "rfc 5769 request parses, fingerprint holds");
+
+		auto v4 = stun::parse(bytes(sample_response_v4));
+		check(v4.has_value() and v4->type == stun::binding_success and v4->mapped == endpoint::parse("192.0.2.1", 32853), "rfc 5769 ipv4 response maps 192.0.2.1:32853");
+
+		auto v6 = stun::parse(bytes(sample_response_v6));
+		check(v6.has_value() and v6->mapped == endpoint::parse("2001:db8:1234:5678:11:2233:4455:6677", 32853), "rfc 5769 ipv6 response maps [2001:db8:1234:5678:11:2233:4455:6677]:32853");
+
+		auto corrupt = std::vector<char>(bytes(sample_response_v4).begin(), bytes(sample_response_v4).end());
+		corrupt[44] ^= 1;
+		check(stun::is_message(corrupt) and stun::parse(corrupt).has_value() is_false, "a flipped address bit fails the fingerprint");
+
+		auto truncated = bytes(sample_response_v4).first(sizeof(sample_response_v4) - 4);
+		check(stun::is_message(truncated) is_false, "a length that does not match the datagram is not a message");
+	}
+
+	// what a server writes parses back to the same transaction and address
+	void round_trip()
+	{
+		for (auto* host : { "203.0.113.7", "2001:db8::5" })
+		{
+			auto request = std::array<char, stun::max_message_size> {};
+			auto reply	 = std::array<char, stun::max_message_size> {};
+			auto id		 = stun::new_transaction_id();
+			auto from	 = *endpoint::parse(host, 4444);
+			auto len	 = stun::respond(std::span<const char>(request.data(), stun::write_request(request, id)), from, reply);
+			auto msg	 = stun::parse(std::span<const char>(reply.data(), len));
+			check(msg.has_value() and msg->id == id and msg->mapped == from, std::format("respond round trip for {}", host));
+		}
+	}
+
+	// a server that answers from a fixed mapped address, or drops the request
+	struct fake_server
+	{
+		endpoint		  mapped;
+		uint32			  drop_count = 0;
+		std::vector<char> reply;
+
+		void operator()(std::span<const char> request)
+		{
+			if (drop_count > 0)
+			{
+				--drop_count;
+				return;
+			}
+
+			auto out = std::array<char, stun::max_message_size> {};
+			reply.assign(out.data(), out.data() + stun::respond(request, mapped, out));
+		}
+	};
+
+	// rfc 5389 7.2.1 : sends at 0, 500, 1500, 3500, 7500, 15500, 31500 ms, the transaction fails at 39500 ms
+	void retransmit_timing()
+	{
+		auto server = fake_server { .mapped = *endpoint::parse("198.51.100.1", 5000), .drop_count = ~0u };
+		auto client = stun::client(*endpoint::parse("127.0.0.1", 3478));
+		auto sends	= std::vector<uint64> {};
+		auto events = std::vector<std::pair<uint64, stun::event_kind>> {};
+		auto now	= uint64 { 0 };
+		while (events.empty())
+		{
+			now = client.tick(
+				now,
+				[&](std::span<const char> data) {
+					sends.push_back(now);
+					server(data);
+				},
+				[&](const stun::client_event& event) { events.emplace_back(now, event.kind); });
+		}
+
+		check(sends == std::vector<uint64> { 0, 500 * ms, 1500 * ms, 3500 * ms, 7500 * ms, 15500 * ms, 31500 * ms }, "retransmissions double the rto from 500 ms, 7 sends");
+		check(events.size() == 1 and events[0] == std::pair { 39500 * ms, stun::event_kind::timeout }, "timeout 16 rto after the last send, at 39.5 s");
+		check(client.in_flight is_false and client.next_send == 39500 * ms + client.config.refresh_ns, "a timed out client asks again after refresh_ns");
+	}
+
+	// answers after two lost requests, then the nat moves the mapping between two refreshes
+	void mapping_changes()
+	{
+		auto server = fake_server { .mapped = *endpoint::parse("198.51.100.1", 5000), .drop_count = 2 };
+		auto client = stun::client(*endpoint::parse("127.0.0.1", 3478));
+		auto events = std::vector<stun::client_event> {};
+		auto emit	= [&](const stun::client_event& event) { events.push_back(event); };
+		auto now	= uint64 { 0 };
+		for (auto round : std::views::iota(0, 4))
+		{
+			if (round == 2)
+			{
+				server.mapped.set_port(5001);
+			}
+
+			// until the transaction of this round is answered, 20 ms after the send that got through
+			auto sent_at = now;
+			while (server.reply.empty())
+			{
+				sent_at = now;
+				now		= client.tick(now, server, emit);
+			}
+			client.on_message(server.reply, sent_at + 20 * ms, emit);
+			server.reply.clear();
+			now = client.next_send;
+		}
+
+		auto kinds = events | std::views::transform(&stun::client_event::kind);
+		check(std::ranges::equal(kinds, std::array { stun::event_kind::mapped, stun::event_kind::refreshed, stun::event_kind::changed, stun::event_kind::refreshed }),
+			  "mapped, refreshed, changed, refreshed");
+		check(events[0].rtt_ns == 20 * ms, "rtt from the last send of the transaction");
+		check(events[2].previous.port() == 5000 and events[2].mapped.port() == 5001, "changed carries the old and the new mapping");
+
+		auto stray = std::array<char, stun::max_message_size> {};
+		auto len   = stun::write_success(stray, stun::new_transaction_id(), server.mapped);
+		check(client.on_message(std::span<const char>(stray.data(), len), now, emit) is_false, "an answer to another transaction is ignored");
+	}
+
+	// a nat that forgets a binding idle for longer than timeout_ns and maps the socket to the next port then
+	struct fake_nat
+	{
+		uint64			  timeout_ns;
+		uint64			  last_seen = 0;
+		uint16			  port		= 7000;
+		uint64*			  p_now;
+		std::vector<char> reply;
+
+		void operator()(std::span<const char> request)
+		{
+			if (last_seen != 0 and *p_now - last_seen > timeout_ns)
+			{
+				++port;
+			}
+			last_seen = *p_now;
+
+			auto out = std::array<char, stun::max_message_size> {};
+			reply.assign(out.data(), out.data() + stun::respond(request, *endpoint::parse("198.51.100.1", port), out));
+		}
+	};
+
+	void lifetime_converges()
+	{
+		for (auto timeout_s : { 20ull, 37ull, 100ull, 290ull, 2000ull })
+		{
+			auto now   = uint64 { 0 };
+			auto nat   = fake_nat { .timeout_ns = timeout_s * s, .p_now = &now };
+			auto probe = stun::lifetime_probe(*endpoint::parse("127.0.0.1", 3478));
+			for (auto _ : std::views::iota(0, 200))
+			{
+				if (probe.done())
+				{
+					break;
+				}
+
+				auto next = probe.tick(now, nat, [](const auto&) { });
+				if (nat.reply.empty() is_false)
+				{
+					probe.on_message(nat.reply, now, [](const auto&) { });
+					nat.reply.clear();
+				}
+				now = std::max(next, now + 1);
+			}
+
+			auto bounded = timeout_s * s >= probe.config.max_gap_ns
+							 ? probe.kept_ns == probe.config.max_gap_ns and probe.lost_ns == 0
+							 : probe.kept_ns <= timeout_s * s and probe.lost_ns > timeout_s * s and probe.lost_ns - probe.kept_ns <= probe.config.resolution_ns;
+			check(probe.done() and bounded and probe.keepalive_ns() < timeout_s * s,
+				  std::format("lifetime probe brackets a {} s nat timeout : kept {} s, lost {} s", timeout_s, probe.kept_ns / s, probe.lost_ns / s));
+		}
+	}
+
+	// a responder socket and a client socket on 127.0.0.1, the client learns its own address
+	void loopback_responder()
+	{
+		auto any		 = *endpoint::parse("127.0.0.1", 0);
+		auto server_sock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		auto client_sock = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		::bind(server_sock, any.get(), any.size());
+		::bind(client_sock, any.get(), any.size());
+
+		auto server_addr = endpoint {};
+		auto client_addr = endpoint {};
+		auto addr_len	 = (socklen_t)sizeof(endpoint);
+		::getsockname(server_sock, server_addr.get(), &addr_len);
+		addr_len = sizeof(endpoint);
+		::getsockname(client_sock, client_addr.get(), &addr_len);
+
+		auto wait = [](SOCKET sock) {
+			auto pfd = pollfd { .fd = sock, .events = POLLIN };
+			return ::poll(&pfd, 1, 1000) == 1;
+		};
+
+		auto client = stun::client(server_addr);
+		auto events = std::vector<stun::client_event> {};
+		auto buf	= std::array<char, stun::max_message_size> {};
+		client.tick(1, [&](std::span<const char> data) { ::sendto(client_sock, data.data(), data.size(), 0, server_addr.get(), server_addr.size()); }, [](const auto&) { });
+
+		// the responder side of the server : every binding request gets its source back
+		auto from	  = endpoint {};
+		auto from_len = (socklen_t)sizeof(from);
+		auto len	  = wait(server_sock) ? ::recvfrom(server_sock, buf.data(), buf.size(), 0, from.get(), &from_len) : -1;
+		check(len > 0 and stun::is_message(std::span<const char>(buf.data(), len)), "responder receives a binding request");
+
+		auto reply = std::array<char, stun::max_message_size> {};
+		auto size  = len > 0 ? stun::respond(std::span<const char>(buf.data(), len), from, reply) : 0;
+		::sendto(server_sock, reply.data(), size, 0, from.get(), from.size());
+
+		len = wait(client_sock) ? ::recv(client_sock, buf.data(), buf.size(), 0) : -1;
+		check(len > 0 and client.on_message(std::span<const char>(buf.data(), len), 2, [&](const stun::client_event& event) { events.push_back(event); }),
+			  "client takes the answer");
+		check(events.size() == 1 and events[0].kind == stun::event_kind::mapped and events[0].mapped == client_addr, "client learns the address of its socket");
+
+		::closesocket(server_sock);
+		::closesocket(client_sock);
+	}
+}	 // namespace
+
+int main()
+{
+	rfc5769_vectors();
+	round_trip();
+	retransmit_timing();
+	mapping_changes();
+	lifetime_converges();
+	loopback_responder();
+
+	std::printf("%d failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -1,4 +1,5 @@
 #pragma once
+#define NOMINMAX
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #include <iphlpapi.h>
@@ -2,18 +2,56 @@
 #include "server.h"
 #include <concurrent_queue.h>
 #include <concurrent_vector.h>
+#include <mutex>
+#include <memory>
+#include <filesystem>
+#include <online_model.h>
+#include <discretizer.h>
+#include <change_detector.h>
+#include <event_queue.h>
+#include <model_pool.h>
+#include <lstm_model.h>
+#include <rcu.h>
+#include <feature_engine.h>
+#include <stun.h>
+
+#define RECV_THREAD_COUNT  2
+#define DELAY_STATE_COUNT  5
+#define DELAY_SYMBOL_COUNT 10
+#define DELAY_HISTORY_SIZE 300
+
+// change detector and rolling features of one client, fed by every packet_6 it sends. its delay regime hmm lives in delay_models,
+// p_hmm is its slot there from the first report on so the recv threads skip the pool's map
+// recv threads can handle two reports of the same client at once, so the update is locked
+struct delay_model
+{
+	std::mutex						  mutex;
+	change_detector					  detector;
+	std::shared_ptr<model_pool::slot> p_hmm;
+	// windows of 10, 60 and DELAY_HISTORY_SIZE delays, the forecaster's window is the newest of them
+	feature_engine					  features { { .window_sizes = { 10, 60, DELAY_HISTORY_SIZE } } };
 
-#define RECV_THREAD_COUNT 2
+	explicit delay_model(uint32 id) : detector(id) { }
+};
 
 struct c_session
 {
-	std::string c_name;
-	uint32		c_id;
-	bool		connected = false;
+	std::string					 c_name;
+	uint32						 c_id;
+	bool						 connected = false;
+	std::shared_ptr<delay_model> p_delay_model;
 
-	c_session(char* p_name, uint32 name_len, uint32 id) : c_name(p_name, name_len), c_id(id) { };
+	c_session(char* p_name, uint32 name_len, uint32 id) : c_name(p_name, name_len), c_id(id), p_delay_model(std::make_shared<delay_model>(id)) { };
 };
 
+// delay (ns) -> symbol, geometric bins from 100us to 100ms so every client's model shares the same symbols
+const auto delay_binning = discretizer::log_spaced(100'000.0, 100'000'000.0, DELAY_SYMBOL_COUNT);
+
+t_observation delay_to_symbol(uint64 delay)
+{
+	return delay_binning((double64)delay);
+}
+
 struct iocp_key_wsa_recv
 {
 };
@@ -23,13 +61,15 @@ struct recv_io_data
 	WSAOVERLAPPED		   wsa_overlapped;	  // do not move
 	WSABUF				   wsa_buf;
 	std::array<char, 1024> recv_buf;
-	sockaddr_in			   client_addr;
+	// either family, client_addr_size goes back to sizeof(client_addr) before every post
+	net_core::endpoint	   client_addr;
 	int32				   client_addr_size;
 	uint32				   recv_len;
 	uint32				   io_flag;
 	bool				   is_from_client;
+	SOCKET				   sock = INVALID_SOCKET;
 
-	recv_io_data() : io_flag(0), client_addr_size(sizeof(client_addr)), is_from_client(true)
+	recv_io_data() : client_addr_size(sizeof(client_addr)), io_flag(0), is_from_client(true)
 	{
 		assert((uint64)this == (uint64)&wsa_overlapped);
 		ZeroMemory(&wsa_overlapped, sizeof(WSAOVERLAPPED));
@@ -44,7 +84,7 @@ struct send_io_data
 	WSAOVERLAPPED		   wsa_overlapped;	  // do not move
 	WSABUF				   wsa_buf;
 	std::array<char, 1024> recv_buf;
-	sockaddr_in			   client_addr;
+	net_core::endpoint	   client_addr;
 	int32				   client_addr_size;
 	uint32				   recv_len;
 	uint32				   io_flag;
@@ -61,8 +101,8 @@ struct send_io_data
 
 namespace
 {
-	auto server_socket	  = SOCKET {};
-	auto server_addr_info = sockaddr_in6 {};
+	// v4 and v6, INVALID_SOCKET for a family the host has no address of. a reply leaves through the one it came in on
+	auto server_sockets = std::array<SOCKET, 2> { INVALID_SOCKET, INVALID_SOCKET };
 
 	auto send_thread = std::thread();
 
@@ -71,11 +111,8 @@ namespace
 	auto h_iocp = HANDLE {};
 
 	auto recv_thread_arr = std::array<std::thread, RECV_THREAD_COUNT> {};
-	auto recv_io_datas	 = std::array<recv_io_data, RECV_THREAD_COUNT> {};
-
-	auto stun_recv_thread	= std::thread {};
-	auto stun_send_thread	= std::thread {};
-	auto stun_recv_io_datas = []() { auto temp = recv_io_data {}; temp.is_from_client = false; return temp; }();
+	// RECV_THREAD_COUNT posted reads per socket
+	auto recv_io_datas	 = std::array<recv_io_data, RECV_THREAD_COUNT * 2> {};
 
 	// std::vector<c_session> sessions;
 	concurrency::concurrent_vector<c_session> sessions;
@@ -142,12 +179,205 @@ struct memory_buffer
 
 namespace
 {
-	auto send_queue = concurrency::concurrent_queue<std::function<std::tuple<void*, size_t, sockaddr_in>()>>();
+	auto send_queue = concurrency::concurrent_queue<std::function<std::tuple<void*, size_t, net_core::endpoint>()>>();
+
+	// per-client hmms : cold ones evicted to models/ and read back on their next sample, retrained in the background
+	auto train_workers = thread_pool(2);
+	auto delay_models  = model_pool(train_workers, { .state_count = DELAY_STATE_COUNT, .observation_count = DELAY_SYMBOL_COUNT, .store_dir = "models" });
+
+	// spikes and level / regime changes of every client, pushed from the recv threads without a lock
+	auto change_events = event_queue<change_event>(4096);
+	auto event_thread  = std::thread {};
+
+	// next delay forecaster, swapped while the recv threads read it : they load it with one acquire and say when they
+	// are done (offline while blocked on the completion port), the version it replaced is deleted after that
+	struct delay_forecaster
+	{
+		uint64	   version;
+		lstm_model model;
+	};
+
+	auto forecaster_domain	= rcu_domain {};
+	auto forecaster			= rcu_ptr<delay_forecaster> {};
+	auto forecaster_thread	= std::thread {};
+	auto forecaster_path	= std::filesystem::path("lstm_weights.txt");
+
+	// deploys the weights file whenever it changes, the load happens here and never on a recv thread
+	void _forecaster_loop()
+	{
+		auto version	= 0ull;
+		auto last_write = std::filesystem::file_time_type {};
+		while (sending)
+		{
+			auto err		= std::error_code {};
+			auto write_time = std::filesystem::last_write_time(forecaster_path, err);
+			if (not err and write_time != last_write)
+			{
+				last_write = write_time;
+
+				auto p_next = std::make_unique<delay_forecaster>();
+				if (p_next->model.load(forecaster_path.string()) and p_next->model.feature_count == 1
+					and p_next->model.output_count() == 1 and p_next->model.window_size <= DELAY_HISTORY_SIZE)
+				{
+					p_next->version = ++version;
+					forecaster.publish(forecaster_domain, std::move(p_next));
+					forecaster_domain.synchronize();
+					logger::info("server : delay forecaster version {} deployed from {}", version, forecaster_path.string());
+				}
+				else
+				{
+					logger::error("server : failed to load delay forecaster from {}", forecaster_path.string());
+				}
+			}
+
+			std::this_thread::sleep_for(std::chrono::seconds(1));
+		}
+	}
+
+	// a copy of data to addr through the send thread
+	void _push_send(std::span<const char> data, const net_core::endpoint& addr)
+	{
+		send_queue.push([buf = std::vector<char>(data.begin(), data.end()), addr]() {
+			auto* p_mem = malloc(buf.size());
+			assert(p_mem != nullptr);
+			memcpy(p_mem, buf.data(), buf.size());
+			return std::tuple { p_mem, buf.size(), addr };
+		});
+	}
+
+	// a stun answer that reached a server socket, for the event thread
+	struct stun_datagram
+	{
+		net_core::endpoint									from;
+		uint16												len;
+		std::array<char, net_core::stun::max_message_size> data;
+	};
+
+	// where the nat maps each server socket, asked on the socket itself so the answer is what clients reach, and how long
+	// it keeps an idle binding, asked from a probe socket on the same address that sends nothing else. event thread only
+	struct stun_state
+	{
+		const char*					   name;
+		net_core::stun::client		   mapping;
+		net_core::stun::lifetime_probe lifetime;
+		SOCKET						   probe_sock;
+
+		stun_state(const char* name, const net_core::endpoint& server, SOCKET probe_sock) : name(name), mapping(server), lifetime(server), probe_sock(probe_sock) { }
+	};
+
+	auto stun_datagrams = event_queue<stun_datagram>(64);
+	auto stun_states	= std::array<std::unique_ptr<stun_state>, 2> {};
+
+	void _on_mapping(const stun_state& state, const net_core::stun::client_event& event)
+	{
+		switch (event.kind)
+		{
+		case net_core::stun::event_kind::mapped:
+			logger::info("server : {} socket is reachable at {} (stun rtt {:.1f} ms)", state.name, event.mapped.to_string(), (double64)event.rtt_ns / 1e6);
+			break;
+		case net_core::stun::event_kind::changed:
+			logger::warn("server : nat moved the {} socket from {} to {}", state.name, event.previous.to_string(), event.mapped.to_string());
+			break;
+		case net_core::stun::event_kind::timeout:
+			logger::warn("server : no stun answer for the {} socket from {}", state.name, state.mapping.server.to_string());
+			break;
+		case net_core::stun::event_kind::error:
+			logger::error("server : stun server answered the {} socket with error {}", state.name, event.error);
+			break;
+		case net_core::stun::event_kind::refreshed:
+			break;
+		}
+	}
+
+	// answers to the mapping requests, the probe sockets, then whatever is due
+	void _stun_tick()
+	{
+		auto now = utils::steady_now();
+		while (auto datagram = stun_datagrams.pop())
+		{
+			auto& p_state = stun_states[datagram->from.is_v6()];
+			if (p_state != nullptr and datagram->from == p_state->mapping.server)
+			{
+				p_state->mapping.on_message({ datagram->data.data(), datagram->len }, now, [&](const auto& event) { _on_mapping(*p_state, event); });
+			}
+		}
+
+		for (auto& p_state : stun_states)
+		{
+			if (p_state is_nullptr)
+			{
+				continue;
+			}
+
+			auto& state = *p_state;
+			state.mapping.tick(now, [&](std::span<const char> data) { _push_send(data, state.mapping.server); }, [&](const auto& event) { _on_mapping(state, event); });
+			if (state.probe_sock == INVALID_SOCKET)
+			{
+				continue;
+			}
+
+			auto buf = std::array<char, net_core::stun::max_message_size> {};
+			while (true)
+			{
+				auto from	  = net_core::endpoint {};
+				auto from_len = (socklen_t)sizeof(from);
+				auto len	  = ::recvfrom(state.probe_sock, buf.data(), (int)buf.size(), 0, from.get(), &from_len);
+				if (len <= 0)
+				{
+					break;
+				}
+				state.lifetime.on_message({ buf.data(), (std::size_t)len }, now, [](const auto&) { });
+			}
+
+			if (state.lifetime.done())
+			{
+				// the mapping refresh doubles as the keepalive of the socket's binding, at the pace the nat needs
+				auto keepalive = state.lifetime.keepalive_ns();
+				if (keepalive != 0)
+				{
+					state.mapping.config.refresh_ns = keepalive;
+					state.mapping.request_at(std::min(state.mapping.next_send, now + keepalive));
+				}
+
+				logger::info("server : nat keeps an idle {} binding {}{}s, refreshing it every {}s", state.name,
+							 state.lifetime.lost_ns == 0 ? "at least " : "", state.lifetime.kept_ns / 1'000'000'000, state.mapping.config.refresh_ns / 1'000'000'000);
+				::closesocket(state.probe_sock);
+				state.probe_sock = INVALID_SOCKET;
+				continue;
+			}
+
+			// timeouts are the mapping's to report, the probe retries on its own
+			auto& server = state.lifetime.transactions.server;
+			state.lifetime.tick(
+				now,
+				[&](std::span<const char> data) { ::sendto(state.probe_sock, data.data(), (int)data.size(), 0, server.get(), server.size()); },
+				[](const auto&) { });
+		}
+	}
+
+	void _event_loop()
+	{
+		while (sending)
+		{
+			_stun_tick();
+
+			auto event = change_events.pop();
+			if (not event.has_value())
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				continue;
+			}
+
+			logger::warn("client [{}] : {} (sources {:#x}), delay x{:.2f}, state {} -> {}, onset seq [{}] {:.3f}ms before detection at seq [{}]",
+						 sessions[event->client_id].c_name, source_name(event->source), event->sources, event->ratio, event->from_state, event->to_state,
+						 event->onset_seq, (double64)(event->detect_time - event->onset_time) / 1e6, event->detect_seq);
+		}
+	}
 
 	void _send_loop()
 	{
-		auto													seq_num = 0;
-		std::function<std::tuple<void*, size_t, sockaddr_in>()> packet_func;
+		auto														   seq_num = 0;
+		std::function<std::tuple<void*, size_t, net_core::endpoint>()> packet_func;
 		while (sending)
 		{
 			if (send_queue.try_pop(packet_func) is_false)
@@ -155,12 +385,11 @@ namespace
 				continue;
 			}
 
+			// back to the port the packet came from, a client behind a nat is not on PORT_CLIENT
 			auto&& [p_mem, len, addr] = packet_func();
 
-			addr.sin_port = ::htons(PORT_CLIENT);
-
 			// send_packet.time_server_send = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-			if (::sendto(server_socket, (char*)p_mem, len, 0, (sockaddr*)&addr, sizeof(sockaddr_in)) == SOCKET_ERROR)
+			if (::sendto(server_sockets[addr.is_v6()], (char*)p_mem, len, 0, addr.get(), addr.size()) == SOCKET_ERROR)
 			{
 				err_msg("sendto() failed");
 			}
@@ -222,12 +451,15 @@ namespace
 
 	void _iocp_recv_loop()
 	{
+		auto reader = forecaster_domain.reader();
 		while (true)
 		{
+			reader.offline();
 			auto  recv_len		 = 0;
 			auto* p_iocp_key	 = (iocp_key_wsa_recv*)nullptr;
 			auto* p_recv_io_data = (recv_io_data*)nullptr;
 			auto  res			 = ::GetQueuedCompletionStatus(h_iocp, (LPDWORD)&recv_len, (PULONG_PTR)&p_iocp_key, (WSAOVERLAPPED**)&p_recv_io_data, INFINITE);
+			reader.online();
 			// auto* p_packet		 = (packet*)(p_recv_io_data->recv_buf.data());
 			auto* p_mem = (void*)(p_recv_io_data->recv_buf.data());
 
@@ -251,7 +483,8 @@ namespace
 
 			server::handle_packet(p_mem, recv_len, &p_recv_io_data->client_addr);
 
-			res = ::WSARecvFrom(server_socket,
+			p_recv_io_data->client_addr_size = sizeof(p_recv_io_data->client_addr);
+			res								 = ::WSARecvFrom(p_recv_io_data->sock,
 								&p_recv_io_data->wsa_buf,
 								1,
 								/*(LPDWORD)&sessions[idx].recv_len*/ nullptr,
@@ -276,10 +509,10 @@ namespace
 bool server::init()
 {
 	logger::init("server_log.txt");
+	std::filesystem::create_directories("models");
 
 	auto wsa_data = WSADATA {};
 
-	ZeroMemory(&server_addr_info, sizeof(server_addr_info));
 	// ZeroMemory(host_name, sizeof(host_name));
 
 	if (::WSAStartup(MAKEWORD(2, 2), &wsa_data) != S_OK)
@@ -297,68 +530,95 @@ bool server::init()
 		goto failed;
 	}
 
+	// one socket per family, v6-only so the v4 one keeps plain sockaddr_in peers
+	for (auto [family_idx, family] : std::array { AF_INET, AF_INET6 } | std::views::enumerate)
 	{
-		auto socks = net_core::get_binded_socks(PORT_SERVER, { IF_TYPE_ETHERNET_CSMACD, IF_TYPE_IEEE80211 }, 10);
+		auto socks = net_core::get_binded_socks(PORT_SERVER, { IF_TYPE_ETHERNET_CSMACD, IF_TYPE_IEEE80211 }, 1, false, family);
 		if (socks.size() == 0)
 		{
-			err_msg("bind() failed");
-			goto failed;
+			logger::warn("no {} address to bind", family == AF_INET6 ? "IPv6" : "IPv4");
+			continue;
 		}
 
-		server_socket = socks[0];
-	}
-
-	if (::CreateIoCompletionPort((HANDLE)server_socket, h_iocp, /*(ULONG_PTR)&iocp_key_recv*/ 0, 0) == nullptr)
-	{
-		err_msg("CreateIoCompletionPort() failed");
-		goto failed;
-	}
-
-	for (auto idx : std::views::iota(0, RECV_THREAD_COUNT))
-	{
-		while (true)
+		server_sockets[family_idx] = socks[0];
+		if (::CreateIoCompletionPort((HANDLE)socks[0], h_iocp, /*(ULONG_PTR)&iocp_key_recv*/ 0, 0) == nullptr)
 		{
-			auto res = ::WSARecvFrom(server_socket,
-									 &recv_io_datas[idx].wsa_buf,
-									 1,
-									 /*(LPDWORD)&sessions[idx].recv_len*/ nullptr,
-									 (LPDWORD)&recv_io_datas[idx].io_flag,
-									 (sockaddr*)&recv_io_datas[idx].client_addr,
-									 &recv_io_datas[idx].client_addr_size,
-									 &recv_io_datas[idx].wsa_overlapped,
-									 nullptr);
+			err_msg("CreateIoCompletionPort() failed");
+			goto failed;
+		}
 
-			if (res == SOCKET_ERROR)
+		for (auto idx : std::views::iota(0, RECV_THREAD_COUNT))
+		{
+			auto& io_data = recv_io_datas[family_idx * RECV_THREAD_COUNT + idx];
+			io_data.sock  = socks[0];
+			while (true)
 			{
-				auto err = ::WSAGetLastError();
-				if (err != WSA_IO_PENDING)
+				auto res = ::WSARecvFrom(io_data.sock,
+										 &io_data.wsa_buf,
+										 1,
+										 /*(LPDWORD)&sessions[idx].recv_len*/ nullptr,
+										 (LPDWORD)&io_data.io_flag,
+										 io_data.client_addr.get(),
+										 &io_data.client_addr_size,
+										 &io_data.wsa_overlapped,
+										 nullptr);
+
+				if (res == SOCKET_ERROR)
 				{
-					err_msg("wsarecv failed");
-					continue;
+					auto err = ::WSAGetLastError();
+					if (err != WSA_IO_PENDING)
+					{
+						err_msg("wsarecv failed");
+						continue;
+					}
+					else
+					{
+						break;
+					}
 				}
 				else
 				{
-					break;
+					assert(res == 0);
 				}
 			}
-			else
-			{
-				assert(res == 0);
-			}
 		}
+	}
 
+	if (server_sockets[0] == INVALID_SOCKET and server_sockets[1] == INVALID_SOCKET)
+	{
+		err_msg("bind() failed");
+		goto failed;
+	}
 
+	for (auto idx : std::views::iota(0, RECV_THREAD_COUNT))
+	{
 		recv_thread_arr[idx] = std::thread(_iocp_recv_loop);
 	}
 
-	// stun_send_thread = std::thread([]() {
+	// stun : the public address of each socket and the nat's idle timeout, both driven from the event thread
+	for (auto [family_idx, family] : std::array { AF_INET, AF_INET6 } | std::views::enumerate)
+	{
+		auto stun_server = net_core::stun_server(family);
+		if (server_sockets[family_idx] == INVALID_SOCKET or stun_server.has_value() is_false)
+		{
+			continue;
+		}
 
-	//	auto* p_stun_packet = malloc(sizeof());
+		auto local	   = net_core::endpoint {};
+		auto local_len = (socklen_t)sizeof(local);
+		::getsockname(server_sockets[family_idx], local.get(), &local_len);
+		local.set_port(0);
 
-	//	send_queue.push();
+		auto probe_sock = ::socket(local.family(), SOCK_DGRAM, IPPROTO_UDP);
+		if (probe_sock != INVALID_SOCKET and (::bind(probe_sock, local.get(), local.size()) == SOCKET_ERROR or net_core::set_nonblocking(probe_sock) is_false))
+		{
+			err_msg("stun probe socket failed");
+			::closesocket(probe_sock);
+			probe_sock = INVALID_SOCKET;
+		}
 
-	//	Sleep(1000);
-	//});
+		stun_states[family_idx] = std::make_unique<stun_state>(family == AF_INET6 ? "IPv6" : "IPv4", *stun_server, probe_sock);
+	}
 
 	return true;
 failed:
@@ -369,10 +629,14 @@ failed:
 
 void server::run()
 {
-	send_thread = std::thread(_send_loop);
+	send_thread		  = std::thread(_send_loop);
+	event_thread	  = std::thread(_event_loop);
+	forecaster_thread = std::thread(_forecaster_loop);
 	// recv_thread = std::thread(_recv_loop);
 
 	send_thread.join();
+	event_thread.join();
+	forecaster_thread.join();
 	// recv_thread.join();
 
 	// getchar();
@@ -380,11 +644,12 @@ void server::run()
 
 void server::deinit()
 {
+	delay_models.flush();
 	logger::clear();
 	::WSACleanup();
 }
 
-void server::handle_packet(void* p_mem, int32 recv_len, sockaddr_in* p_addr)
+void server::handle_packet(void* p_mem, int32 recv_len, net_core::endpoint* p_addr)
 {
 	if (recv_len < sizeof(uint16))
 	{
@@ -393,6 +658,19 @@ void server::handle_packet(void* p_mem, int32 recv_len, sockaddr_in* p_addr)
 	}
 	auto packet_type = *(uint16*)p_mem;
 
+	// stun shares the port : only answers to the server's own binding requests, it does not reflect for others
+	auto data = std::span<const char>((const char*)p_mem, recv_len);
+	if (net_core::stun::is_message(data))
+	{
+		if (data.size() <= net_core::stun::max_message_size)
+		{
+			auto datagram = stun_datagram { .from = *p_addr, .len = (uint16)data.size() };
+			std::ranges::copy(data, datagram.data.begin());
+			stun_datagrams.push(datagram);
+		}
+		return;
+	}
+
 	switch (packet_type)
 	{
 	case 0:
@@ -440,6 +718,34 @@ void server::handle_packet(void* p_mem, int32 recv_len, sockaddr_in* p_addr)
 		logger::info("server : client [{}] is now connected", sessions[p_packet->client_id].c_name);
 		break;
 	}
+	case 4:
+	{
+		// the client moved to another address, same session and models, answered like a registration
+		auto* p_packet = (packet_4*)p_mem;
+		if (recv_len != sizeof(packet_4) or p_packet->client_id >= sessions.size())
+		{
+			logger::error("invalid packet, packet type : {}, recv_len is {}", packet_type, recv_len);
+			return;
+		}
+
+		logger::info("server : client [{}] rejoined from {} (move {}, {:.1f} ms gap), continuing at seq {}",
+					 sessions[p_packet->client_id].c_name, p_addr->to_string(),
+					 p_packet->rebind_count, (double64)p_packet->gap / 1e6, p_packet->seq_num);
+
+		send_queue.push(
+			[id = p_packet->client_id, addr = *p_addr]() {
+				auto* p_packet = (packet_1*)malloc(sizeof(packet_1));
+				assert(p_packet != nullptr);
+				{
+					p_packet->type		= 1;
+					p_packet->res		= 0;
+					p_packet->client_id = id;
+				}
+
+				return std::tuple { (void*)p_packet, sizeof(packet_1), addr };
+			});
+		break;
+	}
 	case 3:
 	{
 		auto* p_packet			   = (packet_3*)p_mem;
@@ -465,7 +771,48 @@ void server::handle_packet(void* p_mem, int32 recv_len, sockaddr_in* p_addr)
 	case 6:
 	{
 		auto* p_packet = (packet_6*)p_mem;
-		logger::info("seq : [{}], delay : {}", p_packet->seq_num, p_packet->delay);
+		if (p_packet->client_id >= sessions.size())
+		{
+			logger::error("invalid packet, packet type : {} but client_id is {}", packet_type, p_packet->client_id);
+			return;
+		}
+
+		auto& model = *sessions[p_packet->client_id].p_delay_model;
+		auto  lock	= std::lock_guard(model.mutex);
+
+		// while the client's hmm is read back from the store its last state stands
+		auto state			= model.detector.state;
+		auto log_likelihood = 0.0;
+		if (model.p_hmm == nullptr)
+		{
+			model.p_hmm = delay_models.find_or_create(p_packet->client_id);
+		}
+		delay_models.update(model.p_hmm, delay_to_symbol(p_packet->delay), [&](const online_model& hmm) {
+			state		   = (t_state)(std::ranges::max_element(hmm.filter) - hmm.filter.begin());
+			log_likelihood = hmm.log_likelihood / (double64)hmm.sample_count;
+		});
+
+		model.detector.update(p_packet->seq_num, utils::time_now(), (double64)p_packet->delay, state, [](const change_event& event) { change_events.push(event); });
+		model.features.update((double64)p_packet->delay);
+
+		// valid until this recv thread goes offline again
+		auto  forecast		= 0.0;
+		auto  version		= 0ull;
+		auto* p_forecaster	= forecaster.load();
+		if (p_forecaster != nullptr)
+		{
+			thread_local auto workspace = lstm_workspace {};
+			thread_local auto window	= std::vector<double64> {};
+			window.resize(p_forecaster->model.window_size);
+			if (model.features.recent(window))
+			{
+				p_forecaster->model.predict_next(window, { &forecast, 1 }, workspace);
+				version = p_forecaster->version;
+			}
+		}
+
+		logger::info("seq : [{}], delay : {}, state : {}, log likelihood / sample : {:.4f}, next delay : {:.0f} (forecaster v{}), last {} median / p99 : {:.0f} / {:.0f}",
+					 p_packet->seq_num, p_packet->delay, state, log_likelihood, forecast, version, DELAY_HISTORY_SIZE, model.features.quantile(2, 0), model.features.quantile(2, 2));
 		break;
 	}
 	default:
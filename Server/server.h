@@ -6,5 +6,5 @@ namespace server
 	void run();
 	void deinit();
 
-	void handle_packet(void* p_packet, int32 recv_len, sockaddr_in* p_addr);
+	void handle_packet(void* p_packet, int32 recv_len, net_core::endpoint* p_addr);
 }	 // namespace server
\ No newline at end of file
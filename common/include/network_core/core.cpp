@@ -2,10 +2,28 @@
 #include <string>
 #include <format>
 #include <span>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 
+#ifdef _WIN32
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #include <iphlpapi.h>
+#else
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+#include <fstream>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <linux/if_packet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <poll.h>
+#include <fcntl.h>
+#endif
 
 #include "core.h"
 
@@ -14,12 +32,17 @@
 #include <spdlog/async.h>
 #include <spdlog/spdlog.h>
 
+#ifdef _WIN32
 #pragma comment(lib, "Ws2_32.lib")
 #pragma comment(lib, "iphlpapi.lib")
 #pragma comment(lib, "spdlog.lib")
+#endif
 
 LPSTR print_err(int err_code)
 {
+#ifndef _WIN32
+	return ::strerror(err_code);
+#else
 	static char msg[1024];
 
 	// If this program was multithreaded, we'd want to use
@@ -30,6 +53,7 @@ LPSTR print_err(int err_code)
 					 MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
 					 (LPSTR)msg, 1024, NULL);
 	return msg;
+#endif
 }
 
 namespace logger
@@ -56,15 +80,18 @@ namespace logger
 
 std::string utils::ip6addr_to_string(IN6_ADDR addr)
 {
+	// the eight words as stored, IN6_ADDR::u.Word on windows
+	uint16 word[8];
+	std::memcpy(word, &addr, sizeof(word));
 	return std::format("{:X},{:X},{:X},{:X},{:X},{:X},{:X},{:X}",
-					   addr.u.Word[0],
-					   addr.u.Word[1],
-					   addr.u.Word[2],
-					   addr.u.Word[3],
-					   addr.u.Word[4],
-					   addr.u.Word[5],
-					   addr.u.Word[6],
-					   addr.u.Word[7]);
+					   word[0],
+					   word[1],
+					   word[2],
+					   word[3],
+					   word[4],
+					   word[5],
+					   word[6],
+					   word[7]);
 }
 
 uint64 utils::time_now()
@@ -72,11 +99,17 @@ uint64 utils::time_now()
 	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
 }
 
+uint64 utils::steady_now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 bool is_link_local(const IN6_ADDR& addr)
 {
 	// Link-local addresses start with fe80::/10.
 	// Check if the first 8 bits are 0xfe and the next 2 bits are 10.
-	return (addr.u.Byte[0] == 0xfe) && ((addr.u.Byte[1] & 0xc0) == 0x80);
+	auto* byte = (const uint8*)&addr;
+	return (byte[0] == 0xfe) && ((byte[1] & 0xc0) == 0x80);
 }
 
 bool is_link_local(const IN_ADDR& addr)
@@ -86,11 +119,62 @@ bool is_link_local(const IN_ADDR& addr)
 	return (ip & 0xFFFF0000) == 0xA9FE0000;
 }
 
-std::vector<SOCKET> net_core::get_binded_socks(uint16 port, std::initializer_list<uint64> adapter_filter, uint32 max_count)
+net_core::endpoint::endpoint(const sockaddr* p_addr) : v6 {}
+{
+	std::memcpy(this, p_addr, p_addr->sa_family == AF_INET6 ? sizeof(sockaddr_in6) : sizeof(sockaddr_in));
+}
+
+bool net_core::endpoint::is_link_local() const
+{
+	return is_v6() ? ::is_link_local(v6.sin6_addr) : ::is_link_local(v4.sin_addr);
+}
+
+bool net_core::endpoint::same_host(const endpoint& other) const
+{
+	if (family() != other.family())
+	{
+		return false;
+	}
+
+	if (is_v6() is_false)
+	{
+		return v4.sin_addr.s_addr == other.v4.sin_addr.s_addr;
+	}
+
+	// the scope tells apart the same link-local address on two links, a global address has one meaning everywhere
+	return std::memcmp(&v6.sin6_addr, &other.v6.sin6_addr, sizeof(v6.sin6_addr)) == 0 and (is_link_local() is_false or v6.sin6_scope_id == other.v6.sin6_scope_id);
+}
+
+std::string net_core::endpoint::to_string() const
 {
-	auto socks	  = std::vector<SOCKET> {};
+	auto host = sockaddr_to_str(get(), size());
+	return is_v6() ? std::format("[{}]:{}", host, port()) : std::format("{}:{}", host, port());
+}
+
+std::optional<net_core::endpoint> net_core::endpoint::parse(const char* host, uint16 port)
+{
+	// getaddrinfo reads the %scope suffix, inet_pton does not
+	auto	  hints	  = addrinfo {};
+	addrinfo* p_infos = nullptr;
+	hints.ai_family	  = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags	  = AI_NUMERICHOST;
+	if (::getaddrinfo(host, nullptr, &hints, &p_infos) != 0 or p_infos == nullptr)
+	{
+		return std::nullopt;
+	}
+
+	auto res = endpoint(p_infos->ai_addr);
+	::freeaddrinfo(p_infos);
+	res.set_port(port);
+	return res;
+}
+
+#ifdef _WIN32
+std::vector<net_core::adapter_addr> net_core::get_adapter_addrs(std::span<const uint64> adapter_filter, int family)
+{
+	auto res	  = std::vector<adapter_addr> {};
 	auto flags	  = GAA_FLAG_INCLUDE_PREFIX;
-	auto family	  = AF_INET;
 	auto addr_buf = std::vector<char>((sizeof(IP_ADAPTER_ADDRESSES) * 30));
 	auto buf_len  = addr_buf.size();
 	auto ret	  = ::GetAdaptersAddresses(family, flags, NULL, (PIP_ADAPTER_ADDRESSES)addr_buf.data(), (PULONG)&buf_len);
@@ -102,7 +186,7 @@ std::vector<SOCKET> net_core::get_binded_socks(uint16 port, std::initializer_lis
 	if (ret != NO_ERROR)
 	{
 		err_msg("GetAdaptersAddresses() failed");
-		return socks;
+		return res;
 	}
 
 	for (auto* adapter = (IP_ADAPTER_ADDRESSES*)(addr_buf.data()); adapter != nullptr; adapter = adapter->Next)
@@ -112,97 +196,232 @@ std::vector<SOCKET> net_core::get_binded_socks(uint16 port, std::initializer_lis
 			continue;
 		}
 
-		if (adapter->IfType == IF_TYPE_SOFTWARE_LOOPBACK)
-		{
-			continue;
-		}
-
+		// loopback only when asked for, it is not in the filter otherwise
 		if (adapter->IfType != 0 and std::ranges::find(adapter_filter, adapter->IfType) == adapter_filter.end())
 		{
 			continue;
 		}
 
+		auto name_len = ::WideCharToMultiByte(CP_UTF8, 0, adapter->Description, -1, nullptr, 0, nullptr, nullptr);
+		auto name	  = std::string(std::max(name_len, 1) - 1, '\0');
+		::WideCharToMultiByte(CP_UTF8, 0, adapter->Description, -1, name.data(), name_len, nullptr, nullptr);
+
 		for (auto* p_unicast = adapter->FirstUnicastAddress; p_unicast != nullptr; p_unicast = p_unicast->Next)
 		{
-			auto* p_addr = (sockaddr_in*)(p_unicast->Address.lpSockaddr);
-
-			if (p_unicast->Address.lpSockaddr->sa_family != AF_INET)
+			auto addr = endpoint(p_unicast->Address.lpSockaddr);
+			if (addr.family() != AF_INET and addr.family() != AF_INET6)
 			{
 				continue;
 			}
 
-			// if (::IN6_IS_ADDR_LINKLOCAL(&p_addr->sin6_addr))
-			//{
-			//	continue;
-			// }
-			if (is_link_local(p_addr->sin_addr))
+			if (family != AF_UNSPEC and addr.family() != family)
 			{
 				continue;
 			}
 
-			//{
-			//	auto	wstr_len					  = (DWORD)INET6_ADDRSTRLEN;
-			//	wchar_t p_wstr_ipv6[INET6_ADDRSTRLEN] = { 0 };
-
-			//	// Convert the IPv6 address to a string.
-			//	if (::WSAAddressToStringW((LPSOCKADDR)&p_addr->sin6_addr, sizeof(sockaddr_in6), NULL, p_wstr_ipv6, &wstr_len) == 0)
-			//	{
-			//		logger::info(L"binding success, IPv6 Address: {}, interface description : {}", p_wstr_ipv6, adapter->Description);
-			//	}
-			//}
-
-			auto sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-			if (sock == INVALID_SOCKET)
+			if (addr.is_link_local())
 			{
-				err_msg("socket creation failed");
 				continue;
 			}
 
-			auto sock_addr = sockaddr_in {};
-			sock_addr	   = *p_addr;
-			// ZeroMemory(&sock_addr, sizeof(sock_addr));
-			// sock_addr.sin_family = AF_INET;
-			sock_addr.sin_port = htons(port);
-			// sock_addr.sin_addr	 = p_addr->sin_addr;
-			//  sock_addr.sin6_scope_id = p_addr->sin6_scope_id;	// Needed for link-local addresses.
-
-			if (::bind(sock, (sockaddr*)&sock_addr, sizeof(sockaddr_in)) == SOCKET_ERROR)
+			// tentative, duplicate or deprecated (an old privacy address) : not one to start a session on
+			if (addr.is_v6() and p_unicast->DadState != IpDadStatePreferred)
 			{
-				err_msg("bind failed");
-				::closesocket(sock);
 				continue;
 			}
 
+			res.push_back({ adapter->IfIndex, adapter->IfType, name, addr });
+		}
+	}
 
-			if constexpr (sizeof(sock_addr) == sizeof(sockaddr_in6))
-			{
-				auto	wstr_len					  = (DWORD)INET6_ADDRSTRLEN;
-				wchar_t p_wstr_ipv6[INET6_ADDRSTRLEN] = { 0 };
-				// Convert the IPv6 address to a string.
-				if (::WSAAddressToStringW((LPSOCKADDR)&sock_addr, sizeof(sockaddr_in6), NULL, p_wstr_ipv6, &wstr_len) == 0)
-				{
-					logger::info(L"binding success, IPv6 Address: {}, interface description : {}", p_wstr_ipv6, adapter->Description);
-				}
-			}
-			else
-			{
-				auto	wstr_len					 = (DWORD)INET_ADDRSTRLEN;
-				wchar_t p_wstr_ipv4[INET_ADDRSTRLEN] = { 0 };
-				if (::WSAAddressToStringW((LPSOCKADDR)&sock_addr, sizeof(sockaddr_in), NULL, p_wstr_ipv4, &wstr_len) == 0)
-				{
-					logger::info(L"binding success, IPv4 Address: {}, interface description : {}", p_wstr_ipv4, adapter->Description);
-				}
-			}
+	return res;
+}
+#else
+// iana iftype of a linux interface. wired and wireless are both ARPHRD_ETHER, only sysfs tells them apart
+uint64 adapter_type(const char* name, uint16 hardware_type)
+{
+	switch (hardware_type)
+	{
+	case ARPHRD_LOOPBACK:
+		return IF_TYPE_SOFTWARE_LOOPBACK;
+	case ARPHRD_ETHER:
+	{
+		auto dir = std::filesystem::path("/sys/class/net") / name;
+		auto ec	 = std::error_code {};
+		return std::filesystem::exists(dir / "wireless", ec) or std::filesystem::exists(dir / "phy80211", ec) ? IF_TYPE_IEEE80211 : IF_TYPE_ETHERNET_CSMACD;
+	}
+	case ARPHRD_PPP:
+		return IF_TYPE_PPP;
+	case ARPHRD_NONE:
+	case ARPHRD_TUNNEL:
+	case ARPHRD_TUNNEL6:
+	case ARPHRD_SIT:
+		return IF_TYPE_TUNNEL;
+	default:
+		return IF_TYPE_OTHER;
+	}
+}
 
+// v6 address as /proc/net/if_inet6 prints it, 32 hex digits, then a space and the interface name
+std::string v6_key(const sockaddr_in6& addr, const char* name)
+{
+	auto res = std::string {};
+	for (auto byte : std::span((const uint8*)&addr.sin6_addr, sizeof(addr.sin6_addr)))
+	{
+		res += std::format("{:02x}", byte);
+	}
+	return res + " " + name;
+}
 
-			socks.emplace_back(sock);
+// v6 addresses not to bind : in duplicate address detection or failed it, or deprecated. getifaddrs leaves the flags
+// out, what windows' DadState says is in /proc/net/if_inet6
+std::unordered_set<std::string> unusable_v6_addrs()
+{
+	auto res		= std::unordered_set<std::string> {};
+	auto file		= std::ifstream("/proc/net/if_inet6");
+	auto addr		= std::string {};
+	auto name		= std::string {};
+	auto if_index	= 0u;
+	auto prefix_len = 0u;
+	auto scope		= 0u;
+	auto flags		= 0u;
+	while (file >> addr >> std::hex >> if_index >> prefix_len >> scope >> flags >> name)
+	{
+		if ((flags & (IFA_F_TENTATIVE | IFA_F_DADFAILED | IFA_F_DEPRECATED)) != 0)
+		{
+			res.insert(addr + " " + name);
+		}
+	}
+	return res;
+}
 
-			if (socks.size() >= max_count)
-			{
-				return socks;
-			}
+std::vector<net_core::adapter_addr> net_core::get_adapter_addrs(std::span<const uint64> adapter_filter, int family)
+{
+	auto	 res		= std::vector<adapter_addr> {};
+	auto	 unusable	= family == AF_INET ? std::unordered_set<std::string> {} : unusable_v6_addrs();
+	ifaddrs* p_if_addrs = nullptr;
+	if (::getifaddrs(&p_if_addrs) != 0)
+	{
+		err_msg("getifaddrs() failed");
+		return res;
+	}
+
+	// getifaddrs reads links and addresses over netlink, the AF_PACKET entry of a link carries its hardware type
+	auto types = std::unordered_map<std::string, uint64> {};
+	for (auto* p_if = p_if_addrs; p_if != nullptr; p_if = p_if->ifa_next)
+	{
+		if (p_if->ifa_addr != nullptr and p_if->ifa_addr->sa_family == AF_PACKET)
+		{
+			types[p_if->ifa_name] = adapter_type(p_if->ifa_name, ((sockaddr_ll*)p_if->ifa_addr)->sll_hatype);
+		}
+	}
+
+	for (auto* p_if = p_if_addrs; p_if != nullptr; p_if = p_if->ifa_next)
+	{
+		if (p_if->ifa_addr == nullptr or (p_if->ifa_addr->sa_family != AF_INET and p_if->ifa_addr->sa_family != AF_INET6))
+		{
+			continue;
+		}
+
+		if (family != AF_UNSPEC and p_if->ifa_addr->sa_family != family)
+		{
+			continue;
+		}
+
+		// IFF_RUNNING is the operational state, IfOperStatusUp on windows
+		if ((p_if->ifa_flags & IFF_UP) == 0 or (p_if->ifa_flags & IFF_RUNNING) == 0)
+		{
+			continue;
+		}
+
+		// a link without AF_PACKET entry is unknown, IfType 0 on windows, and passes unless it is the loopback
+		auto it		 = types.find(p_if->ifa_name);
+		auto if_type = it != types.end() ? it->second : (p_if->ifa_flags & IFF_LOOPBACK) != 0 ? IF_TYPE_SOFTWARE_LOOPBACK : 0;
+		if (if_type != 0 and std::ranges::find(adapter_filter, if_type) == adapter_filter.end())
+		{
+			continue;
+		}
+
+		auto addr = endpoint(p_if->ifa_addr);
+		if (addr.is_link_local() or (addr.is_v6() and unusable.contains(v6_key(addr.v6, p_if->ifa_name))))
+		{
+			continue;
+		}
+
+		res.push_back({ ::if_nametoindex(p_if->ifa_name), if_type, p_if->ifa_name, addr });
+	}
+
+	::freeifaddrs(p_if_addrs);
+	return res;
+}
+#endif
+
+SOCKET net_core::bind_sock(const adapter_addr& adapter, uint16 port, bool bind_device)
+{
+	auto family = adapter.addr.family();
+	auto sock	= ::socket(family, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock == INVALID_SOCKET)
+	{
+		err_msg("socket creation failed");
+		return INVALID_SOCKET;
+	}
+
+	// the v4 socket of the same port takes the v4 traffic
+	auto v6_only = 1;
+	if (family == AF_INET6 and ::setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY, (const char*)&v6_only, sizeof(v6_only)) == SOCKET_ERROR)
+	{
+		err_msg("IPV6_V6ONLY failed");
+		::closesocket(sock);
+		return INVALID_SOCKET;
+	}
+
+	if (bind_device)
+	{
+#ifdef _WIN32
+		// ipv4 wants the index in network order, ipv6 in host order
+		auto if_index = (DWORD)(family == AF_INET6 ? adapter.if_index : ::htonl(adapter.if_index));
+		auto res	  = family == AF_INET6 ? ::setsockopt(sock, IPPROTO_IPV6, IPV6_UNICAST_IF, (const char*)&if_index, sizeof(if_index))
+										   : ::setsockopt(sock, IPPROTO_IP, IP_UNICAST_IF, (const char*)&if_index, sizeof(if_index));
+#else
+		auto res = ::setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, adapter.name.c_str(), (socklen_t)adapter.name.size());
+#endif
+		if (res == SOCKET_ERROR)
+		{
+			err_msg("binding to the device failed");
+			::closesocket(sock);
+			return INVALID_SOCKET;
+		}
+	}
+
+	auto sock_addr = adapter.addr;
+	sock_addr.set_port(port);
+	if (::bind(sock, sock_addr.get(), sock_addr.size()) == SOCKET_ERROR)
+	{
+		err_msg("bind failed");
+		::closesocket(sock);
+		return INVALID_SOCKET;
+	}
+
+	logger::info("binding success, {} Address: {}, interface : {}", family == AF_INET6 ? "IPv6" : "IPv4", sock_addr.to_string(), adapter.name);
+	return sock;
+}
+
+std::vector<SOCKET> net_core::get_binded_socks(uint16 port, std::initializer_list<uint64> adapter_filter, uint32 max_count, bool bind_device, int family)
+{
+	auto socks = std::vector<SOCKET> {};
+	for (auto& adapter : get_adapter_addrs(std::span(adapter_filter.begin(), adapter_filter.size()), family))
+	{
+		auto sock = bind_sock(adapter, port, bind_device);
+		if (sock == INVALID_SOCKET)
+		{
+			continue;
+		}
+
+		socks.emplace_back(sock);
+		if (socks.size() >= max_count)
+		{
+			break;
 		}
-		// logger::info("=====================================================");
 	}
 
 	return socks;
@@ -220,15 +439,194 @@ std::string net_core::sockaddr_to_str(const sockaddr* sa, socklen_t salen)
 	return std::string(host);
 }
 
-static sockaddr_in& net_core::stun_server_sockaddr()
+std::optional<net_core::endpoint> net_core::stun_server(int family)
+{
+	auto	  hints	  = addrinfo {};
+	addrinfo* p_infos = nullptr;
+	hints.ai_family	  = family;
+	hints.ai_socktype = SOCK_DGRAM;
+	if (::getaddrinfo(STUN_SERVER_HOST, nullptr, &hints, &p_infos) == 0 and p_infos != nullptr)
+	{
+		auto res = endpoint(p_infos->ai_addr);
+		::freeaddrinfo(p_infos);
+		res.set_port(STUN_SERVER_PORT);
+		return res;
+	}
+
+	if (family == AF_INET6)
+	{
+		return std::nullopt;
+	}
+	return endpoint::parse(STUN_SERVER_IPV4, STUN_SERVER_PORT);
+}
+
+bool net_core::set_nonblocking(SOCKET sock)
+{
+#ifdef _WIN32
+	auto mode = u_long { 1 };
+	return ::ioctlsocket(sock, FIONBIO, &mode) == 0;
+#else
+	auto flags = ::fcntl(sock, F_GETFL, 0);
+	return flags != -1 and ::fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+bool net_core::interface_watcher::start(std::function<void()> on_change_func, std::chrono::milliseconds settle_time)
+{
+	if (running)
+	{
+		return false;
+	}
+
+	on_change = std::move(on_change_func);
+	settle	  = settle_time;
+
+#ifdef _WIN32
+	auto on_addr_change = [](PVOID p_context, PMIB_UNICASTIPADDRESS_ROW, MIB_NOTIFICATION_TYPE) { ((interface_watcher*)p_context)->notify(); };
+	auto on_if_change	= [](PVOID p_context, PMIB_IPINTERFACE_ROW, MIB_NOTIFICATION_TYPE) { ((interface_watcher*)p_context)->notify(); };
+
+	auto ret = ::NotifyUnicastIpAddressChange(AF_UNSPEC, on_addr_change, this, FALSE, &h_addr_notify);
+	if (ret == NO_ERROR)
+	{
+		ret = ::NotifyIpInterfaceChange(AF_UNSPEC, on_if_change, this, FALSE, &h_if_notify);
+	}
+	if (ret != NO_ERROR)
+	{
+		logger::error("registering for interface changes failed with error code {} : {}", ret, std::string(print_err(ret)));
+		if (h_addr_notify != nullptr)
+		{
+			::CancelMibChangeNotify2(h_addr_notify);
+			h_addr_notify = nullptr;
+		}
+		return false;
+	}
+#else
+	nl_sock = ::socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (nl_sock < 0)
+	{
+		err_msg("netlink socket creation failed");
+		return false;
+	}
+
+	auto nl_addr	  = sockaddr_nl {};
+	nl_addr.nl_family = AF_NETLINK;
+	nl_addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+	if (::bind(nl_sock, (sockaddr*)&nl_addr, sizeof(nl_addr)) < 0)
+	{
+		err_msg("netlink bind failed");
+		::close(nl_sock);
+		nl_sock = -1;
+		return false;
+	}
+#endif
+
+	running = true;
+	thread	= std::thread(&interface_watcher::_loop, this);
+	return true;
+}
+
+void net_core::interface_watcher::stop()
+{
+	if (running.exchange(false) is_false)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	// returns once no callback runs anymore
+	::CancelMibChangeNotify2(h_addr_notify);
+	::CancelMibChangeNotify2(h_if_notify);
+	h_addr_notify = nullptr;
+	h_if_notify	  = nullptr;
+	cv.notify_one();
+	thread.join();
+#else
+	// the loop polls with a timeout and sees running
+	thread.join();
+	::close(nl_sock);
+	nl_sock = -1;
+#endif
+}
+
+void net_core::interface_watcher::notify()
+{
+#ifdef _WIN32
+	{
+		auto lock = std::lock_guard(mutex);
+		++change_count;
+	}
+	cv.notify_one();
+#else
+	++change_count;
+#endif
+}
+
+bool net_core::interface_watcher::_wait(std::chrono::milliseconds timeout)
 {
-	static auto _stun_server_sockaddr = []() {
-		auto temp		= sockaddr_in {};
-		temp.sin_family = AF_INET;
-		inet_pton(AF_INET, "74.125.142.127", &temp.sin_addr);	 // stun.l.google.com
-		temp.sin_port = htons(19302);
-		return temp;
-	}();
+#ifdef _WIN32
+	auto lock	 = std::unique_lock(mutex);
+	auto changed = cv.wait_for(lock, timeout, [this]() { return change_count != seen_count or running is_false; }) and change_count != seen_count;
+	seen_count	 = change_count;
+	return changed;
+#else
+	auto poll_fd = pollfd { .fd = nl_sock, .events = POLLIN, .revents = 0 };
+	if (::poll(&poll_fd, 1, (int)timeout.count()) <= 0)
+	{
+		return false;
+	}
+
+	auto changed = false;
+	alignas(nlmsghdr) char buf[8192];
+	while (true)
+	{
+		auto len = (int)::recv(nl_sock, buf, sizeof(buf), MSG_DONTWAIT);
+		if (len < 0)
+		{
+			// ENOBUFS : the kernel dropped notifications, the caller rereads everything anyway
+			changed |= errno == ENOBUFS;
+			break;
+		}
+
+		for (auto* p_msg = (nlmsghdr*)buf; NLMSG_OK(p_msg, len); p_msg = NLMSG_NEXT(p_msg, len))
+		{
+			switch (p_msg->nlmsg_type)
+			{
+			case RTM_NEWADDR:
+			case RTM_DELADDR:
+			case RTM_NEWLINK:
+			case RTM_DELLINK:
+				changed = true;
+				break;
+			default:
+				break;
+			}
+		}
+	}
 
-	return _stun_server_sockaddr;
+	if (changed)
+	{
+		notify();
+	}
+	return changed;
+#endif
+}
+
+void net_core::interface_watcher::_loop()
+{
+	auto pending	 = false;
+	auto last_change = std::chrono::steady_clock::now();
+	while (running)
+	{
+		// a quiet settle after the last change fires, otherwise wake now and then to see running
+		if (_wait(pending ? settle : std::chrono::milliseconds(100)))
+		{
+			pending		= true;
+			last_change = std::chrono::steady_clock::now();
+		}
+		else if (pending and std::chrono::steady_clock::now() - last_change >= settle and running)
+		{
+			pending = false;
+			on_change();
+		}
+	}
 }
@@ -1,5 +1,54 @@
 #pragma once
+#include <vector>
+#include <string>
+#include <span>
+#include <optional>
+#include <initializer_list>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifdef _WIN32
 #define SPDLOG_WCHAR_TO_UTF8_SUPPORT
+#else
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+// the winsock names the shared code uses, so clients and server build on linux unchanged
+using SOCKET   = int;
+using LPSTR	   = char*;
+using IN_ADDR  = in_addr;
+using IN6_ADDR = in6_addr;
+
+#define INVALID_SOCKET -1
+#define SOCKET_ERROR   -1
+
+// iana iftype values, as windows reports them in IP_ADAPTER_ADDRESSES::IfType
+#define IF_TYPE_OTHER			   1
+#define IF_TYPE_ETHERNET_CSMACD	   6
+#define IF_TYPE_PPP				   23
+#define IF_TYPE_SOFTWARE_LOOPBACK  24
+#define IF_TYPE_IEEE80211		   71
+#define IF_TYPE_TUNNEL			   131
+
+inline int WSAGetLastError()
+{
+	return errno;
+}
+
+inline int closesocket(SOCKET sock)
+{
+	return ::close(sock);
+}
+#endif
+
 #include <spdlog/spdlog.h>
 
 #define is_false   == false
@@ -11,6 +60,8 @@
 #define PORT_SERVER 12345
 #define PORT_CLIENT 12346
 
+#define STUN_SERVER_HOST "stun.l.google.com"
+#define STUN_SERVER_PORT 19302
 #define STUN_SERVER_IPV4 "74.125.142.127"
 
 using uint64 = uint64_t;
@@ -69,6 +120,19 @@ struct packet_3
 	uint64 time_client_recv = 0;
 };
 
+// a registered client whose socket moved to another address (dhcp renew, roaming), the server keeps its session and
+// models and answers with packet_1 of the same id
+struct packet_4
+{
+	uint16 type = 4;
+	uint32 client_id;
+	// next seq_num the client sends, the numbering goes on across the move
+	uint32 seq_num		= 0;
+	uint32 rebind_count = 0;
+	// ns between the old socket going down and this packet
+	uint64 gap			= 0;
+};
+
 struct packet_6
 {
 	uint16 type = 6;
@@ -79,9 +143,128 @@ struct packet_6
 
 namespace net_core
 {
-	std::vector<SOCKET> get_binded_socks(uint16 port, std::initializer_list<uint64> adapter_filter, uint32 max_count = -1);
+	// ipv4 or ipv6 address with port, what the socket calls take as sockaddr* and length.
+	// a v4 endpoint stays a plain sockaddr_in (no v4-mapped v6), so v4 paths copy and compare what they did before
+	struct endpoint
+	{
+		union
+		{
+			sockaddr	 sa;
+			sockaddr_in	 v4;
+			sockaddr_in6 v6;
+		};
+
+		endpoint() : v6 {} { }
+
+		endpoint(const sockaddr_in& addr) : v6 {} { v4 = addr; }
+
+		endpoint(const sockaddr_in6& addr) : v6(addr) { }
+
+		// sa_family picks how much is read
+		explicit endpoint(const sockaddr* p_addr);
+
+		uint16	  family() const { return sa.sa_family; }
+		bool	  is_v6() const { return sa.sa_family == AF_INET6; }
+		socklen_t size() const { return is_v6() ? sizeof(sockaddr_in6) : sizeof(sockaddr_in); }
+
+		sockaddr*		get() { return &sa; }
+		const sockaddr* get() const { return &sa; }
+
+		uint16 port() const { return ntohs(is_v6() ? v6.sin6_port : v4.sin_port); }
+		void   set_port(uint16 port) { (is_v6() ? v6.sin6_port : v4.sin_port) = htons(port); }
+
+		// 169.254/16 or fe80::/10
+		bool is_link_local() const;
+
+		// address (and scope for link-local), not the port : a host is the same whatever port its nat picked
+		bool same_host(const endpoint& other) const;
+
+		bool operator==(const endpoint& other) const { return same_host(other) and port() == other.port(); }
+
+		// 1.2.3.4:5 or [fe80::1%3]:5
+		std::string to_string() const;
+
+		// numeric host only, 1.2.3.4 or 2001:db8::1 or fe80::1%eth0 (fe80::1%3 on windows)
+		static std::optional<endpoint> parse(const char* host, uint16 port);
+	};
+
+	// an up, non link-local address of an adapter
+	struct adapter_addr
+	{
+		uint32		if_index;
+		uint64		if_type;
+		// interface name on linux, adapter description on windows
+		std::string name;
+		// port 0, sin6_scope_id as the os reports it
+		endpoint	addr;
+
+		bool operator==(const adapter_addr& other) const { return if_index == other.if_index and addr.same_host(other.addr); }
+	};
+
+	// addresses of family (AF_INET, AF_INET6 or AF_UNSPEC for both) of the adapters whose iftype is in adapter_filter
+	// (an adapter of unknown type passes), loopback only when IF_TYPE_SOFTWARE_LOOPBACK is in the filter.
+	// v6 addresses still in duplicate address detection or deprecated are left out
+	std::vector<adapter_addr> get_adapter_addrs(std::span<const uint64> adapter_filter, int family = AF_UNSPEC);
+
+	// udp socket of adapter.addr's family bound to port on it, INVALID_SOCKET on failure. a v6 socket is v6 only.
+	// bind_device also pins it to the adapter (IP_UNICAST_IF / IPV6_UNICAST_IF on windows, SO_BINDTODEVICE on linux,
+	// which needs CAP_NET_RAW), so traffic to any destination leaves through that nic instead of whatever the routing
+	// table picks
+	SOCKET bind_sock(const adapter_addr& adapter, uint16 port, bool bind_device = false);
+
+	// bind_sock on every get_adapter_addrs, at most max_count sockets
+	std::vector<SOCKET> get_binded_socks(uint16 port, std::initializer_list<uint64> adapter_filter, uint32 max_count = -1, bool bind_device = false, int family = AF_INET);
 	std::string			sockaddr_to_str(const sockaddr* sa, socklen_t salen);
-	static sockaddr_in& stun_server_sockaddr();
+
+	// STUN_SERVER_HOST resolved to family, STUN_SERVER_IPV4 when that fails for v4
+	std::optional<endpoint> stun_server(int family = AF_INET);
+
+	// recvfrom on it returns instead of waiting for a datagram
+	bool set_nonblocking(SOCKET sock);
+
+	// calls on_change from its own thread once link or address changes went quiet for settle.
+	// it carries no details : after a burst, or a notification the kernel dropped, the caller reads get_adapter_addrs
+	// again and diffs it against what it has bound.
+	//	linux	netlink route socket on RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR, RTM_NEWADDR / DELADDR / NEWLINK / DELLINK
+	//	windows	NotifyUnicastIpAddressChange and NotifyIpInterfaceChange on AF_UNSPEC
+	// both families, so slaac, privacy address rotation and a dhcpv6 renew wake a v6-only client too
+	struct interface_watcher
+	{
+		std::function<void()>	  on_change;
+		std::chrono::milliseconds settle;
+		std::atomic<bool>		  running	   = false;
+		std::atomic<uint64>		  change_count = 0;
+		std::thread				  thread;
+#ifdef _WIN32
+		HANDLE					  h_addr_notify = nullptr;
+		HANDLE					  h_if_notify	= nullptr;
+		std::mutex				  mutex;
+		std::condition_variable	  cv;
+		uint64					  seen_count	= 0;
+#else
+		int						  nl_sock = -1;
+#endif
+
+		interface_watcher() = default;
+
+		interface_watcher(const interface_watcher&)			   = delete;
+		interface_watcher& operator=(const interface_watcher&) = delete;
+
+		~interface_watcher() { stop(); }
+
+		// false when the os refused the subscription
+		bool start(std::function<void()> on_change, std::chrono::milliseconds settle = std::chrono::milliseconds(100));
+		// not from on_change, it joins the thread that runs it
+		void stop();
+
+		// any thread, what the os notifications call
+		void notify();
+
+	  private:
+		// true when something changed within timeout
+		bool _wait(std::chrono::milliseconds timeout);
+		void _loop();
+	};
 }	 // namespace net_core
 
 namespace logger
@@ -126,11 +309,13 @@ namespace logger
 		detail::_logger->info(fmt, std::forward<Args>(args)...);
 	}
 
+#ifdef _WIN32
 	template <typename... Args>
 	inline void info(spdlog::wformat_string_t<Args...> fmt, Args&&... args)
 	{
 		detail::_logger->info(fmt, std::forward<Args>(args)...);
 	}
+#endif
 
 	template <typename T>
 	inline void info(const T& msg)
@@ -180,4 +365,7 @@ namespace utils
 	std::string ip6addr_to_string(IN6_ADDR addr);
 
 	uint64 time_now();
+
+	// monotonic ns, for timers. time_now() is wall clock for the packets
+	uint64 steady_now();
 }	 // namespace utils
@@ -0,0 +1,252 @@
+#include <array>
+#include <span>
+#include <ranges>
+#include <random>
+#include <mutex>
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#endif
+
+#include "stun.h"
+
+namespace
+{
+	using namespace net_core::stun;
+
+	constexpr uint32 fingerprint_xor = 0x5354554e;
+
+	constexpr auto crc_table = []() {
+		auto table = std::array<uint32, 256> {};
+		for (auto idx : std::views::iota(0u, 256u))
+		{
+			auto crc = idx;
+			for (auto _ : std::views::iota(0, 8))
+			{
+				crc = (crc & 1) != 0 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+			}
+			table[idx] = crc;
+		}
+		return table;
+	}();
+
+	// crc-32 of iso 3309, what fingerprint takes
+	uint32 crc32(std::span<const char> data)
+	{
+		auto crc = ~0u;
+		for (auto c : data)
+		{
+			crc = crc_table[(crc ^ (uint8)c) & 0xff] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	uint16 read_u16(const char* p) { return (uint16)((uint8)p[0] << 8 | (uint8)p[1]); }
+
+	uint32 read_u32(const char* p) { return (uint32)read_u16(p) << 16 | read_u16(p + 2); }
+
+	void write_u16(char* p, uint16 v)
+	{
+		p[0] = (char)(v >> 8);
+		p[1] = (char)v;
+	}
+
+	void write_u32(char* p, uint32 v)
+	{
+		write_u16(p, (uint16)(v >> 16));
+		write_u16(p + 2, (uint16)v);
+	}
+
+	// header with a zero length, attributes go after it
+	std::size_t write_header(std::span<char> out, uint16 type, const transaction_id& id)
+	{
+		write_u16(out.data(), type);
+		write_u16(out.data() + 2, 0);
+		write_u32(out.data() + 4, magic_cookie);
+		std::memcpy(out.data() + 8, id.data(), id.size());
+		return header_size;
+	}
+
+	// appends fingerprint, the length field counts it before the crc is taken
+	std::size_t finish(std::span<char> out, std::size_t len)
+	{
+		write_u16(out.data() + 2, (uint16)(len + 8 - header_size));
+		write_u16(out.data() + len, fingerprint);
+		write_u16(out.data() + len + 2, 4);
+		write_u32(out.data() + len + 4, crc32(out.first(len)) ^ fingerprint_xor);
+		return len + 8;
+	}
+
+	// (xor-)mapped-address value : 0, family, port, address. xor with the cookie, and the transaction id for v6
+	std::optional<net_core::endpoint> read_address(const char* p, uint16 len, const transaction_id& id, bool xored)
+	{
+		if (len < 4)
+		{
+			return std::nullopt;
+		}
+
+		auto family = (uint8)p[1];
+		auto port	= (uint16)(read_u16(p + 2) ^ (xored ? magic_cookie >> 16 : 0));
+		auto mask	= std::array<uint8, 16> {};
+		if (xored)
+		{
+			write_u32((char*)mask.data(), magic_cookie);
+			std::memcpy(mask.data() + 4, id.data(), id.size());
+		}
+
+		auto res = net_core::endpoint {};
+		if (family == 0x01 and len == 8)
+		{
+			auto addr = sockaddr_in {};
+			auto* dst = (uint8*)&addr.sin_addr;
+			for (auto idx : std::views::iota(0, 4))
+			{
+				dst[idx] = (uint8)p[4 + idx] ^ mask[idx];
+			}
+			addr.sin_family = AF_INET;
+			res				= addr;
+		}
+		else if (family == 0x02 and len == 20)
+		{
+			auto addr = sockaddr_in6 {};
+			auto* dst = (uint8*)&addr.sin6_addr;
+			for (auto idx : std::views::iota(0, 16))
+			{
+				dst[idx] = (uint8)p[4 + idx] ^ mask[idx];
+			}
+			addr.sin6_family = AF_INET6;
+			res				 = addr;
+		}
+		else
+		{
+			return std::nullopt;
+		}
+
+		res.set_port(port);
+		return res;
+	}
+}	 // namespace
+
+bool net_core::stun::is_message(std::span<const char> data)
+{
+	if (data.size() < header_size or ((uint8)data[0] & 0xc0) != 0 or read_u32(data.data() + 4) != magic_cookie)
+	{
+		return false;
+	}
+
+	auto len = read_u16(data.data() + 2);
+	return len % 4 == 0 and len + header_size == data.size();
+}
+
+std::optional<net_core::stun::message> net_core::stun::parse(std::span<const char> data)
+{
+	if (is_message(data) is_false)
+	{
+		return std::nullopt;
+	}
+
+	auto res = message { .type = read_u16(data.data()) };
+	std::memcpy(res.id.data(), data.data() + 8, res.id.size());
+
+	auto mapped = std::optional<endpoint> {};
+	auto pos	= header_size;
+	while (pos + 4 <= data.size())
+	{
+		auto type = read_u16(data.data() + pos);
+		auto len  = read_u16(data.data() + pos + 2);
+		auto* p	  = data.data() + pos + 4;
+		if (pos + 4 + len > data.size())
+		{
+			return std::nullopt;
+		}
+
+		switch (type)
+		{
+		case xor_mapped_address:
+			res.mapped = read_address(p, len, res.id, true);
+			break;
+		case mapped_address:
+			mapped = read_address(p, len, res.id, false);
+			break;
+		case error_code:
+			if (len >= 4)
+			{
+				res.error = (uint16)(((uint8)p[2] & 0x07) * 100 + (uint8)p[3]);
+			}
+			break;
+		case fingerprint:
+			// the last attribute, over everything before it
+			if (len != 4 or pos + 8 != data.size() or (read_u32(p) ^ fingerprint_xor) != crc32(data.first(pos)))
+			{
+				return std::nullopt;
+			}
+			break;
+		default:
+			break;
+		}
+
+		// values are padded to 4 bytes
+		pos += 4 + (len + 3) / 4 * 4;
+	}
+
+	if (res.mapped.has_value() is_false)
+	{
+		res.mapped = mapped;
+	}
+	return res;
+}
+
+std::size_t net_core::stun::write_request(std::span<char> out, const transaction_id& id)
+{
+	return finish(out, write_header(out, binding_request, id));
+}
+
+std::size_t net_core::stun::write_success(std::span<char> out, const transaction_id& id, const endpoint& mapped)
+{
+	auto len  = write_header(out, binding_success, id);
+	auto size = (uint16)(mapped.is_v6() ? 20 : 8);
+	auto* p	  = out.data() + len;
+	write_u16(p, xor_mapped_address);
+	write_u16(p + 2, size);
+	p[4] = 0;
+	p[5] = mapped.is_v6() ? 0x02 : 0x01;
+	write_u16(p + 6, (uint16)(mapped.port() ^ (magic_cookie >> 16)));
+
+	auto mask = std::array<uint8, 16> {};
+	write_u32((char*)mask.data(), magic_cookie);
+	std::memcpy(mask.data() + 4, id.data(), id.size());
+	auto* src = mapped.is_v6() ? (const uint8*)&mapped.v6.sin6_addr : (const uint8*)&mapped.v4.sin_addr;
+	for (auto idx : std::views::iota(0, size - 4))
+	{
+		p[8 + idx] = (char)(src[idx] ^ mask[idx]);
+	}
+
+	return finish(out, len + 4 + size);
+}
+
+std::size_t net_core::stun::respond(std::span<const char> data, const endpoint& from, std::span<char> out)
+{
+	auto msg = parse(data);
+	if (msg.has_value() is_false or msg->type != binding_request)
+	{
+		return 0;
+	}
+	return write_success(out, msg->id, from);
+}
+
+net_core::stun::transaction_id net_core::stun::new_transaction_id()
+{
+	// 96 random bits per rfc 5389, only the stun paths draw them
+	static auto mutex = std::mutex {};
+	static auto rng	  = std::mt19937_64(std::random_device {}());
+
+	auto lock = std::lock_guard(mutex);
+	auto res  = transaction_id {};
+	for (auto idx : std::views::iota(0uz, res.size()))
+	{
+		res[idx] = (uint8)rng();
+	}
+	return res;
+}
@@ -0,0 +1,285 @@
+#pragma once
+#include <array>
+#include <span>
+#include <optional>
+#include <limits>
+#include <algorithm>
+#include "core.h"
+
+// rfc 5389 binding requests : the public address a nat maps a socket to, when that moves, and how long the nat keeps an
+// idle mapping. nothing here owns a socket, a thread or a clock : the loop that owns the socket passes datagrams in
+// with the time and sends what tick() hands out, so the same code runs on a server's event loop and in a test with
+// simulated time
+namespace net_core::stun
+{
+	constexpr uint32	  magic_cookie = 0x2112A442;
+	constexpr std::size_t header_size  = 20;
+	// request with fingerprint is 28, a success with a v6 mapping and fingerprint 52
+	constexpr std::size_t max_message_size = 548;
+
+	enum message_type : uint16
+	{
+		binding_request = 0x0001,
+		binding_success = 0x0101,
+		binding_error	= 0x0111,
+	};
+
+	enum attribute_type : uint16
+	{
+		mapped_address	   = 0x0001,
+		error_code		   = 0x0009,
+		xor_mapped_address = 0x0020,
+		software		   = 0x8022,
+		fingerprint		   = 0x8028,
+	};
+
+	using transaction_id = std::array<uint8, 12>;
+
+	struct message
+	{
+		uint16					type;
+		transaction_id			id;
+		// xor-mapped-address, mapped-address from an old server without it
+		std::optional<endpoint> mapped;
+		// class * 100 + number of an error response
+		uint16					error = 0;
+	};
+
+	// header only : top bits 00, magic cookie, length in 4 byte steps that matches. cheap enough for every datagram,
+	// the application packets of this repo never pass it
+	bool is_message(std::span<const char> data);
+
+	// full parse with the fingerprint checked when present, nullopt for anything malformed
+	std::optional<message> parse(std::span<const char> data);
+
+	// the message size, out must hold max_message_size
+	std::size_t write_request(std::span<char> out, const transaction_id& id);
+	std::size_t write_success(std::span<char> out, const transaction_id& id, const endpoint& mapped);
+
+	// what a stun server answers a binding request from `from` with, 0 when data is not one
+	std::size_t respond(std::span<const char> data, const endpoint& from, std::span<char> out);
+
+	transaction_id new_transaction_id();
+
+	struct client_config
+	{
+		// rfc 5389 7.2.1 : rto doubles from 500 ms, the transaction fails last_wait rto after the last of max_sends sends
+		uint64 rto_ns	  = 500'000'000;
+		uint32 max_sends  = 7;
+		uint32 last_wait  = 16;
+		// a successful binding is asked again after this, 0 asks only when request_at() says so
+		uint64 refresh_ns = 30'000'000'000;
+	};
+
+	enum class event_kind : uint8
+	{
+		mapped,		  // first answer, or the first after a timeout
+		refreshed,	  // same mapping as before
+		changed,	  // the nat maps the socket somewhere else now
+		timeout,	  // no answer within the retransmissions
+		error,		  // the server answered with an error code
+	};
+
+	struct client_event
+	{
+		event_kind kind;
+		endpoint   mapped;
+		endpoint   previous;
+		// from the last send of the transaction, so a retransmission is not counted (karn)
+		uint64	   rtt_ns;
+		uint16	   error;
+	};
+
+	// binding transactions from one socket to one stun server, the socket's public mapping and when it moves
+	struct client
+	{
+		client_config			config;
+		endpoint				server;
+		std::optional<endpoint> mapped;
+
+		transaction_id id {};
+		bool		   in_flight  = false;
+		uint32		   send_count = 0;
+		uint64		   last_send  = 0;
+		uint64		   rto		  = 0;
+		// when tick() sends next : a new transaction or a retransmission
+		uint64		   next_send  = 0;
+
+		explicit client(const endpoint& server, client_config config = {}) : config(config), server(server) { }
+
+		// the next transaction starts at when, or right now if one is due earlier
+		void request_at(uint64 when)
+		{
+			if (in_flight is_false)
+			{
+				next_send = when;
+			}
+		}
+
+		// send(std::span<const char>) sends a message to server from the socket, emit(const client_event&) reports a
+		// timeout. returns when tick() has something to do next
+		template <typename t_send, typename t_emit>
+		uint64 tick(uint64 now, t_send&& send, t_emit&& emit)
+		{
+			if (now < next_send)
+			{
+				return next_send;
+			}
+
+			if (in_flight and send_count >= config.max_sends)
+			{
+				in_flight = false;
+				next_send = config.refresh_ns == 0 ? std::numeric_limits<uint64>::max() : now + config.refresh_ns;
+				emit(client_event { .kind = event_kind::timeout, .mapped = mapped.value_or(endpoint {}), .previous = mapped.value_or(endpoint {}) });
+				// a timeout is not a change, but the next answer has nothing to compare against
+				mapped.reset();
+				return next_send;
+			}
+
+			if (in_flight is_false)
+			{
+				in_flight  = true;
+				id		   = new_transaction_id();
+				send_count = 0;
+				rto		   = config.rto_ns;
+			}
+
+			auto buf = std::array<char, max_message_size> {};
+			auto len = write_request(buf, id);
+			send(std::span<const char>(buf.data(), len));
+
+			++send_count;
+			last_send  = now;
+			next_send  = now + (send_count >= config.max_sends ? config.rto_ns * config.last_wait : rto);
+			rto		  *= 2;
+			return next_send;
+		}
+
+		// data arrived from server. true when it answers the transaction in flight, emit(const client_event&) once then
+		template <typename t_emit>
+		bool on_message(std::span<const char> data, uint64 now, t_emit&& emit)
+		{
+			if (in_flight is_false or is_message(data) is_false)
+			{
+				return false;
+			}
+
+			auto msg = parse(data);
+			if (msg.has_value() is_false or msg->id != id or (msg->type != binding_success and msg->type != binding_error))
+			{
+				return false;
+			}
+
+			in_flight = false;
+			next_send = config.refresh_ns == 0 ? std::numeric_limits<uint64>::max() : now + config.refresh_ns;
+
+			auto event = client_event { .rtt_ns = now - last_send, .error = msg->error };
+			if (msg->type == binding_error or msg->mapped.has_value() is_false)
+			{
+				event.kind = event_kind::error;
+				emit(event);
+				return true;
+			}
+
+			event.mapped   = *msg->mapped;
+			event.previous = mapped.value_or(*msg->mapped);
+			event.kind	   = mapped.has_value() is_false ? event_kind::mapped : *mapped == *msg->mapped ? event_kind::refreshed : event_kind::changed;
+			mapped		   = msg->mapped;
+			emit(event);
+			return true;
+		}
+	};
+
+	struct lifetime_config
+	{
+		uint64 first_gap_ns	 = 15'000'000'000;
+		uint64 max_gap_ns	 = 600'000'000'000;
+		// the search stops once the lost and kept gaps are this close
+		uint64 resolution_ns = 5'000'000'000;
+		// wait after a timeout before the next try
+		uint64 retry_ns		 = 5'000'000'000;
+	};
+
+	// how long the nat keeps an idle udp binding, from a socket that sends nothing else : ask, stay idle for a gap, ask
+	// again. the same mapped address after the gap means the nat kept the binding at least that long, another one means
+	// it expired. the gap doubles from first_gap until a binding is lost, then a binary search between the longest gap
+	// that kept it and the shortest that lost it. every answer refreshes the binding, so each gap starts there.
+	// a nat that hands the same port out again after expiry looks like one that kept it, on those the result is an
+	// upper bound
+	struct lifetime_probe
+	{
+		lifetime_config config;
+		client			transactions;
+		// longest idle gap the binding survived and shortest it did not, 0 none yet
+		uint64			kept_ns	   = 0;
+		uint64			lost_ns	   = 0;
+		// the gap the coming answer tells about, 0 when it only sets the baseline
+		uint64			testing_ns = 0;
+
+		explicit lifetime_probe(const endpoint& server, lifetime_config config = {}) :
+			config(config), transactions(server, client_config { .refresh_ns = 0 })
+		{
+		}
+
+		bool done() const { return (lost_ns != 0 and lost_ns - kept_ns <= config.resolution_ns) or kept_ns >= config.max_gap_ns; }
+
+		// a keepalive this often keeps the binding, with a fifth of margin. 0 until a gap was kept
+		uint64 keepalive_ns() const { return kept_ns / 5 * 4; }
+
+		uint64 next_gap() const
+		{
+			if (lost_ns == 0)
+			{
+				return kept_ns == 0 ? config.first_gap_ns : std::min(kept_ns * 2, config.max_gap_ns);
+			}
+			return (kept_ns + lost_ns) / 2;
+		}
+
+		template <typename t_send, typename t_emit>
+		uint64 tick(uint64 now, t_send&& send, t_emit&& emit)
+		{
+			return transactions.tick(now, send, [&](const client_event& event) {
+				testing_ns = 0;
+				transactions.request_at(now + config.retry_ns);
+				emit(event);
+			});
+		}
+
+		// emit(const client_event&) after kept_ns / lost_ns took the answer in
+		template <typename t_emit>
+		bool on_message(std::span<const char> data, uint64 now, t_emit&& emit)
+		{
+			return transactions.on_message(data, now, [&](const client_event& event) {
+				if (event.kind == event_kind::error)
+				{
+					testing_ns = 0;
+					transactions.request_at(now + config.retry_ns);
+					emit(event);
+					return;
+				}
+
+				if (testing_ns != 0)
+				{
+					if (event.kind == event_kind::changed)
+					{
+						lost_ns = lost_ns == 0 ? testing_ns : std::min(lost_ns, testing_ns);
+					}
+					else if (event.kind == event_kind::refreshed)
+					{
+						kept_ns = std::max(kept_ns, testing_ns);
+					}
+
+					// the nat kept a binding longer than one it lost before, its timer is not fixed : search again upwards
+					if (lost_ns != 0 and kept_ns >= lost_ns)
+					{
+						lost_ns = 0;
+					}
+				}
+
+				testing_ns = done() ? 0 : next_gap();
+				transactions.request_at(testing_ns == 0 ? std::numeric_limits<uint64>::max() : now + testing_ns);
+				emit(event);
+			});
+		}
+	};
+}	 // namespace net_core::stun